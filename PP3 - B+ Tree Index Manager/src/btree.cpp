@@ -8,20 +8,50 @@
 
 #include "btree.h"
 #include <algorithm>
+#include "exceptions/bad_fill_factor_exception.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scan_param_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
-#include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
+#include "external_sort.h"
 #include "filescan.h"
+#include "key_search.h"
+#include "parallel_scan.h"
 
 using namespace std;
 
 namespace badgerdb {
 
+// the bounds of a scan, one pair of members per type of key
+template <>
+int &BTreeScanCursor::lowVal<int>() {
+  return lowValInt;
+}
+template <>
+int &BTreeScanCursor::highVal<int>() {
+  return highValInt;
+}
+template <>
+double &BTreeScanCursor::lowVal<double>() {
+  return lowValDouble;
+}
+template <>
+double &BTreeScanCursor::highVal<double>() {
+  return highValDouble;
+}
+template <>
+StringKey &BTreeScanCursor::lowVal<StringKey>() {
+  return lowValString;
+}
+template <>
+StringKey &BTreeScanCursor::highVal<StringKey>() {
+  return highValString;
+}
+
 // ##################################################################### //
 // ##################################################################### //
 // ##################################################################### //
@@ -31,15 +61,24 @@ namespace badgerdb {
 // ##################################################################### //
 
 /**
- * Alloca a page in the buffer for an internal node
+ * Alloca a page in the buffer for an internal node, taking the first page of
+ * the free list if there is one.
  *
  * @param newPageId the page number for the new node
  * @return a pointer to the new internal node
  */
-NonLeafNodeInt *BTreeIndex::allocNonLeafNode(PageId &newPageId) {
-  NonLeafNodeInt *newNode;
-  bufMgr->allocPage(file, newPageId, (Page *&)newNode);
-  memset(newNode, 0, Page::SIZE);
+template <class T>
+NonLeafNode<T> *BTreeIndex::allocNonLeafNode(PageId &newPageId) {
+  NonLeafNode<T> *newNode;
+  if (indexMetaInfo.freePageNo != 0) {
+    newPageId = indexMetaInfo.freePageNo;
+    bufMgr->readPage(file, newPageId, (Page *&)newNode);
+    indexMetaInfo.freePageNo = ((FreeNode *)newNode)->nextFreePageNo;
+    writeMetaInfo();
+  } else {
+    bufMgr->allocPage(file, newPageId, (Page *&)newNode);
+  }
+  memset(reinterpret_cast<char *>(newNode), 0, Page::SIZE);
   return newNode;
 }
 
@@ -49,12 +88,51 @@ NonLeafNodeInt *BTreeIndex::allocNonLeafNode(PageId &newPageId) {
  * @param newPageId the page number for the new node
  * @return a pointer to the new leaf node
  */
-LeafNodeInt *BTreeIndex::allocLeafNode(PageId &newPageId) {
-  LeafNodeInt *newNode = (LeafNodeInt *)allocNonLeafNode(newPageId);
+template <class T>
+LeafNode<T> *BTreeIndex::allocLeafNode(PageId &newPageId) {
+  LeafNode<T> *newNode = (LeafNode<T> *)allocNonLeafNode<T>(newPageId);
   newNode->level = -1;
   return newNode;
 }
 
+/**
+ * Put a page no longer used by the tree at the head of the free list.
+ *
+ * @param pageNo the page to free
+ */
+void BTreeIndex::freePage(PageId pageNo) {
+  Page *page;
+  bufMgr->readPage(file, pageNo, page);
+  memset(reinterpret_cast<char *>(page), 0, Page::SIZE);
+  FreeNode *node = (FreeNode *)page;
+  node->flags = FREE_NODE;
+  node->nextFreePageNo = indexMetaInfo.freePageNo;
+  bufMgr->unPinPage(file, pageNo, true);
+
+  indexMetaInfo.freePageNo = pageNo;
+  writeMetaInfo();
+}
+
+/**
+ * Put every page of the subtree with the given root on the free list.
+ *
+ * @param pageNo the page of the root of the subtree
+ */
+template <class T>
+void BTreeIndex::freeSubtree(PageId pageNo) {
+  Page *page;
+  bufMgr->readPage(file, pageNo, page);
+  vector<PageId> children;
+  if (!isLeaf(page)) {
+    NonLeafNode<T> *node = (NonLeafNode<T> *)page;
+    children.assign(node->pageNoArray, node->pageNoArray + node->count + 1);
+  }
+  bufMgr->unPinPage(file, pageNo, false);
+
+  for (PageId child : children) freeSubtree<T>(child);
+  freePage(pageNo);
+}
+
 // ##################################################################### //
 // ##################################################################### //
 // ##################################################################### //
@@ -63,6 +141,17 @@ LeafNodeInt *BTreeIndex::allocLeafNode(PageId &newPageId) {
 // ##################################################################### //
 // ##################################################################### //
 
+/**
+ * Reject a bulk load fill factor outside (0, 1], NaN included.
+ *
+ * @param fillFactor the fraction of each node to fill
+ * @throws BadFillFactorException If the fill factor is out of range.
+ */
+static void checkFillFactor(double fillFactor) {
+  if (!(fillFactor > 0 && fillFactor <= 1))
+    throw BadFillFactorException(fillFactor);
+}
+
 /**
  * Constructor
  *
@@ -72,16 +161,32 @@ LeafNodeInt *BTreeIndex::allocLeafNode(PageId &newPageId) {
  *
  * If the index ﬁle exists, the ﬁle is opened. Else, a new index ﬁle is created.
  *
+ * An existing index is opened by reading only its meta page, which is checked
+ * against the constructor parameters; the base relation is not scanned. A new
+ * index stores its meta info on the first page and is then built from the
+ * base relation.
+ *
  * @param relationName The name of the relation on which to build the index.
  * @param outIndexName The name of the index file.
  * @param bufMgrIn The instance of the global buffer manager.
  * @param attrByteOffset The byte offset of the attribute in the tuple on which
  * to build the index.
  * @param attrType The data type of the attribute we are indexing.
+ * @param buildMode Whether to insert the tuples one at a time or to bulk load
+ * them.
+ * @param fillFactor The fraction of each node filled by a bulk load.
+ * @throws BadIndexInfoException If the index file exists but its meta page
+ * does not match the relation name, attribute offset or attribute type, or
+ * the index was written in another format version.
+ * @throws BadFillFactorException If a bulk load is asked for a fill factor
+ * outside (0, 1].
  */
 BTreeIndex::BTreeIndex(const string &relationName, string &outIndexName,
                        BufMgr *bufMgrIn, const int attrByteOffset_,
-                       const Datatype attrType) {
+                       const Datatype attrType, const BuildMode buildMode,
+                       const double fillFactor) {
+  if (buildMode == BULK_BUILD) checkFillFactor(fillFactor);
+
   bufMgr = bufMgrIn;
   attrByteOffset = attrByteOffset_;
   attributeType = attrType;
@@ -93,26 +198,128 @@ BTreeIndex::BTreeIndex(const string &relationName, string &outIndexName,
   relationName.copy(indexMetaInfo.relationName, 20, 0);
   indexMetaInfo.attrByteOffset = attrByteOffset;
   indexMetaInfo.attrType = attrType;
+  indexMetaInfo.formatVersion = INDEX_FORMAT_VERSION;
+
+  // open an existing index by reading only its meta page
+  if (File::exists(outIndexName)) {
+    file = new BlobFile(outIndexName, false);
+    headerPageNum = file->getFirstPageNo();
+
+    Page *metaPage;
+    bufMgr->readPage(file, headerPageNum, metaPage);
+    IndexMetaInfo *meta = (IndexMetaInfo *)metaPage;
+    IndexMetaInfo stored = *meta;
+    bufMgr->unPinPage(file, headerPageNum, false);
+
+    if (strncmp(stored.relationName, indexMetaInfo.relationName,
+                sizeof(stored.relationName)) != 0 ||
+        stored.attrByteOffset != attrByteOffset ||
+        stored.attrType != attrType || stored.rootPageNo == 0 ||
+        stored.formatVersion != INDEX_FORMAT_VERSION) {
+      bufMgr->flushFile(file);
+      delete file;
+      file = nullptr;
+      throw BadIndexInfoException(outIndexName);
+    }
+
+    indexMetaInfo.rootPageNo = stored.rootPageNo;
+    indexMetaInfo.freePageNo = stored.freePageNo;
+    return;
+  }
 
   file = new BlobFile(outIndexName, true);
 
-  allocLeafNode(indexMetaInfo.rootPageNo);
+  // the first page of the file holds the meta info
+  Page *metaPage;
+  bufMgr->allocPage(file, headerPageNum, metaPage);
+  memset(reinterpret_cast<char *>(metaPage), 0, Page::SIZE);
+  bufMgr->unPinPage(file, headerPageNum, true);
+
+  switch (attributeType) {
+    case INTEGER:
+      buildFromRelation<int>(relationName, buildMode, fillFactor);
+      break;
+    case DOUBLE:
+      buildFromRelation<double>(relationName, buildMode, fillFactor);
+      break;
+    case STRING:
+      buildFromRelation<StringKey>(relationName, buildMode, fillFactor);
+      break;
+  }
+}
+
+/**
+ * Fill a new index from the base relation, by inserting every record or by
+ * bulk loading them.
+ *
+ * @param relationName The name of the relation on which the index is built.
+ * @param buildMode Whether to insert the tuples one at a time or to bulk load
+ * them.
+ * @param fillFactor The fraction of each node filled by a bulk load.
+ */
+template <class T>
+void BTreeIndex::buildFromRelation(const string &relationName,
+                                   BuildMode buildMode, double fillFactor) {
+  // the relation is read through a small ring of frames so the scan does not
+  // push everything else out of the buffer pool
+  BufAccessStrategy scanStrategy;
+  ScanRecord batch[FileScan::DEFAULT_BATCH_SIZE];
+  std::size_t count;
+
+  if (buildMode == BULK_BUILD) {
+    // sort every key-record pair with an external sort, fed by a parallel
+    // scan whose workers each write runs of their own, and pack the tree
+    // bottom-up from the merged runs
+    ParallelScan pscan(relationName, bufMgr);
+    pscan.setRingSize(BufAccessStrategy::DEFAULT_RING_SIZE);
+    ExternalSort<T> sorter(bufMgr, file->filename() + ".sort",
+                           pscan.numWorkers());
+    const int keyOffset = attrByteOffset;
+    pscan.run([&sorter, keyOffset](int worker, const ScanRecord *records,
+                                   std::size_t numRecords) {
+      for (std::size_t i = 0; i < numRecords; i++) {
+        RIDKeyPair<T> entry;
+        entry.set(records[i].rid,
+                  KeyTraits<T>::read(records[i].record.data() + keyOffset));
+        sorter.add(worker, entry);
+      }
+    });
+    sorter.finish();
+
+    buildTree<T>(sorter.size(),
+                 [&sorter]() {
+                   RIDKeyPair<T> entry;
+                   sorter.next(entry);
+                   return entry;
+                 },
+                 fillFactor);
+    return;
+  }
+
+  allocLeafNode<T>(indexMetaInfo.rootPageNo);
   bufMgr->unPinPage(file, indexMetaInfo.rootPageNo, true);
+  writeMetaInfo();
 
-  FileScan fscan(relationName, bufMgr);
-  try {
-    RecordId scanRid;
-    while (1) {
-      fscan.scanNext(scanRid);
-      std::string recordStr = fscan.getRecord();
-      const char *record = recordStr.c_str();
-      int key = *((int *)(record + attrByteOffset));
-      insertEntry(&key, scanRid);
-    }
-  } catch (EndOfFileException e) {
+  FileScan fscan(relationName, bufMgr, &scanStrategy);
+  while ((count = fscan.scanNextBatch(batch, FileScan::DEFAULT_BATCH_SIZE)) > 0) {
+    for (std::size_t i = 0; i < count; i++)
+      insertKey(KeyTraits<T>::read(batch[i].record.data() + attrByteOffset),
+                batch[i].rid);
   }
 }
 
+/**
+ * Write indexMetaInfo to the meta page. Called whenever the root page of the
+ * tree changes.
+ */
+void BTreeIndex::writeMetaInfo() {
+  Page *metaPage;
+  bufMgr->readPage(file, headerPageNum, metaPage);
+  memcpy(reinterpret_cast<char *>(metaPage), &indexMetaInfo,
+         sizeof(IndexMetaInfo));
+  bufMgr->unPinPage(file, headerPageNum, true);
+}
+
 // ##################################################################### //
 // ##################################################################### //
 // ##################################################################### //
@@ -136,28 +343,25 @@ bool BTreeIndex::isLeaf(Page *page) { return *((int *)page) == -1; }
 /**
  * Checks if an internal node is full
  *
- * Assumption: All valid page numbers are nonzero.
- *
  * @param node an internal node
  * @return true if an internal node is full
  *         false if an internal node is not full
  */
-bool BTreeIndex::isNonLeafNodeFull(NonLeafNodeInt *node) {
-  return node->pageNoArray[INTARRAYNONLEAFSIZE] != 0;
+template <class T>
+bool BTreeIndex::isNonLeafNodeFull(NonLeafNode<T> *node) {
+  return node->count == KeyTraits<T>::NONLEAF_SIZE;
 }
 
 /**
  * Checks if a leaf node is full
  *
- * Assumption: All valid records are nonzero.
- *
  * @param node a leaf node
  * @return true if a leaf node is full
  *         false if a leaf node is not full
  */
-bool BTreeIndex::isLeafNodeFull(LeafNodeInt *node) {
-  return !(node->ridArray[INTARRAYLEAFSIZE - 1].page_number == 0 &&
-           node->ridArray[INTARRAYLEAFSIZE - 1].slot_number == 0);
+template <class T>
+bool BTreeIndex::isLeafNodeFull(LeafNode<T> *node) {
+  return node->count == KeyTraits<T>::LEAF_SIZE;
 }
 
 // ##################################################################### //
@@ -171,61 +375,47 @@ bool BTreeIndex::isLeafNodeFull(LeafNodeInt *node) {
 /**
  * Returns the number of records stored in the leaf node.
  *
- * Assumption: 1. All records are continuously stored.
- *             2. All valid records are nonzero.
- *
  * @param node a leaf node
  * @return the number of records stored in the leaf node
  */
-int BTreeIndex::getLeafLen(LeafNodeInt *node) {
-  static auto comp = [](const RecordId &r1, const RecordId &r2) {
-    return r1.page_number > r2.page_number;
-  };
-  static RecordId emptyRecord{};
-
-  RecordId *start = node->ridArray;
-  RecordId *end = &node->ridArray[INTARRAYLEAFSIZE];
-
-  return lower_bound(start, end, emptyRecord, comp) - start;
+template <class T>
+int BTreeIndex::getLeafLen(LeafNode<T> *node) {
+  return node->count;
 }
 
 /**
- * Returns the number of records stored in the internal node.
- *
- * Assumption: 1. All records are continuously stored.
- *             2. All valid page numbers are nonzero.
+ * Returns the number of page numbers stored in the internal node, one more
+ * than its number of keys.
  *
  * @param node an internal node
- * @return the number of records stored in the internal node
+ * @return the number of page numbers stored in the internal node
  */
-int BTreeIndex::getNonLeafLen(NonLeafNodeInt *node) {
-  static auto comp = [](const PageId &p1, const PageId &p2) { return p1 > p2; };
-  PageId *start = node->pageNoArray;
-  PageId *end = &node->pageNoArray[INTARRAYNONLEAFSIZE + 1];
-  return lower_bound(start, end, 0, comp) - start;
+template <class T>
+int BTreeIndex::getNonLeafLen(NonLeafNode<T> *node) {
+  return node->count + 1;
 }
 
 /**
- * Given an integer array, find the index of the first integer larger than
- * (or equal to) the given key.
+ * Given a key array, find the index of the first key larger than (or equal
+ * to) the given key.
  *
  * Assumption: The array is sorted.
  *
- * @param arr an interger array
+ * @param arr a key array
  * @param len the length of the array
  * @param key the target key
  * @param includeKey whether the current key is included
  *
- * @return a. the index of the first integer larger than the given key if
+ * @return a. the index of the first key larger than the given key if
  *            includeKey = false
- *         b. the index of the first integer larger than or equal to the
+ *         b. the index of the first key larger than or equal to the
  *            given key if includeKey = true
  *         c. -1 if the key is not found till the end of array
  */
-int BTreeIndex::findArrayIndex(const int *arr, int len, int key,
+template <class T>
+int BTreeIndex::findArrayIndex(const T *arr, int len, const T &key,
                                bool includeKey) {
-  if (!includeKey) key++;
-  int result = lower_bound(arr, &arr[len], key) - arr;
+  int result = KeySearch::search(arr, len, key, includeKey);
   return result >= len ? -1 : result;
 }
 
@@ -233,15 +423,15 @@ int BTreeIndex::findArrayIndex(const int *arr, int len, int key,
  * Find the index of the first key smaller than the given key
  *
  * Assumption: 1. All records are continuously stored.
- *             2. All valid page numbers are nonzero.
- *             3. All keys are sorted in the node.
+ *             2. All keys are sorted in the node.
  *
  * @param node an internal node
  * @param key the key to find
  * @return the index of the first key smaller than the given key
  *         return the largest index if not found
  */
-int BTreeIndex::findIndexNonLeaf(NonLeafNodeInt *node, int key) {
+template <class T>
+int BTreeIndex::findIndexNonLeaf(NonLeafNode<T> *node, const T &key) {
   int len = getNonLeafLen(node);
   int result = findArrayIndex(node->keyArray, len - 1, key);
   return result == -1 ? len - 1 : result;
@@ -251,15 +441,15 @@ int BTreeIndex::findIndexNonLeaf(NonLeafNodeInt *node, int key) {
  * Find the insertaion index for a key in a leaf node
  *
  * Assumption: 1. All records are continuously stored.
- *             2. All valid records are nonzero.
- *             3. All keys are sorted in the node.
+ *             2. All keys are sorted in the node.
  *
  * @param node a leaf node
  * @param key the key to be inserted
  *
  * @return the insertaion index for a key in a leaf node
  */
-int BTreeIndex::findInsertionIndexLeaf(LeafNodeInt *node, int key) {
+template <class T>
+int BTreeIndex::findInsertionIndexLeaf(LeafNode<T> *node, const T &key) {
   int len = getLeafLen(node);
   int result = findArrayIndex(node->keyArray, len, key);
   return result == -1 ? len : result;
@@ -269,8 +459,7 @@ int BTreeIndex::findInsertionIndexLeaf(LeafNodeInt *node, int key) {
  * Find the index of the first key larger than the given key in the leaf node
  *
  * Assumption: 1. All records are continuously stored.
- *             2. All valid records are nonzero.
- *             3. All keys are sorted in the node.
+ *             2. All keys are sorted in the node.
  *
  * @param node a leaf node
  * @param key the key to find
@@ -282,7 +471,9 @@ int BTreeIndex::findInsertionIndexLeaf(LeafNodeInt *node, int key) {
  *            given key if includeKey = true
  *         c. -1 if the key is not found till the end of array
  */
-int BTreeIndex::findScanIndexLeaf(LeafNodeInt *node, int key, bool includeKey) {
+template <class T>
+int BTreeIndex::findScanIndexLeaf(LeafNode<T> *node, const T &key,
+                                  bool includeKey) {
   return findArrayIndex(node->keyArray, getLeafLen(node), key, includeKey);
 }
 
@@ -303,17 +494,19 @@ int BTreeIndex::findScanIndexLeaf(LeafNodeInt *node, int key, bool includeKey) {
  * @param key the key of the key-record pair to be inserted
  * @param rid the record ID of the key-record pair to be inserted
  */
-void BTreeIndex::insertToLeafNode(LeafNodeInt *node, int i, int key,
+template <class T>
+void BTreeIndex::insertToLeafNode(LeafNode<T> *node, int i, const T &key,
                                   RecordId rid) {
-  const size_t len = INTARRAYLEAFSIZE - i - 1;
+  const size_t len = node->count - i;
 
   // shift items to add space for the new element
-  memmove(&node->keyArray[i + 1], &node->keyArray[i], len * sizeof(int));
+  memmove(&node->keyArray[i + 1], &node->keyArray[i], len * sizeof(T));
   memmove(&node->ridArray[i + 1], &node->ridArray[i], len * sizeof(RecordId));
 
   // save the key and record id to the leaf node
   node->keyArray[i] = key;
   node->ridArray[i] = rid;
+  node->count++;
 }
 
 /**
@@ -325,17 +518,19 @@ void BTreeIndex::insertToLeafNode(LeafNodeInt *node, int i, int key,
  * @param key the key of the key-(page number) pair
  * @param pid the page number of the key-(page number) pair
  */
-void BTreeIndex::insertToNonLeafNode(NonLeafNodeInt *n, int i, int key,
+template <class T>
+void BTreeIndex::insertToNonLeafNode(NonLeafNode<T> *n, int i, const T &key,
                                      PageId pid) {
-  const size_t len = INTARRAYNONLEAFSIZE - i - 1;
+  const size_t len = n->count - i;
 
   // shift items to add space for the new element
-  memmove(&n->keyArray[i + 1], &n->keyArray[i], len * sizeof(int));
+  memmove(&n->keyArray[i + 1], &n->keyArray[i], len * sizeof(T));
   memmove(&n->pageNoArray[i + 2], &n->pageNoArray[i + 1], len * sizeof(PageId));
 
   // store the key and page number to the node
   n->keyArray[i] = key;
   n->pageNoArray[i + 1] = pid;
+  n->count++;
 }
 
 // ##################################################################### //
@@ -354,17 +549,20 @@ void BTreeIndex::insertToNonLeafNode(NonLeafNodeInt *n, int i, int key,
  * @param newNode a pointer to the new node
  * @param index the index where the split occurs.
  */
-void BTreeIndex::splitLeafNode(LeafNodeInt *node, LeafNodeInt *newNode,
+template <class T>
+void BTreeIndex::splitLeafNode(LeafNode<T> *node, LeafNode<T> *newNode,
                                int index) {
-  const size_t len = INTARRAYLEAFSIZE - index;
+  const size_t len = node->count - index;
 
   // copy elements from old node to new node
-  memcpy(&newNode->keyArray, &node->keyArray[index], len * sizeof(int));
+  memcpy(&newNode->keyArray, &node->keyArray[index], len * sizeof(T));
   memcpy(&newNode->ridArray, &node->ridArray[index], len * sizeof(RecordId));
+  newNode->count = len;
 
   // remove elements from old node
-  memset(&node->keyArray[index], 0, len * sizeof(int));
+  memset(&node->keyArray[index], 0, len * sizeof(T));
   memset(&node->ridArray[index], 0, len * sizeof(RecordId));
+  node->count = index;
 }
 
 /**
@@ -376,26 +574,34 @@ void BTreeIndex::splitLeafNode(LeafNodeInt *node, LeafNodeInt *newNode,
  * @param keepMidKey Whether the value at the index should be moved to the
  * parent internal node or not. If keepMidKey is true, then the pair at the
  * index does not need to be moved up and will be moved to the newly created
- *                   internal node.
+ *                   internal node, whose first page number is left for the
+ *                   caller to set.
  *
  * @return a pointer to the newly created internal node.
  */
-void BTreeIndex::splitNonLeafNode(NonLeafNodeInt *curr, NonLeafNodeInt *next,
+template <class T>
+void BTreeIndex::splitNonLeafNode(NonLeafNode<T> *curr, NonLeafNode<T> *next,
                                   int i, bool keepMidKey) {
-  size_t len = INTARRAYNONLEAFSIZE - i;
-
-  // copy keys from old node to new node
-  if (keepMidKey)
-    memcpy(&next->keyArray, &curr->keyArray[i], len * sizeof(int));
-  else
-    memcpy(&next->keyArray, &curr->keyArray[i + 1], (len - 1) * sizeof(int));
-
-  // copy values from old node to new node
-  memcpy(&next->pageNoArray, &curr->pageNoArray[i + 1], len * sizeof(PageId));
+  size_t len = curr->count - i;
+
+  // copy keys and page numbers from old node to new node
+  if (keepMidKey) {
+    memcpy(&next->keyArray, &curr->keyArray[i], len * sizeof(T));
+    memcpy(&next->pageNoArray[1], &curr->pageNoArray[i + 1],
+           len * sizeof(PageId));
+    next->count = len;
+  } else {
+    memcpy(&next->keyArray, &curr->keyArray[i + 1], (len - 1) * sizeof(T));
+    memcpy(&next->pageNoArray, &curr->pageNoArray[i + 1],
+           len * sizeof(PageId));
+    next->count = len - 1;
+  }
+  next->level = curr->level;
 
   // remove elements from old node
-  memset(&curr->keyArray[i], 0, len * sizeof(int));
+  memset(&curr->keyArray[i], 0, len * sizeof(T));
   memset(&curr->pageNoArray[i + 1], 0, len * sizeof(PageId));
+  curr->count = i;
 }
 
 /**
@@ -407,15 +613,17 @@ void BTreeIndex::splitNonLeafNode(NonLeafNodeInt *curr, NonLeafNodeInt *next,
  *
  * @return the page id of the new root
  */
-PageId BTreeIndex::splitRoot(int midVal, PageId pid1, PageId pid2) {
+template <class T>
+PageId BTreeIndex::splitRoot(const T &midVal, PageId pid1, PageId pid2) {
   // alloc a new page for root
   PageId newRootPageId;
-  NonLeafNodeInt *newRoot = allocNonLeafNode(newRootPageId);
+  NonLeafNode<T> *newRoot = allocNonLeafNode<T>(newRootPageId);
 
   // set key and page numbers
   newRoot->keyArray[0] = midVal;
   newRoot->pageNoArray[0] = pid1;
   newRoot->pageNoArray[1] = pid2;
+  newRoot->count = 1;
 
   // unpin the root page
   bufMgr->unPinPage(file, newRootPageId, true);
@@ -438,16 +646,17 @@ PageId BTreeIndex::splitRoot(int midVal, PageId pid1, PageId pid2) {
  * @param origPageId the page id of the page that stores the leaf node
  * @param key the key of the key-record pair
  * @param rid the record id of the key-record pair
- * @param midVal a reference to an integer in the parent node. If the insertion
+ * @param midVal a reference to a key in the parent node. If the insertion
  *               requires a split in the leaf node, midVal is set to the
  *               smallest element of the newly created node.
  *
  * @return The page number of the newly created page if insertion requires a
  *         split, or 0 if no new node is created.
  */
-PageId BTreeIndex::insertToLeafPage(Page *origPage, PageId origPageId, int key,
-                                    RecordId rid, int &midVal) {
-  LeafNodeInt *origNode = (LeafNodeInt *)origPage;
+template <class T>
+PageId BTreeIndex::insertToLeafPage(Page *origPage, PageId origPageId,
+                                    const T &key, RecordId rid, T &midVal) {
+  LeafNode<T> *origNode = (LeafNode<T> *)origPage;
 
   // finde the insertion index
   int index = findInsertionIndexLeaf(origNode, key);
@@ -462,14 +671,14 @@ PageId BTreeIndex::insertToLeafPage(Page *origPage, PageId origPageId, int key,
   // the node is full at this point
 
   // the middle index for spliting the page
-  const int middleIndex = INTARRAYLEAFSIZE / 2;
+  const int middleIndex = KeyTraits<T>::LEAF_SIZE / 2;
 
   // whether the new element is insert to the left half of the original node
   bool insertToLeft = index < middleIndex;
 
   // alloc a page for the new node
   PageId newPageId;
-  LeafNodeInt *newNode = allocLeafNode(newPageId);
+  LeafNode<T> *newNode = allocLeafNode<T>(newPageId);
 
   // split the node to origNode and newNode
   splitLeafNode(origNode, newNode, middleIndex + insertToLeft);
@@ -484,12 +693,12 @@ PageId BTreeIndex::insertToLeafPage(Page *origPage, PageId origPageId, int key,
   newNode->rightSibPageNo = origNode->rightSibPageNo;
   origNode->rightSibPageNo = newPageId;
 
+  // set the middle value while the new node is still pinned
+  midVal = newNode->keyArray[0];
+
   // unpin the new node and the original node
   bufMgr->unPinPage(file, origPageId, true);
   bufMgr->unPinPage(file, newPageId, true);
-
-  // set the middle value
-  midVal = newNode->keyArray[0];
   return newPageId;
 }
 
@@ -502,30 +711,30 @@ PageId BTreeIndex::insertToLeafPage(Page *origPage, PageId origPageId, int key,
  *        subtree.
  * @param key the key of the key-record pair to be inserted
  * @param rid the record ID of the key-record pair to be inserted
- * @param midVal a pointer to an integer value to be stored in the parent node.
- *        If the insertion requires a split in the current level, midVal is set
- *        to the smallest key stored in the subtree pointed by the newly created
- *        node.
+ * @param midVal a reference to a key to be stored in the parent node. If the
+ *        insertion requires a split in the current level, midVal is set to the
+ *        smallest key stored in the subtree pointed by the newly created node.
  *
  * @return the page number of the newly created node if a split occurs, or 0
  *         otherwise.
  */
-PageId BTreeIndex::insert(PageId origPageId, int key, RecordId rid,
-                          int &midVal) {
+template <class T>
+PageId BTreeIndex::insert(PageId origPageId, const T &key, RecordId rid,
+                          T &midVal) {
   Page *origPage;
   bufMgr->readPage(file, origPageId, origPage);
 
   if (isLeaf(origPage))  // base case
     return insertToLeafPage(origPage, origPageId, key, rid, midVal);
 
-  NonLeafNodeInt *origNode = (NonLeafNodeInt *)origPage;
+  NonLeafNode<T> *origNode = (NonLeafNode<T> *)origPage;
 
   // find the child page id
   int origChildPageIndex = findIndexNonLeaf(origNode, key);
   PageId origChildPageId = origNode->pageNoArray[origChildPageIndex];
 
   // insert key, rid to child and check whether child is splitted
-  int newChildMidVal;
+  T newChildMidVal;
   PageId newChildPageId = insert(origChildPageId, key, rid, newChildMidVal);
 
   // not split in child
@@ -543,31 +752,35 @@ PageId BTreeIndex::insert(PageId origPageId, int key, RecordId rid,
   }
 
   // the middle index for spliting the page
-  int middleIndex = (INTARRAYNONLEAFSIZE - 1) / 2;
+  int middleIndex = (KeyTraits<T>::NONLEAF_SIZE - 1) / 2;
 
   // whether the new element is insert to the left half of the original node
   bool insertToLeft = index < middleIndex;
 
   // split
   int splitIndex = middleIndex + insertToLeft;
-  int insertIndex = insertToLeft ? index : index - middleIndex;
 
   // insert to right[0]
-  bool moveKeyUp = !insertToLeft && insertIndex == 0;
+  bool moveKeyUp = !insertToLeft && index == middleIndex;
+
+  // the new node starts with the key after the one at the split index
+  int insertIndex = insertToLeft ? index : index - middleIndex - 1;
 
   // if we need to move key up, set midVal = key, else key at splited index
   midVal = moveKeyUp ? newChildMidVal : origNode->keyArray[splitIndex];
 
   // alloc a page for the new node
   PageId newPageId;
-  NonLeafNodeInt *newNode = allocNonLeafNode(newPageId);
+  NonLeafNode<T> *newNode = allocNonLeafNode<T>(newPageId);
 
   // split the node to origNode and newNode
   splitNonLeafNode(origNode, newNode, splitIndex, moveKeyUp);
 
-  // need to insert
-  if (!moveKeyUp) {
-    NonLeafNodeInt *node = insertToLeft ? origNode : newNode;
+  // need to insert, unless the new child becomes the first of the new node
+  if (moveKeyUp) {
+    newNode->pageNoArray[0] = newChildPageId;
+  } else {
+    NonLeafNode<T> *node = insertToLeft ? origNode : newNode;
     insertToNonLeafNode(node, insertIndex, newChildMidVal, newChildPageId);
   }
 
@@ -593,11 +806,563 @@ PageId BTreeIndex::insert(PageId origPageId, int key, RecordId rid,
  *inserted into the index.
  **/
 const void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
-  int midval;
-  PageId pid = insert(indexMetaInfo.rootPageNo, *(int *)key, rid, midval);
+  // the prefetcher must not read leaves while the tree is being changed
+  bufMgr->cancelPrefetch(file);
+
+  switch (attributeType) {
+    case INTEGER:
+      insertKey(KeyTraits<int>::read(key), rid);
+      break;
+    case DOUBLE:
+      insertKey(KeyTraits<double>::read(key), rid);
+      break;
+    case STRING:
+      insertKey(KeyTraits<StringKey>::read(key), rid);
+      break;
+  }
+}
+
+/**
+ * Insert a key-record pair into the tree, growing a new root if the old one
+ * splits.
+ *
+ * @param key the key of the key-record pair
+ * @param rid the record id of the key-record pair
+ */
+template <class T>
+void BTreeIndex::insertKey(const T &key, RecordId rid) {
+  T midval;
+  PageId pid = insert(indexMetaInfo.rootPageNo, key, rid, midval);
 
-  if (pid != 0)
+  if (pid != 0) {
     indexMetaInfo.rootPageNo = splitRoot(midval, indexMetaInfo.rootPageNo, pid);
+    writeMetaInfo();
+  }
+}
+
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+// #########################       Delete      ######################### //
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+
+/**
+ * Remove the key-(page number) pair at the given index of an internal node:
+ * key i and the child to its right.
+ *
+ * @param node an internal node
+ * @param i the index of the key to remove
+ */
+template <class T>
+void BTreeIndex::removeFromNonLeafNode(NonLeafNode<T> *node, int i) {
+  const size_t len = node->count - i - 1;
+
+  // shift the following items over the removed ones
+  memmove(&node->keyArray[i], &node->keyArray[i + 1], len * sizeof(T));
+  memmove(&node->pageNoArray[i + 1], &node->pageNoArray[i + 2],
+          len * sizeof(PageId));
+  node->count--;
+  memset(&node->keyArray[node->count], 0, sizeof(T));
+  memset(&node->pageNoArray[node->count + 1], 0, sizeof(PageId));
+}
+
+/**
+ * Balance two neighbouring leaves, or merge them if together they do not have
+ * enough entries for two.
+ *
+ * @param parent the internal node holding both
+ * @param i the index of the key of parent between them
+ * @param left the left leaf
+ * @param right the right leaf
+ *
+ * @return whether right was merged into left
+ */
+template <class T>
+bool BTreeIndex::rebalanceLeaves(NonLeafNode<T> *parent, int i,
+                                 LeafNode<T> *left, LeafNode<T> *right) {
+  const int minEntries = KeyTraits<T>::LEAF_SIZE / 2;
+  const int total = left->count + right->count;
+
+  // merge: take over every entry and the right sibling of right
+  if (total < 2 * minEntries) {
+    memcpy(&left->keyArray[left->count], right->keyArray,
+           right->count * sizeof(T));
+    memcpy(&left->ridArray[left->count], right->ridArray,
+           right->count * sizeof(RecordId));
+    left->count = total;
+    left->rightSibPageNo = right->rightSibPageNo;
+    return true;
+  }
+
+  const int target = total / 2;
+  if (left->count < target) {
+    // move the first entries of right to the end of left
+    const int k = target - left->count;
+    memcpy(&left->keyArray[left->count], right->keyArray, k * sizeof(T));
+    memcpy(&left->ridArray[left->count], right->ridArray,
+           k * sizeof(RecordId));
+    memmove(right->keyArray, &right->keyArray[k],
+            (right->count - k) * sizeof(T));
+    memmove(right->ridArray, &right->ridArray[k],
+            (right->count - k) * sizeof(RecordId));
+    memset(&right->keyArray[right->count - k], 0, k * sizeof(T));
+    memset(&right->ridArray[right->count - k], 0, k * sizeof(RecordId));
+  } else {
+    // move the last entries of left to the front of right
+    const int k = left->count - target;
+    memmove(&right->keyArray[k], right->keyArray, right->count * sizeof(T));
+    memmove(&right->ridArray[k], right->ridArray,
+            right->count * sizeof(RecordId));
+    memcpy(right->keyArray, &left->keyArray[target], k * sizeof(T));
+    memcpy(right->ridArray, &left->ridArray[target], k * sizeof(RecordId));
+    memset(&left->keyArray[target], 0, k * sizeof(T));
+    memset(&left->ridArray[target], 0, k * sizeof(RecordId));
+  }
+  left->count = target;
+  right->count = total - target;
+  parent->keyArray[i] = right->keyArray[0];
+  return false;
+}
+
+/**
+ * Balance two neighbouring internal nodes, or merge them if together they do
+ * not have enough keys for two. Keys move between them through the key of
+ * the parent that separates them.
+ *
+ * @param parent the internal node holding both
+ * @param i the index of the key of parent between them
+ * @param left the left node
+ * @param right the right node
+ *
+ * @return whether right was merged into left
+ */
+template <class T>
+bool BTreeIndex::rebalanceNonLeaves(NonLeafNode<T> *parent, int i,
+                                    NonLeafNode<T> *left,
+                                    NonLeafNode<T> *right) {
+  const int minKeys = (KeyTraits<T>::NONLEAF_SIZE - 1) / 2;
+  const int leftCount = left->count;
+  const int rightCount = right->count;
+  const int total = leftCount + rightCount;
+
+  // merge: the separating key comes down between the two
+  if (total < 2 * minKeys) {
+    left->keyArray[leftCount] = parent->keyArray[i];
+    memcpy(&left->keyArray[leftCount + 1], right->keyArray,
+           rightCount * sizeof(T));
+    memcpy(&left->pageNoArray[leftCount + 1], right->pageNoArray,
+           (rightCount + 1) * sizeof(PageId));
+    left->count = total + 1;
+    return true;
+  }
+
+  const int target = total / 2;
+  if (leftCount < target) {
+    // rotate the first k children of right over to left
+    const int k = target - leftCount;
+    left->keyArray[leftCount] = parent->keyArray[i];
+    memcpy(&left->keyArray[leftCount + 1], right->keyArray,
+           (k - 1) * sizeof(T));
+    memcpy(&left->pageNoArray[leftCount + 1], right->pageNoArray,
+           k * sizeof(PageId));
+    parent->keyArray[i] = right->keyArray[k - 1];
+    memmove(right->keyArray, &right->keyArray[k],
+            (rightCount - k) * sizeof(T));
+    memmove(right->pageNoArray, &right->pageNoArray[k],
+            (rightCount - k + 1) * sizeof(PageId));
+    memset(&right->keyArray[rightCount - k], 0, k * sizeof(T));
+    memset(&right->pageNoArray[rightCount - k + 1], 0, k * sizeof(PageId));
+  } else {
+    // rotate the last k children of left over to right
+    const int k = leftCount - target;
+    memmove(&right->keyArray[k], right->keyArray, rightCount * sizeof(T));
+    memmove(&right->pageNoArray[k], right->pageNoArray,
+            (rightCount + 1) * sizeof(PageId));
+    right->keyArray[k - 1] = parent->keyArray[i];
+    memcpy(right->keyArray, &left->keyArray[target + 1],
+           (k - 1) * sizeof(T));
+    memcpy(right->pageNoArray, &left->pageNoArray[target + 1],
+           k * sizeof(PageId));
+    parent->keyArray[i] = left->keyArray[target];
+    memset(&left->keyArray[target], 0, k * sizeof(T));
+    memset(&left->pageNoArray[target + 1], 0, k * sizeof(PageId));
+  }
+  left->count = target;
+  right->count = total - target;
+  return false;
+}
+
+/**
+ * Give child i of an internal node enough entries again, together with its
+ * right sibling, or its left one if it is the last child.
+ *
+ * @param parent the internal node, pinned by the caller
+ * @param i the index of the child with too few entries
+ */
+template <class T>
+void BTreeIndex::fixUnderflow(NonLeafNode<T> *parent, int i) {
+  if (parent->count == 0) return;  // an only child has no sibling
+
+  const int sep = i < parent->count ? i : i - 1;
+  const PageId leftPageNo = parent->pageNoArray[sep];
+  const PageId rightPageNo = parent->pageNoArray[sep + 1];
+  Page *leftPage, *rightPage;
+  bufMgr->readPage(file, leftPageNo, leftPage);
+  bufMgr->readPage(file, rightPageNo, rightPage);
+
+  bool merged;
+  if (isLeaf(leftPage))
+    merged = rebalanceLeaves(parent, sep, (LeafNode<T> *)leftPage,
+                             (LeafNode<T> *)rightPage);
+  else
+    merged = rebalanceNonLeaves(parent, sep, (NonLeafNode<T> *)leftPage,
+                                (NonLeafNode<T> *)rightPage);
+
+  bufMgr->unPinPage(file, leftPageNo, true);
+  bufMgr->unPinPage(file, rightPageNo, true);
+  if (merged) {
+    removeFromNonLeafNode(parent, sep);
+    freePage(rightPageNo);
+  }
+}
+
+/**
+ * Recursively delete the given key-record pair from the subtree with the given
+ * root node.
+ *
+ * @param pageNo page id of the page that stores the root of the subtree
+ * @param key the key of the pair
+ * @param rid the record id of the pair
+ * @param underflow set to whether the root of the subtree is left less than
+ *        half full
+ *
+ * @return whether the pair was found
+ */
+template <class T>
+bool BTreeIndex::remove(PageId pageNo, const T &key, RecordId rid,
+                        bool &underflow) {
+  Page *page;
+  bufMgr->readPage(file, pageNo, page);
+  underflow = false;
+
+  if (isLeaf(page)) {  // base case
+    LeafNode<T> *node = (LeafNode<T> *)page;
+    for (int i = findInsertionIndexLeaf(node, key);
+         i < node->count && !(key < node->keyArray[i]); i++) {
+      if (!(node->ridArray[i] == rid)) continue;
+
+      const size_t len = node->count - i - 1;
+      memmove(&node->keyArray[i], &node->keyArray[i + 1], len * sizeof(T));
+      memmove(&node->ridArray[i], &node->ridArray[i + 1],
+              len * sizeof(RecordId));
+      node->count--;
+      memset(&node->keyArray[node->count], 0, sizeof(T));
+      memset(&node->ridArray[node->count], 0, sizeof(RecordId));
+
+      underflow = node->count < KeyTraits<T>::LEAF_SIZE / 2;
+      bufMgr->unPinPage(file, pageNo, true);
+      return true;
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    return false;
+  }
+
+  // keys equal to key may be in any child up to the first whose key is larger
+  NonLeafNode<T> *node = (NonLeafNode<T> *)page;
+  for (int i = findIndexNonLeaf(node, key); i <= node->count; i++) {
+    bool childUnderflow;
+    if (remove(node->pageNoArray[i], key, rid, childUnderflow)) {
+      if (childUnderflow) fixUnderflow(node, i);
+      underflow = node->count < (KeyTraits<T>::NONLEAF_SIZE - 1) / 2;
+      bufMgr->unPinPage(file, pageNo, childUnderflow);
+      return true;
+    }
+    if (i == node->count || key < node->keyArray[i]) break;
+  }
+  bufMgr->unPinPage(file, pageNo, false);
+  return false;
+}
+
+/**
+ * Delete the entry with the pair <value,rid>.
+ *
+ * @param key the key of the entry
+ * @param rid the record id of the entry
+ *
+ * @return false if the index holds no such entry
+ */
+const bool BTreeIndex::deleteEntry(const void *key, const RecordId rid) {
+  // the prefetcher must not read leaves while the tree is being changed
+  bufMgr->cancelPrefetch(file);
+
+  switch (attributeType) {
+    case INTEGER:
+      return deleteKey(KeyTraits<int>::read(key), rid);
+    case DOUBLE:
+      return deleteKey(KeyTraits<double>::read(key), rid);
+    case STRING:
+      return deleteKey(KeyTraits<StringKey>::read(key), rid);
+  }
+  return false;
+}
+
+/**
+ * Delete a key-record pair from the tree, shrinking it by a level if the root
+ * is left with a single child.
+ *
+ * @param key the key of the key-record pair
+ * @param rid the record id of the key-record pair
+ *
+ * @return whether the pair was found
+ */
+template <class T>
+bool BTreeIndex::deleteKey(const T &key, RecordId rid) {
+  bool underflow;
+  if (!remove(indexMetaInfo.rootPageNo, key, rid, underflow)) return false;
+
+  Page *root;
+  bufMgr->readPage(file, indexMetaInfo.rootPageNo, root);
+  if (isLeaf(root) || ((NonLeafNode<T> *)root)->count > 0) {
+    bufMgr->unPinPage(file, indexMetaInfo.rootPageNo, false);
+    return true;
+  }
+
+  const PageId oldRootPageNo = indexMetaInfo.rootPageNo;
+  indexMetaInfo.rootPageNo = ((NonLeafNode<T> *)root)->pageNoArray[0];
+  bufMgr->unPinPage(file, oldRootPageNo, false);
+  freePage(oldRootPageNo);  // writes the new root to the meta page
+  return true;
+}
+
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+// #######################      Bulk Load      ######################### //
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+
+/**
+ * Returns how many entries a node of the given capacity receives during a bulk
+ * load. The result is clamped to [minEntries, capacity].
+ *
+ * @param capacity the maximum number of entries the node can hold
+ * @param minEntries the smallest number of entries a node may hold
+ * @param fillFactor the requested fraction of the node to fill
+ *
+ * @return the number of entries to pack into each node
+ */
+int BTreeIndex::entriesPerNode(int capacity, int minEntries,
+                               double fillFactor) {
+  int n = (int)(capacity * fillFactor);
+  return max(minEntries, min(capacity, n));
+}
+
+/**
+ * Append every key-record pair currently stored in the tree to the given
+ * vector, in key order, by walking the leaf chain from the leftmost leaf.
+ *
+ * @param entries the vector the pairs are appended to
+ */
+template <class T>
+void BTreeIndex::collectEntries(vector<RIDKeyPair<T> > &entries) {
+  // descend to the leftmost leaf
+  PageId pageNo = indexMetaInfo.rootPageNo;
+  Page *page;
+  bufMgr->readPage(file, pageNo, page);
+  while (!isLeaf(page)) {
+    PageId childPageNo = ((NonLeafNode<T> *)page)->pageNoArray[0];
+    bufMgr->unPinPage(file, pageNo, false);
+    pageNo = childPageNo;
+    bufMgr->readPage(file, pageNo, page);
+  }
+
+  // walk the leaf chain
+  while (true) {
+    LeafNode<T> *node = (LeafNode<T> *)page;
+    int len = getLeafLen(node);
+    for (int i = 0; i < len; i++) {
+      RIDKeyPair<T> entry;
+      entry.set(node->ridArray[i], node->keyArray[i]);
+      entries.push_back(entry);
+    }
+    PageId nextPageNo = node->rightSibPageNo;
+    bufMgr->unPinPage(file, pageNo, false);
+    if (nextPageNo == 0) break;
+    pageNo = nextPageNo;
+    bufMgr->readPage(file, pageNo, page);
+  }
+}
+
+/**
+ * Pack sorted key-record pairs into a chain of leaf nodes, taking them one at
+ * a time so they need not all be in memory.
+ *
+ * The entries are spread evenly over the smallest number of leaves that keeps
+ * every leaf at or below the fill factor, so the last leaf is never left
+ * nearly empty.
+ *
+ * @param total the number of pairs
+ * @param nextEntry returns the next pair in sorted order, called total times
+ * @param fillFactor the fraction of each leaf to fill
+ * @param level returns the page number and smallest key of every leaf, from
+ *        left to right
+ */
+template <class T>
+void BTreeIndex::buildLeafLevel(std::size_t total,
+                                const function<RIDKeyPair<T>()> &nextEntry,
+                                double fillFactor,
+                                vector<PageKeyPair<T> > &level) {
+  const std::size_t perLeaf =
+      entriesPerNode(KeyTraits<T>::LEAF_SIZE, 1, fillFactor);
+  const std::size_t numLeaves =
+      max<std::size_t>(1, (total + perLeaf - 1) / perLeaf);
+
+  PageId prevPageId = 0;
+  LeafNode<T> *prevNode = nullptr;
+  for (std::size_t i = 0; i < numLeaves; i++) {
+    const std::size_t len = total * (i + 1) / numLeaves - total * i / numLeaves;
+
+    PageId pageId;
+    LeafNode<T> *node = allocLeafNode<T>(pageId);
+    for (std::size_t j = 0; j < len; j++) {
+      const RIDKeyPair<T> entry = nextEntry();
+      node->keyArray[j] = entry.key;
+      node->ridArray[j] = entry.rid;
+    }
+    node->count = len;
+
+    // link the previous leaf to this one and write it out
+    if (prevNode != nullptr) {
+      prevNode->rightSibPageNo = pageId;
+      bufMgr->unPinPage(file, prevPageId, true);
+    }
+    prevPageId = pageId;
+    prevNode = node;
+
+    // an empty leaf is zeroed, so its smallest key is the zero key
+    PageKeyPair<T> pair;
+    pair.set(pageId, node->keyArray[0]);
+    level.push_back(pair);
+  }
+  bufMgr->unPinPage(file, prevPageId, true);
+}
+
+/**
+ * Pack one level of internal nodes on top of the given level of nodes.
+ *
+ * The separator key stored before each child is the smallest key of that
+ * child, which is the same invariant insert() keeps when a node splits.
+ *
+ * @param children the page number and smallest key of every node in the level
+ *        below, from left to right
+ * @param fillFactor the fraction of each internal node to fill
+ * @param aboveLeaf whether the children are leaf nodes
+ * @param level returns the page number and smallest key of every node created,
+ *        from left to right
+ */
+template <class T>
+void BTreeIndex::buildNonLeafLevel(const vector<PageKeyPair<T> > &children,
+                                   double fillFactor, bool aboveLeaf,
+                                   vector<PageKeyPair<T> > &level) {
+  const int total = children.size();
+  const int perNode =
+      entriesPerNode(KeyTraits<T>::NONLEAF_SIZE + 1, 2, fillFactor);
+  // the even split gives each node at least two children, as long as there
+  // are at least two per node
+  const int numNodes =
+      max(1, min((total + perNode - 1) / perNode, total / 2));
+
+  for (int i = 0; i < numNodes; i++) {
+    const int begin = (int)((long long)total * i / numNodes);
+    const int end = (int)((long long)total * (i + 1) / numNodes);
+
+    PageId pageId;
+    NonLeafNode<T> *node = allocNonLeafNode<T>(pageId);
+    node->level = aboveLeaf ? 1 : 0;
+    node->pageNoArray[0] = children[begin].pageNo;
+    for (int j = begin + 1; j < end; j++) {
+      node->keyArray[j - begin - 1] = children[j].key;
+      node->pageNoArray[j - begin] = children[j].pageNo;
+    }
+    node->count = end - begin - 1;
+    bufMgr->unPinPage(file, pageId, true);
+
+    PageKeyPair<T> pair;
+    pair.set(pageId, children[begin].key);
+    level.push_back(pair);
+  }
+}
+
+/**
+ * Bulk load the given <value,rid> pairs into the index.
+ * The pairs are sorted, together with any entries already in the index, and
+ * the tree is rebuilt bottom-up: leaves are packed left to right and linked
+ * through rightSibPageNo, then each level of non-leaf nodes is packed on top
+ * of the level below until a single root remains. Each node is filled to the
+ * given fraction of its capacity. The pages of the old tree go on the free list
+ * and are reused.
+ * @param entries			Key-record pairs to load. Sorted in place.
+ * @param fillFactor	Fraction of each node to fill, in (0, 1]
+ * @throws  BadIndexInfoException If T is not the type of the key.
+ * @throws  BadFillFactorException If fillFactor is not in (0, 1].
+ **/
+template <class T>
+const void BTreeIndex::bulkLoad(vector<RIDKeyPair<T> > &entries,
+                                const double fillFactor) {
+  if (KeyTraits<T>::TYPE != attributeType)
+    throw BadIndexInfoException(file->filename());
+  checkFillFactor(fillFactor);
+  if (scan.isExecuting()) scan.endScan();
+  // the prefetcher must not read leaves while the tree is being changed
+  bufMgr->cancelPrefetch(file);
+
+  // merge in whatever the tree already holds
+  if (indexMetaInfo.rootPageNo != 0) {
+    collectEntries(entries);
+    freeSubtree<T>(indexMetaInfo.rootPageNo);
+  }
+  sort(entries.begin(), entries.end());
+
+  std::size_t next = 0;
+  buildTree<T>(entries.size(), [&entries, &next]() { return entries[next++]; },
+               fillFactor);
+}
+
+template const void BTreeIndex::bulkLoad<int>(vector<RIDKeyPair<int> > &,
+                                              const double);
+template const void BTreeIndex::bulkLoad<double>(
+    vector<RIDKeyPair<double> > &, const double);
+template const void BTreeIndex::bulkLoad<StringKey>(
+    vector<RIDKeyPair<StringKey> > &, const double);
+
+/**
+ * Build the tree bottom-up from sorted key-record pairs and make it the root
+ * of the index.
+ *
+ * @param total the number of pairs
+ * @param nextEntry returns the next pair in sorted order, called total times
+ * @param fillFactor the fraction of each node to fill
+ */
+template <class T>
+void BTreeIndex::buildTree(std::size_t total,
+                           const function<RIDKeyPair<T>()> &nextEntry,
+                           double fillFactor) {
+  vector<PageKeyPair<T> > level;
+  buildLeafLevel(total, nextEntry, fillFactor, level);
+
+  bool aboveLeaf = true;
+  while (level.size() > 1) {
+    vector<PageKeyPair<T> > parents;
+    buildNonLeafLevel(level, fillFactor, aboveLeaf, parents);
+    level.swap(parents);
+    aboveLeaf = false;
+  }
+
+  indexMetaInfo.rootPageNo = level[0].pageNo;
+  writeMetaInfo();
 }
 
 // ##################################################################### //
@@ -608,44 +1373,105 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
 // ##################################################################### //
 // ##################################################################### //
 
+/**
+ * Returns the right sibling of a leaf page, or Page::INVALID_NUMBER for the
+ * last leaf or a page that is not a leaf. Used to prefetch leaf chains.
+ */
+template <class T>
+static PageId nextLeafPageNo(const Page &page) {
+  const LeafNode<T> *node = (const LeafNode<T> *)&page;
+  return node->level == -1 ? node->rightSibPageNo : Page::INVALID_NUMBER;
+}
+
 /**
  * Change the currently scanning page to the next page pointed to by the current
  * page.
  * @param node the node stored in the currently scanning page.
  */
-void BTreeIndex::moveToNextPage(LeafNodeInt *node) {
-  bufMgr->unPinPage(file, currentPageNum, false);
-  currentPageNum = node->rightSibPageNo;
-  bufMgr->readPage(file, currentPageNum, currentPageData);
+template <class T>
+void BTreeScanCursor::moveToNextPage(LeafNode<T> *node) {
+  BufMgr *bufMgr = index->bufMgr;
+  const PageId nextPageNum = node->rightSibPageNo;
+  bufMgr->unPinPage(index->file, currentPageNum, false);
+  currentPageNum = nextPageNum;
+  bufMgr->readPage(index->file, currentPageNum, currentPageData);
   nextEntry = 0;
+
+  // read the following leaves in the background if the scan may reach them
+  node = (LeafNode<T> *)currentPageData;
+  if (index->prefetchDepth > 0 && index->isLeaf(currentPageData) &&
+      node->rightSibPageNo != 0) {
+    int len = index->getLeafLen(node);
+    if (len > 0 && !(highVal<T>() < node->keyArray[len - 1]))
+      bufMgr->prefetchChain(index->file, node->rightSibPageNo,
+                            index->prefetchDepth, nextLeafPageNo<T>);
+  }
 }
 
 /**
  * Recursively find the page id of the first element larger than or equal to the
  * lower bound given.
  */
-void BTreeIndex::setPageIdForScan() {
-  bufMgr->readPage(file, currentPageNum, currentPageData);
-  if (isLeaf(currentPageData)) return;
-
-  NonLeafNodeInt *node = (NonLeafNodeInt *)currentPageData;
-
-  bufMgr->unPinPage(file, currentPageNum, false);
-  currentPageNum = node->pageNoArray[findIndexNonLeaf(node, lowValInt)];
-  setPageIdForScan();
+template <class T>
+void BTreeScanCursor::setPageIdForScan() {
+  index->bufMgr->readPage(index->file, currentPageNum, currentPageData);
+  if (index->isLeaf(currentPageData)) return;
+
+  NonLeafNode<T> *node = (NonLeafNode<T> *)currentPageData;
+  const PageId childPageNum =
+      node->pageNoArray[index->findIndexNonLeaf(node, lowVal<T>())];
+
+  index->bufMgr->unPinPage(index->file, currentPageNum, false);
+  currentPageNum = childPageNum;
+  setPageIdForScan<T>();
 }
 
 /**
  * Find the first element in the currently scanning page that is within the
  * given bound.
  */
-void BTreeIndex::setEntryIndexForScan() {
-  LeafNodeInt *node = (LeafNodeInt *)currentPageData;
-  int entryIndex = findScanIndexLeaf(node, lowValInt, lowOp == GTE);
-  if (entryIndex == -1)
-    moveToNextPage(node);
-  else
+template <class T>
+void BTreeScanCursor::setEntryIndexForScan() {
+  LeafNode<T> *node = (LeafNode<T> *)currentPageData;
+  int entryIndex = index->findScanIndexLeaf(node, lowVal<T>(), lowOp == GTE);
+  if (entryIndex != -1) {
     nextEntry = entryIndex;
+  } else if (node->rightSibPageNo != 0) {
+    // the next leaf may still start with the low bound, which GT skips
+    moveToNextPage(node);
+    setEntryIndexForScan<T>();
+  } else {
+    nextEntry = node->count;  // past the last entry of the last leaf
+  }
+}
+
+/**
+ * Opens a cursor over the entries in range.
+ *
+ * @param lowValParm The low value to be tested.
+ * @param lowOpParm The operation to be used in testing the low range.
+ * @param highValParm The high value to be tested.
+ * @param highOpParm The operation to be used in testing the high range.
+ */
+BTreeScanCursor BTreeIndex::openScan(const void *lowValParm,
+                                     const Operator lowOpParm,
+                                     const void *highValParm,
+                                     const Operator highOpParm) {
+  BTreeScanCursor cursor;
+  if (!cursor.start(this, lowValParm, lowOpParm, highValParm, highOpParm))
+    throw NoSuchKeyFoundException();
+  return cursor;
+}
+
+/**
+ * Opens a cursor over the entries in range, returning false if there are
+ * none.
+ */
+bool BTreeIndex::openScan(const void *lowValParm, const Operator lowOpParm,
+                          const void *highValParm, const Operator highOpParm,
+                          BTreeScanCursor &cursor) {
+  if (cursor.isExecuting()) cursor.endScan();
+  return cursor.start(this, lowValParm, lowOpParm, highValParm, highOpParm);
 }
 
 /**
@@ -665,42 +1491,83 @@ const void BTreeIndex::startScan(const void *lowValParm,
                                  const Operator lowOpParm,
                                  const void *highValParm,
                                  const Operator highOpParm) {
+  if (scan.isExecuting()) scan.endScan();
+  if (!scan.start(this, lowValParm, lowOpParm, highValParm, highOpParm))
+    throw NoSuchKeyFoundException();
+}
+
+/**
+ * Checks the operators and starts the scan for the type of key of the index.
+ */
+bool BTreeScanCursor::start(BTreeIndex *indexIn, const void *lowValParm,
+                            const Operator lowOpParm, const void *highValParm,
+                            const Operator highOpParm) {
   if (lowOpParm != GT && lowOpParm != GTE) throw BadOpcodesException();
   if (highOpParm != LT && highOpParm != LTE) throw BadOpcodesException();
 
-  lowValInt = *((int *)lowValParm);
-  highValInt = *((int *)highValParm);
-  if (lowValInt > highValInt) throw BadScanrangeException();
+  index = indexIn;
+  switch (index->attributeType) {
+    case INTEGER:
+      return startKeyScan<int>(lowValParm, lowOpParm, highValParm, highOpParm);
+    case DOUBLE:
+      return startKeyScan<double>(lowValParm, lowOpParm, highValParm,
+                                  highOpParm);
+    case STRING:
+      return startKeyScan<StringKey>(lowValParm, lowOpParm, highValParm,
+                                     highOpParm);
+  }
+  return false;
+}
+
+/**
+ * start for a key of type T, once the operators are checked.
+ */
+template <class T>
+bool BTreeScanCursor::startKeyScan(const void *lowValParm,
+                                   const Operator lowOpParm,
+                                   const void *highValParm,
+                                   const Operator highOpParm) {
+  lowVal<T>() = KeyTraits<T>::read(lowValParm);
+  highVal<T>() = KeyTraits<T>::read(highValParm);
+  if (highVal<T>() < lowVal<T>()) throw BadScanrangeException();
 
   lowOp = lowOpParm;
   highOp = highOpParm;
 
   scanExecuting = true;
 
-  currentPageNum = indexMetaInfo.rootPageNo;
+  currentPageNum = index->indexMetaInfo.rootPageNo;
 
-  setPageIdForScan();
-  setEntryIndexForScan();
+  setPageIdForScan<T>();
+  setEntryIndexForScan<T>();
 
-  LeafNodeInt *node = (LeafNodeInt *)currentPageData;
-  RecordId outRid = node->ridArray[nextEntry];
-  if ((outRid.page_number == 0 && outRid.slot_number == 0) ||
-      node->keyArray[nextEntry] > highValInt ||
-      (node->keyArray[nextEntry] == highValInt && highOp == LT)) {
+  LeafNode<T> *node = (LeafNode<T> *)currentPageData;
+  if (nextEntry >= node->count || pastHighVal(node->keyArray[nextEntry])) {
     endScan();
-    throw NoSuchKeyFoundException();
+    return false;
   }
+  return true;
+}
+
+/**
+ * True if the key lies beyond the high bound of the scan.
+ *
+ * @param key the key to test
+ */
+template <class T>
+bool BTreeScanCursor::pastHighVal(const T &key) {
+  return highOp == LT ? !(key < highVal<T>()) : highVal<T>() < key;
 }
 
 /**
  * Continue scanning the next entry. If the currently scanning entry is the last
  * element in this page, set the current scanning page to the next page.
  */
-void BTreeIndex::setNextEntry() {
+template <class T>
+void BTreeScanCursor::setNextEntry() {
   nextEntry++;
-  LeafNodeInt *node = (LeafNodeInt *)currentPageData;
-  if (nextEntry >= INTARRAYLEAFSIZE ||
-      node->ridArray[nextEntry].page_number == 0) {
+  LeafNode<T> *node = (LeafNode<T> *)currentPageData;
+  if (nextEntry >= node->count && node->rightSibPageNo != 0) {
     moveToNextPage(node);
   }
 }
@@ -722,20 +1589,109 @@ void BTreeIndex::setNextEntry() {
  *               This is the record id of the next entry that matches the scan
  * filter set in startScan.
  */
-const void BTreeIndex::scanNext(RecordId &outRid) {
+const void BTreeIndex::scanNext(RecordId &outRid) { scan.scanNext(outRid); }
+
+/**
+ * scanNext of a cursor.
+ *
+ * @param outRid the record id of the next entry that matches the scan
+ */
+const void BTreeScanCursor::scanNext(RecordId &outRid) {
   if (!scanExecuting) throw ScanNotInitializedException();
 
-  LeafNodeInt *node = (LeafNodeInt *)currentPageData;
-  outRid = node->ridArray[nextEntry];
-  int val = node->keyArray[nextEntry];
+  switch (index->attributeType) {
+    case INTEGER:
+      scanNextKey<int>(outRid);
+      break;
+    case DOUBLE:
+      scanNextKey<double>(outRid);
+      break;
+    case STRING:
+      scanNextKey<StringKey>(outRid);
+      break;
+  }
+}
 
-  if ((outRid.page_number == 0 &&
-       outRid.slot_number == 0) ||            // current record ID is empty
-      val > highValInt ||                     // value is out of range
-      (val == highValInt && highOp == LT)) {  // value reaches the higher end
+/**
+ * scanNext for a key of type T.
+ *
+ * @param outRid the record id of the next entry that matches the scan
+ */
+template <class T>
+void BTreeScanCursor::scanNextKey(RecordId &outRid) {
+  LeafNode<T> *node = (LeafNode<T> *)currentPageData;
+  if (nextEntry >= node->count ||                 // past the last leaf
+      pastHighVal(node->keyArray[nextEntry])) {  // beyond the higher end
     throw IndexScanCompletedException();
   }
-  setNextEntry();
+  outRid = node->ridArray[nextEntry];
+  setNextEntry<T>();
+}
+
+/**
+ * Fetches a run of the next entries matching the scan started by startScan.
+ */
+std::size_t BTreeIndex::scanNextBatch(RecordId *outRids,
+                                      std::size_t maxEntries, void *outKeys) {
+  return scan.scanNextBatch(outRids, maxEntries, outKeys);
+}
+
+/**
+ * scanNextBatch of a cursor.
+ */
+std::size_t BTreeScanCursor::scanNextBatch(RecordId *outRids,
+                                           std::size_t maxEntries,
+                                           void *outKeys) {
+  if (!scanExecuting) throw ScanNotInitializedException();
+  // returning 0 entries means the range is done, so 0 cannot be asked for
+  if (maxEntries == 0) throw BadScanParamException();
+
+  switch (index->attributeType) {
+    case INTEGER:
+      return scanNextBatchKey(outRids, maxEntries, (int *)outKeys);
+    case DOUBLE:
+      return scanNextBatchKey(outRids, maxEntries, (double *)outKeys);
+    case STRING:
+      return scanNextBatchKey(outRids, maxEntries, (StringKey *)outKeys);
+  }
+  return 0;
+}
+
+/**
+ * scanNextBatch for a key of type T. Takes the entries from the next one to
+ * the end of the leaf, at most maxEntries of them. If the last is within the
+ * high bound so are all the others; otherwise the end of the range is
+ * searched for in the run. Moves on to the next leaf only once the whole of
+ * the current one has been returned.
+ *
+ * @param outRids the record ids of the entries returned
+ * @param maxEntries the most entries to return
+ * @param outKeys the keys of the entries returned, or NULL
+ * @return the number of entries returned, 0 at the end of the range
+ */
+template <class T>
+std::size_t BTreeScanCursor::scanNextBatchKey(RecordId *outRids,
+                                              std::size_t maxEntries,
+                                              T *outKeys) {
+  LeafNode<T> *node = (LeafNode<T> *)currentPageData;
+  const int first = nextEntry;
+  int end = first + (int)std::min<std::size_t>(maxEntries, node->count - first);
+  if (end <= first) return 0;  // past the last leaf
+
+  const bool inRange = !pastHighVal(node->keyArray[end - 1]);
+  if (!inRange) {
+    end = first + KeySearch::search(node->keyArray + first, end - first,
+                                    highVal<T>(), highOp == LT);
+    if (end == first) return 0;  // beyond the higher end
+  }
+
+  std::copy(node->ridArray + first, node->ridArray + end, outRids);
+  if (outKeys != NULL)
+    std::copy(node->keyArray + first, node->keyArray + end, outKeys);
+  nextEntry = end;
+  if (inRange && nextEntry >= node->count && node->rightSibPageNo != 0)
+    moveToNextPage(node);
+  return end - first;
 }
 
 /**
@@ -745,10 +1701,49 @@ const void BTreeIndex::scanNext(RecordId &outRid) {
  * It throws ScanNotInitializedException when called before a successful
  * startScan call.
  */
-const void BTreeIndex::endScan() {
+const void BTreeIndex::endScan() { scan.endScan(); }
+
+/**
+ * endScan of a cursor: unpins its leaf.
+ */
+const void BTreeScanCursor::endScan() {
   if (!scanExecuting) throw ScanNotInitializedException();
   scanExecuting = false;
-  bufMgr->unPinPage(file, currentPageNum, false);
+  index->bufMgr->unPinPage(index->file, currentPageNum, false);
+}
+
+/**
+ * Takes over the scan of another cursor, ending this cursor's scan first.
+ */
+BTreeScanCursor &BTreeScanCursor::operator=(BTreeScanCursor &&other) {
+  if (this == &other) return *this;
+  if (scanExecuting) endScan();
+
+  index = other.index;
+  scanExecuting = other.scanExecuting;
+  nextEntry = other.nextEntry;
+  currentPageNum = other.currentPageNum;
+  currentPageData = other.currentPageData;
+  lowValInt = other.lowValInt;
+  highValInt = other.highValInt;
+  lowValDouble = other.lowValDouble;
+  highValDouble = other.highValDouble;
+  lowValString = other.lowValString;
+  highValString = other.highValString;
+  lowOp = other.lowOp;
+  highOp = other.highOp;
+  other.scanExecuting = false;
+  return *this;
+}
+
+/**
+ * Ends the scan if the cursor is destroyed while scanning.
+ */
+BTreeScanCursor::~BTreeScanCursor() {
+  try {
+    if (scanExecuting) endScan();
+  } catch (...) {
+  }
 }
 
 // ##################################################################### //
@@ -772,7 +1767,7 @@ const void BTreeIndex::endScan() {
  * the index file to be closed.
  */
 BTreeIndex::~BTreeIndex() {
-  if (scanExecuting) endScan();
+  if (scan.isExecuting()) scan.endScan();
   bufMgr->flushFile(file);
   delete file;
 }
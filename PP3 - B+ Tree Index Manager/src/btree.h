@@ -8,9 +8,13 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 #include "string.h"
 
 #include "buffer.h"
@@ -21,36 +25,197 @@
 namespace badgerdb {
 
 /**
- * @brief Datatype enumeration type.
+ * @brief Build modes. Passed to the BTreeIndex constructor to choose how the
+ * index is populated from the base relation.
  */
-enum Datatype { INTEGER = 0, DOUBLE = 1, STRING = 2 };
+enum BuildMode {
+  INSERT_BUILD, /* Insert every tuple with insertEntry */
+  BULK_BUILD    /* Sort all entries and pack the tree bottom-up */
+};
 
 /**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
+ * @brief Default fraction of each node that is filled by a bulk load. Leaving
+ * some room avoids splitting every leaf on the first inserts after the load.
  */
-enum Operator {
-  LT,  /* Less Than */
-  LTE, /* Less Than or Equal to */
-  GTE, /* Greater Than or Equal to */
-  GT   /* Greater Than */
-};
+const double DEFAULT_FILL_FACTOR = 0.9;
+
+/**
+ * @brief Version of the on-disk format of the index, stored in its meta page.
+ * Version 2 added the entry count to the node header, version 3 the list of
+ * free pages, version 4 widened STRING keys to STRINGSIZE bytes.
+ */
+const int INDEX_FORMAT_VERSION = 4;
+
+/**
+ * @brief Number of bytes of the header every node starts with: its level, its
+ * entry count and its flags.
+ */
+const int NODEHEADERSIZE = sizeof(int) + 2 * sizeof(std::uint16_t);
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr             key
-//                                                  rid
-const int INTARRAYLEAFSIZE =
-    (Page::SIZE - sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+//                                                  header      sibling ptr
+//                                                  key         rid
+const int INTARRAYLEAFSIZE = (Page::SIZE - NODEHEADERSIZE - sizeof(PageId)) /
+                             (sizeof(int) + sizeof(RecordId));
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo
-//                                                     key       pageNo
-const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) /
+//                                                  header      extra pageNo
+//                                                  key         pageNo
+const int INTARRAYNONLEAFSIZE = (Page::SIZE - NODEHEADERSIZE - sizeof(PageId)) /
                                 (sizeof(int) + sizeof(PageId));
 
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                                  header      sibling ptr
+//                                                  key         rid
+const int DOUBLEARRAYLEAFSIZE = (Page::SIZE - NODEHEADERSIZE - sizeof(PageId)) /
+                                (sizeof(double) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+//                                                  header      extra pageNo
+//                                                  key         pageNo
+const int DOUBLEARRAYNONLEAFSIZE =
+    (Page::SIZE - NODEHEADERSIZE - sizeof(PageId)) /
+    (sizeof(double) + sizeof(PageId));
+
+/**
+ * @brief Number of bytes of a STRING key: the size of the string attribute,
+ * so keys are never cut off.
+ */
+const int STRINGSIZE = 64;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for STRING key.
+ */
+//                                                  header      sibling ptr
+//                                                  key         rid
+const int STRINGARRAYLEAFSIZE = (Page::SIZE - NODEHEADERSIZE - sizeof(PageId)) /
+                                (STRINGSIZE + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for STRING key.
+ */
+//                                                  header      extra pageNo
+//                                                  key         pageNo
+const int STRINGARRAYNONLEAFSIZE =
+    (Page::SIZE - NODEHEADERSIZE - sizeof(PageId)) /
+    (STRINGSIZE + sizeof(PageId));
+
+/**
+ * @brief A STRING key: the first STRINGSIZE bytes of the attribute, padded
+ * with zero bytes. Keys order bytewise as unsigned chars, like memcmp.
+ */
+struct StringKey {
+  char data[STRINGSIZE];
+
+  /**
+   * Returns the key of a string, cut off at STRINGSIZE bytes.
+   */
+  static StringKey fromString(const char *s) {
+    StringKey key;
+    strncpy(key.data, s, STRINGSIZE);
+    return key;
+  }
+
+  /**
+   * Returns bytes i to i + 7 of the key as a big-endian word, zero padded, so
+   * that comparing words compares bytes in order.
+   */
+  std::uint64_t word(int i) const {
+    std::uint64_t w = 0;
+    for (int j = i; j < i + 8; j++)
+      w = (w << 8) | (j < STRINGSIZE ? (unsigned char)data[j] : 0);
+    return w;
+  }
+};
+
+/**
+ * @brief Compares two STRING keys a word at a time, without branching on the
+ * bytes.
+ */
+inline bool operator<(const StringKey &a, const StringKey &b) {
+  bool less = false;
+  bool equal = true;
+  for (int i = 0; i < STRINGSIZE; i += 8) {
+    const std::uint64_t x = a.word(i);
+    const std::uint64_t y = b.word(i);
+    less = less | (equal & (x < y));
+    equal = equal & (x == y);
+  }
+  return less;
+}
+
+inline bool operator==(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) == 0;
+}
+
+inline bool operator!=(const StringKey &a, const StringKey &b) {
+  return !(a == b);
+}
+
+inline bool operator>(const StringKey &a, const StringKey &b) { return b < a; }
+
+inline bool operator<=(const StringKey &a, const StringKey &b) {
+  return !(b < a);
+}
+
+inline bool operator>=(const StringKey &a, const StringKey &b) {
+  return !(a < b);
+}
+
+inline std::ostream &operator<<(std::ostream &out, const StringKey &key) {
+  return out << std::string(key.data, strnlen(key.data, STRINGSIZE));
+}
+
+/**
+ * @brief What the tree needs to know about each type of key: the Datatype it
+ * stores, the fanout of its nodes and how to read a key from the attribute of
+ * a record or from a key passed to insertEntry or startScan.
+ */
+template <class T>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int> {
+  static const Datatype TYPE = INTEGER;
+  static const int LEAF_SIZE = INTARRAYLEAFSIZE;
+  static const int NONLEAF_SIZE = INTARRAYNONLEAFSIZE;
+  static int read(const void *key) {
+    int value;
+    memcpy(&value, key, sizeof(value));
+    return value;
+  }
+};
+
+template <>
+struct KeyTraits<double> {
+  static const Datatype TYPE = DOUBLE;
+  static const int LEAF_SIZE = DOUBLEARRAYLEAFSIZE;
+  static const int NONLEAF_SIZE = DOUBLEARRAYNONLEAFSIZE;
+  static double read(const void *key) {
+    double value;
+    memcpy(&value, key, sizeof(value));
+    return value;
+  }
+};
+
+template <>
+struct KeyTraits<StringKey> {
+  static const Datatype TYPE = STRING;
+  static const int LEAF_SIZE = STRINGARRAYLEAFSIZE;
+  static const int NONLEAF_SIZE = STRINGARRAYNONLEAFSIZE;
+  static StringKey read(const void *key) {
+    return StringKey::fromString((const char *)key);
+  }
+};
+
 /**
  * @brief The meta page, which holds metadata for Index file, is always first
  * page of the btree index file and is cast to the following structure to store
@@ -81,8 +246,65 @@ struct IndexMetaInfo {
    * Page number of root page of the B+ Tree inside the file index file.
    */
   PageId rootPageNo;
+
+  /**
+   * INDEX_FORMAT_VERSION of the index when it was created.
+   */
+  int formatVersion;
+
+  /**
+   * First page of the list of pages freed by deletes and bulk loads, or 0 if
+   * there is none. New nodes take pages from this list before growing the
+   * file.
+   */
+  PageId freePageNo;
+};
+
+/**
+ * @brief Structure to store a key-rid pair. It is used to pass the pair to
+ * functions that add to or make changes to the leaf node pages of the tree.
+ * Is templated for the key member.
+ */
+template <class T>
+class RIDKeyPair {
+ public:
+  RecordId rid;
+  T key;
+  void set(RecordId r, T k) {
+    rid = r;
+    key = k;
+  }
+};
+
+/**
+ * @brief Structure to store a key page pair which is used to pass the key and
+ * page to functions that make any modifications to the non leaf pages of the
+ * tree.
+ */
+template <class T>
+class PageKeyPair {
+ public:
+  PageId pageNo;
+  T key;
+  void set(int p, T k) {
+    pageNo = p;
+    key = k;
+  }
 };
 
+/**
+ * @brief Overloaded operator to compare the key values of two rid-key pairs
+ * and if they are the same compare to see if the first pair has a smaller rid
+ * value.
+ */
+template <class T>
+bool operator<(const RIDKeyPair<T> &r1, const RIDKeyPair<T> &r2) {
+  if (r1.key != r2.key) return r1.key < r2.key;
+  if (r1.rid.page_number != r2.rid.page_number)
+    return r1.rid.page_number < r2.rid.page_number;
+  return r1.rid.slot_number < r2.rid.slot_number;
+}
+
 /*
 Each node is a page, so once we read the page in we just cast the pointer to the
 page to this struct and use it to access the parts These structures basically
@@ -93,42 +315,63 @@ leaf nodes. Otherwise set to 0.
 */
 
 /**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all non-leaf nodes, for a key of type T.
  */
-struct NonLeafNodeInt {
+template <class T>
+struct NonLeafNode {
   /**
    * Level of the node in the tree.
    */
   int level = 0;
 
+  /**
+   * Number of keys stored; the node has one more child than keys.
+   */
+  std::uint16_t count = 0;
+
+  /**
+   * Flags of the node; FREE_NODE once its page is on the free list.
+   */
+  std::uint16_t flags = 0;
+
   /**
    * Stores keys.
    */
-  int keyArray[INTARRAYNONLEAFSIZE]{};
+  T keyArray[KeyTraits<T>::NONLEAF_SIZE]{};
 
   /**
    * Stores page numbers of child pages which themselves are other non-leaf/leaf
    * nodes in the tree.
    */
-  PageId pageNoArray[INTARRAYNONLEAFSIZE + 1]{};
+  PageId pageNoArray[KeyTraits<T>::NONLEAF_SIZE + 1]{};
 };
 
 /**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all leaf nodes, for a key of type T.
  */
-
-struct LeafNodeInt {
+template <class T>
+struct LeafNode {
   int level = -1;
 
+  /**
+   * Number of key-record pairs stored.
+   */
+  std::uint16_t count = 0;
+
+  /**
+   * Flags of the node; FREE_NODE once its page is on the free list.
+   */
+  std::uint16_t flags = 0;
+
   /**
    * Stores keys.
    */
-  int keyArray[INTARRAYLEAFSIZE]{};
+  T keyArray[KeyTraits<T>::LEAF_SIZE]{};
 
   /**
    * Stores RecordIds.
    */
-  RecordId ridArray[INTARRAYLEAFSIZE]{};
+  RecordId ridArray[KeyTraits<T>::LEAF_SIZE]{};
 
   /**
    * Page number of the leaf on the right side.
@@ -139,32 +382,123 @@ struct LeafNodeInt {
 };
 
 /**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
- * of a relation. This index supports only one scan at a time.
+ * @brief Flag of a node whose page is on the free list.
  */
-class BTreeIndex {
- private:
+const std::uint16_t FREE_NODE = 1;
+
+/**
+ * @brief Structure of a page on the free list of the index file. It keeps the
+ * node header, with FREE_NODE set, followed by the next free page.
+ */
+struct FreeNode {
+  int level;
+  std::uint16_t count;
+  std::uint16_t flags;
+
   /**
-   * File object for the index file.
+   * Next page of the free list, or 0 for the last.
    */
-  File *file{};
+  PageId nextFreePageNo;
+};
+
+typedef NonLeafNode<int> NonLeafNodeInt;
+typedef LeafNode<int> LeafNodeInt;
+typedef NonLeafNode<double> NonLeafNodeDouble;
+typedef LeafNode<double> LeafNodeDouble;
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE &&
+                  sizeof(LeafNodeInt) <= Page::SIZE,
+              "INTEGER nodes must fit in a page.");
+static_assert(sizeof(NonLeafNodeDouble) <= Page::SIZE &&
+                  sizeof(LeafNodeDouble) <= Page::SIZE,
+              "DOUBLE nodes must fit in a page.");
+static_assert(sizeof(NonLeafNodeString) <= Page::SIZE &&
+                  sizeof(LeafNodeString) <= Page::SIZE,
+              "STRING nodes must fit in a page.");
+
+class BTreeIndex;
+
+/**
+ * @brief A range scan of a BTreeIndex, returned by BTreeIndex::openScan.
+ *
+ * A cursor owns its bounds and keeps the leaf it is on pinned, so any number
+ * of cursors may scan one index at a time, interleaved in one thread or from
+ * several threads. The index must not be changed while cursors are open, and
+ * every cursor must be ended or destroyed before its index.
+ *
+ * Cursors can be moved but not copied.
+ */
+class BTreeScanCursor {
+ public:
+  /**
+   * Creates a cursor that is not scanning.
+   */
+  BTreeScanCursor() {}
 
   /**
-   * Buffer Manager Instance.
+   * Takes over the scan of another cursor, which is left not scanning.
    */
-  BufMgr *bufMgr{};
+  BTreeScanCursor(BTreeScanCursor &&other) { *this = std::move(other); }
+  BTreeScanCursor &operator=(BTreeScanCursor &&other);
+
+  BTreeScanCursor(const BTreeScanCursor &) = delete;
+  BTreeScanCursor &operator=(const BTreeScanCursor &) = delete;
 
   /**
-   * Datatype of attribute over which index is built.
+   * Ends the scan if it is still executing. Does not throw.
    */
-  Datatype attributeType;
+  ~BTreeScanCursor();
 
   /**
-   * Offset of attribute, over which index is built, inside records.
+   * True if the cursor has been started and not ended.
    */
-  int attrByteOffset{};
+  bool isExecuting() const { return scanExecuting; }
 
-  // MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Fetch the record id of the next index entry that matches the scan. Once
+   * every entry of the current leaf has been returned, unpin it and move on
+   * to its right sibling.
+   * @param outRid	RecordId of next record found that satisfies the scan
+   * @throws ScanNotInitializedException If the cursor is not scanning.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  const void scanNext(RecordId &outRid);
+
+  /**
+   * Fills outRids with up to maxEntries of the next entries of the scan, all
+   * from the same leaf, and returns how many; 0 once the scan has passed the
+   * end of its range. Never throws IndexScanCompletedException. The entries
+   * are copied out of the pinned leaf as one run, and only the last key of
+   * the run is tested against the high bound unless the range ends inside
+   * it.
+   * @param outRids     Array of at least maxEntries record ids to fill.
+   * @param maxEntries  Most entries to return, at least 1.
+   * @param outKeys     If not NULL, array of at least maxEntries keys of the
+   *                    index's type (int, double or StringKey) that receives
+   *                    the key of each entry.
+   * @throws ScanNotInitializedException If the cursor is not scanning.
+   * @throws BadScanParamException If maxEntries is 0, which could not be told
+   *                    apart from the end of the range.
+   **/
+  std::size_t scanNextBatch(RecordId *outRids, std::size_t maxEntries,
+                            void *outKeys = NULL);
+
+  /**
+   * Terminate the scan and unpin its leaf.
+   * @throws ScanNotInitializedException If the cursor is not scanning.
+   **/
+  const void endScan();
+
+ private:
+  friend class BTreeIndex;
+
+  /**
+   * Index being scanned.
+   */
+  BTreeIndex *index{};
 
   /**
    * True if an index scan has been started.
@@ -196,6 +530,26 @@ class BTreeIndex {
    */
   int highValInt{};
 
+  /**
+   * Low DOUBLE value for scan.
+   */
+  double lowValDouble{};
+
+  /**
+   * High DOUBLE value for scan.
+   */
+  double highValDouble{};
+
+  /**
+   * Low STRING value for scan.
+   */
+  StringKey lowValString{};
+
+  /**
+   * High STRING value for scan.
+   */
+  StringKey highValString{};
+
   /**
    * Low Operator. Can only be GT(>) or GTE(>=).
    */
@@ -206,15 +560,140 @@ class BTreeIndex {
    */
   Operator highOp{LT};
 
+  /**
+   * Returns the low or high bound of the scan for a key of type T.
+   */
+  template <class T>
+  T &lowVal();
+  template <class T>
+  T &highVal();
+
+  /**
+   * Start scanning the index. Checks the operators and positions the cursor
+   * on the first entry in range. Returns false, with the scan ended, if there
+   * is no entry in range.
+   * @see BTreeIndex::openScan
+   */
+  bool start(BTreeIndex *indexIn, const void *lowValParm,
+             const Operator lowOpParm, const void *highValParm,
+             const Operator highOpParm);
+
+  /**
+   * Change the currently scanning page to the next page pointed to by the
+   * current page.
+   * @param node the node stored in the currently scanning page.
+   */
+  template <class T>
+  void moveToNextPage(LeafNode<T> *node);
+
+  /**
+   * Recursively find the page id of the first element larger than or equal to
+   * the lower bound given.
+   */
+  template <class T>
+  void setPageIdForScan();
+
+  /**
+   * Find the first element in the currently scanning page that is within the
+   * given bound.
+   */
+  template <class T>
+  void setEntryIndexForScan();
+
+  /**
+   * Continue scanning the next entry. If the currently scanning entry is the
+   * last element in this page, set the current scanning page to the next page.
+   */
+  template <class T>
+  void setNextEntry();
+
+  /**
+   * True if the key lies beyond the high bound of the scan.
+   */
+  template <class T>
+  bool pastHighVal(const T &key);
+
+  /**
+   * start and scanNext for a key of type T.
+   */
+  template <class T>
+  bool startKeyScan(const void *lowValParm, const Operator lowOpParm,
+                    const void *highValParm, const Operator highOpParm);
+  template <class T>
+  void scanNextKey(RecordId &outRid);
+
+  /**
+   * scanNextBatch for a key of type T.
+   */
+  template <class T>
+  std::size_t scanNextBatchKey(RecordId *outRids, std::size_t maxEntries,
+                               T *outKeys);
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
+ * of a relation. Scans are run with BTreeScanCursor, any number at a time;
+ * startScan, scanNext and endScan run one scan with a cursor of the index's
+ * own.
+ */
+class BTreeIndex {
+  friend class BTreeScanCursor;
+
+ private:
+  /**
+   * File object for the index file.
+   */
+  File *file{};
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr *bufMgr{};
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset{};
+
+  /**
+   * Page number of meta page.
+   */
+  PageId headerPageNum{};
+
+  // MEMBERS SPECIFIC TO SCANNING
+
+  /**
+   * Cursor of the scan run by startScan, scanNext and endScan.
+   */
+  BTreeScanCursor scan;
+
+  /**
+   * Number of leaves prefetched ahead of the current one once a scan moves
+   * past its first leaf.
+   */
+  int prefetchDepth{BufMgr::DEFAULT_PREFETCH_DEPTH};
+
   struct IndexMetaInfo indexMetaInfo {};
 
+  /**
+   * Write indexMetaInfo to the meta page. Called whenever the root page of
+   * the tree changes.
+   */
+  void writeMetaInfo();
+
   /**
    * Alloc a page in the buffer for a leaf node
    *
    * @param newPageId the page number for the new node
    * @return a pointer to the new leaf node
    */
-  LeafNodeInt *allocLeafNode(PageId &newPageId);
+  template <class T>
+  LeafNode<T> *allocLeafNode(PageId &newPageId);
 
   /**
    * Alloca a page in the buffer for an internal node
@@ -222,7 +701,8 @@ class BTreeIndex {
    * @param newPageId the page number for the new node
    * @return a pointer to the new internal node
    */
-  NonLeafNodeInt *allocNonLeafNode(PageId &newPageId);
+  template <class T>
+  NonLeafNode<T> *allocNonLeafNode(PageId &newPageId);
 
   /**
    * This method takes in a page and checks if the page stores a leaf node or
@@ -239,117 +719,111 @@ class BTreeIndex {
   /**
    * Checks if an internal node is full
    *
-   * Assumption: All valid page numbers are nonzero.
-   *
    * @param node an internal node
    * @return true if an internal node is full
    *         false if an internal node is not full
    */
-  bool isNonLeafNodeFull(NonLeafNodeInt *node);
+  template <class T>
+  bool isNonLeafNodeFull(NonLeafNode<T> *node);
 
   /**
    * Checks if a leaf node is full
    *
-   * Assumption: All valid records are nonzero.
-   *
    * @param node a leaf node
    * @return true if a leaf node is full
    *         false if a leaf node is not full
    */
-  bool isLeafNodeFull(LeafNodeInt *node);
+  template <class T>
+  bool isLeafNodeFull(LeafNode<T> *node);
 
   /**
    * Returns the number of records stored in the leaf node.
    *
-   * Assumption:
-   *             1. All records are continuously stored.
-   *             2. All valid records are nonzero.
-   *
    * @param node a leaf node
    * @return the number of records stored in the leaf node
    */
-  int getLeafLen(LeafNodeInt *node);
+  template <class T>
+  int getLeafLen(LeafNode<T> *node);
 
   /**
    * Returns the number of records stored in the internal node.
    *
-   * Assumption:
-   *             1. All records are continuously stored.
-   *             2. All valid page numbers are nonzero.
-   *
    * @param node an internal node
    * @return the number of records stored in the internal node
    */
-  int getNonLeafLen(NonLeafNodeInt *node);
+  template <class T>
+  int getNonLeafLen(NonLeafNode<T> *node);
 
   /**
-   * Given an integer array, find the index of the first integer larger than
-   * (or equal to) the given key.
+   * Given a key array, find the index of the first key larger than (or equal
+   * to) the given key.
    *
    * Assumption: The array is sorted.
    *
-   * @param arr an interger array
+   * @param arr a key array
    * @param len the length of the array
    * @param key the target key
    * @param includeKey whether the current key is included
    *
-   * @return a. the index of the first integer larger than the given key if
+   * @return a. the index of the first key larger than the given key if
    *            includeKey = false
-   *         b. the index of the first integer larger than or equal to the
+   *         b. the index of the first key larger than or equal to the
    *            given key if includeKey = true
    *         c. -1 if the key is not found till the end of array
    */
-  int findArrayIndex(const int *arr, int len, int key, bool includeKey = true);
+  template <class T>
+  int findArrayIndex(const T *arr, int len, const T &key,
+                     bool includeKey = true);
 
   /**
    * Find the index of the first key smaller than the given key
    *
    * Assumption:
    *             1. All records are continuously stored.
-   *             2. All valid page numbers are nonzero.
-   *             3. All keys are sorted in the node.
+   *             2. All keys are sorted in the node.
    *
    * @param node an internal node
    * @param key the key to find
    * @return the index of the first key smaller than the given key
    *         return the largest index if not found
    */
-  int findIndexNonLeaf(NonLeafNodeInt *node, int key);
+  template <class T>
+  int findIndexNonLeaf(NonLeafNode<T> *node, const T &key);
 
   /**
    * Find the insertaion index for a key in a leaf node
    *
    * Assumption:
    *             1. All records are continuously stored.
-   *             2. All valid records are nonzero.
-   *             3. All keys are sorted in the node.
+   *             2. All keys are sorted in the node.
    *
    * @param node a leaf node
    * @param key the key to be inserted
    *
    * @return the insertaion index for a key in a leaf node
    */
-  int findInsertionIndexLeaf(LeafNodeInt *node, int key);
+  template <class T>
+  int findInsertionIndexLeaf(LeafNode<T> *node, const T &key);
 
   /**
    * Find the index of the first key larger than the given key in the leaf node
    *
    * Assumption:
    *             1. All records are continuously stored.
-   *             2. All valid records are nonzero.
-   *             3. All keys are sorted in the node.
+   *             2. All keys are sorted in the node.
    *
    * @param node a leaf node
    * @param key the key to find
    * @param includeKey whether the current key is included
    *
-   * @return a. the index of the first integer larger than the given key if
+   * @return a. the index of the first key larger than the given key if
    *            includeKey = false
-   *         b. the index of the first integer larger than or equal to the
+   *         b. the index of the first key larger than or equal to the
    *            given key if includeKey = true
    *         c. -1 if the key is not found till the end of array
    */
-  int findScanIndexLeaf(LeafNodeInt *node, int key, bool includeKey);
+  template <class T>
+  int findScanIndexLeaf(LeafNode<T> *node, const T &key, bool includeKey);
 
   /**
    * Inserts the given key-record pair into the leaf node at the given insertion
@@ -360,7 +834,8 @@ class BTreeIndex {
    * @param key the key of the key-record pair to be inserted
    * @param rid the record ID of the key-record pair to be inserted
    */
-  void insertToLeafNode(LeafNodeInt *node, int i, int key, RecordId rid);
+  template <class T>
+  void insertToLeafNode(LeafNode<T> *node, int i, const T &key, RecordId rid);
 
   /**
    * Inserts the given key-(page number) pair into the given leaf node at the
@@ -371,7 +846,8 @@ class BTreeIndex {
    * @param key the key of the key-(page number) pair
    * @param pid the page number of the key-(page number) pair
    */
-  void insertToNonLeafNode(NonLeafNodeInt *n, int i, int key, PageId pid);
+  template <class T>
+  void insertToNonLeafNode(NonLeafNode<T> *n, int i, const T &key, PageId pid);
 
   /**
    * Splits a leaf node into two.
@@ -381,7 +857,8 @@ class BTreeIndex {
    * @param newNode a pointer to the new node
    * @param index the index where the split occurs.
    */
-  void splitLeafNode(LeafNodeInt *node, LeafNodeInt *newNode, int index);
+  template <class T>
+  void splitLeafNode(LeafNode<T> *node, LeafNode<T> *newNode, int index);
 
   /**
    * Split the internal node by the given index. It moves the values stored in
@@ -396,7 +873,8 @@ class BTreeIndex {
    *
    * @return a pointer to the newly created internal node.
    */
-  void splitNonLeafNode(NonLeafNodeInt *curr, NonLeafNodeInt *next, int i,
+  template <class T>
+  void splitNonLeafNode(NonLeafNode<T> *curr, NonLeafNode<T> *next, int i,
                         bool keepMidKey);
 
   /**
@@ -408,7 +886,8 @@ class BTreeIndex {
    *
    * @return the page id of the new root
    */
-  PageId splitRoot(int midVal, PageId pid1, PageId pid2);
+  template <class T>
+  PageId splitRoot(const T &midVal, PageId pid1, PageId pid2);
 
   /**
    * Insert the given key-(record id) pair into the given leaf node.
@@ -417,15 +896,16 @@ class BTreeIndex {
    * @param origPageId the page id of the page that stores the leaf node
    * @param key the key of the key-record pair
    * @param rid the record id of the key-record pair
-   * @param midVal a reference to an integer in the parent node. If the
-   * insertion requires a split in the leaf node, midVal is set to the smallest
-   * element of the newly created node.
+   * @param midVal a reference to a key in the parent node. If the insertion
+   * requires a split in the leaf node, midVal is set to the smallest element
+   * of the newly created node.
    *
    * @return The page number of the newly created page if insertion requires a
    *         split, or 0 if no new node is created.
    */
-  PageId insertToLeafPage(Page *origPage, PageId origPageId, int key,
-                          RecordId rid, int &midVal);
+  template <class T>
+  PageId insertToLeafPage(Page *origPage, PageId origPageId, const T &key,
+                          RecordId rid, T &midVal);
 
   /**
    * Recursively insert the given key-record pair into the subtree with the
@@ -436,40 +916,168 @@ class BTreeIndex {
    *        subtree.
    * @param key the key of the key-record pair to be inserted
    * @param rid the record ID of the key-record pair to be inserted
-   * @param midVal a pointer to an integer value to be stored in the parent
-   * node. If the insertion requires a split in the current level, midVal is set
-   *        to the smallest key stored in the subtree pointed by the newly
-   * created node.
+   * @param midVal a reference to a key to be stored in the parent node. If the
+   *        insertion requires a split in the current level, midVal is set to
+   *        the smallest key stored in the subtree pointed by the newly created
+   *        node.
    *
    * @return the page number of the newly created node if a split occurs, or 0
    *         otherwise.
    */
-  PageId insert(PageId origPageId, int key, RecordId rid, int &midVal);
+  template <class T>
+  PageId insert(PageId origPageId, const T &key, RecordId rid, T &midVal);
 
   /**
-   * Change the currently scanning page to the next page pointed to by the
-   * current page.
-   * @param node the node stored in the currently scanning page.
+   * Insert a key-record pair into the tree, growing a new root if the old one
+   * splits.
    */
-  void moveToNextPage(LeafNodeInt *node);
+  template <class T>
+  void insertKey(const T &key, RecordId rid);
 
   /**
-   * Recursively find the page id of the first element larger than or equal to
-   * the lower bound given.
+   * Put a page no longer used by the tree at the head of the free list.
+   *
+   * @param pageNo the page to free; it must not be pinned
    */
-  void setPageIdForScan();
+  void freePage(PageId pageNo);
 
   /**
-   * Find the first element in the currently scanning page that is within the
-   * given bound.
+   * Put every page of the subtree with the given root on the free list.
    */
-  void setEntryIndexForScan();
+  template <class T>
+  void freeSubtree(PageId pageNo);
 
   /**
-   * Continue scanning the next entry. If the currently scanning entry is the
-   * last element in this page, set the current scanning page to the next page.
+   * Remove the key-(page number) pair at the given index of an internal node:
+   * key i and the child to its right.
    */
-  void setNextEntry();
+  template <class T>
+  void removeFromNonLeafNode(NonLeafNode<T> *node, int i);
+
+  /**
+   * Recursively delete the given key-record pair from the subtree with the
+   * given root node, fixing children left with too few entries on the way
+   * back up. Children whose keys may equal key are tried from left to right
+   * until the pair is found.
+   *
+   * @param pageNo page id of the page that stores the root of the subtree
+   * @param key the key of the pair
+   * @param rid the record id of the pair
+   * @param underflow set to whether the root of the subtree is left with
+   *        fewer entries than a node is allowed outside the root
+   *
+   * @return whether the pair was found
+   */
+  template <class T>
+  bool remove(PageId pageNo, const T &key, RecordId rid, bool &underflow);
+
+  /**
+   * Give child i of an internal node enough entries again, by moving entries
+   * over from a sibling or, if the sibling has none to spare, by merging the
+   * two. The right one of a merged pair is freed.
+   *
+   * @param parent the internal node, pinned by the caller
+   * @param i the index of the child with too few entries
+   */
+  template <class T>
+  void fixUnderflow(NonLeafNode<T> *parent, int i);
+
+  /**
+   * Balance or merge two neighbouring leaves, separated by key i of parent.
+   * Returns whether they were merged into left.
+   */
+  template <class T>
+  bool rebalanceLeaves(NonLeafNode<T> *parent, int i, LeafNode<T> *left,
+                       LeafNode<T> *right);
+
+  /**
+   * Balance or merge two neighbouring internal nodes, separated by key i of
+   * parent, rotating keys through it. Returns whether they were merged into
+   * left.
+   */
+  template <class T>
+  bool rebalanceNonLeaves(NonLeafNode<T> *parent, int i, NonLeafNode<T> *left,
+                          NonLeafNode<T> *right);
+
+  /**
+   * Delete a key-record pair from the tree, making the only child of an
+   * emptied internal root the new root.
+   */
+  template <class T>
+  bool deleteKey(const T &key, RecordId rid);
+
+  /**
+   * Fill a new index from the base relation, by inserting every record or by
+   * bulk loading them.
+   */
+  template <class T>
+  void buildFromRelation(const std::string &relationName, BuildMode buildMode,
+                         double fillFactor);
+
+  /**
+   * Returns how many entries a node of the given capacity receives during a
+   * bulk load. The result is clamped to [minEntries, capacity].
+   *
+   * @param capacity the maximum number of entries the node can hold
+   * @param minEntries the smallest number of entries a node may hold
+   * @param fillFactor the requested fraction of the node to fill
+   *
+   * @return the number of entries to pack into each node
+   */
+  int entriesPerNode(int capacity, int minEntries, double fillFactor);
+
+  /**
+   * Append every key-record pair currently stored in the tree to the given
+   * vector, in key order, by walking the leaf chain from the leftmost leaf.
+   *
+   * @param entries the vector the pairs are appended to
+   */
+  template <class T>
+  void collectEntries(std::vector<RIDKeyPair<T> > &entries);
+
+  /**
+   * Pack sorted key-record pairs into a chain of leaf nodes, taking them one
+   * at a time so they need not all be in memory.
+   *
+   * @param total the number of pairs
+   * @param nextEntry returns the next pair in sorted order, called total times
+   * @param fillFactor the fraction of each leaf to fill
+   * @param level returns the page number and smallest key of every leaf, from
+   *        left to right
+   */
+  template <class T>
+  void buildLeafLevel(std::size_t total,
+                      const std::function<RIDKeyPair<T>()> &nextEntry,
+                      double fillFactor,
+                      std::vector<PageKeyPair<T> > &level);
+
+  /**
+   * Pack one level of internal nodes on top of the given level of nodes.
+   *
+   * @param children the page number and smallest key of every node in the
+   *        level below, from left to right
+   * @param fillFactor the fraction of each internal node to fill
+   * @param aboveLeaf whether the children are leaf nodes
+   * @param level returns the page number and smallest key of every node
+   *        created, from left to right
+   */
+  template <class T>
+  void buildNonLeafLevel(const std::vector<PageKeyPair<T> > &children,
+                         double fillFactor, bool aboveLeaf,
+                         std::vector<PageKeyPair<T> > &level);
+
+  /**
+   * Build the tree bottom-up from sorted key-record pairs and make it the
+   * root of the index.
+   *
+   * @param total the number of pairs
+   * @param nextEntry returns the next pair in sorted order, called total times
+   * @param fillFactor the fraction of each node to fill
+   */
+  template <class T>
+  void buildTree(std::size_t total,
+                 const std::function<RIDKeyPair<T>()> &nextEntry,
+                 double fillFactor);
 
  public:
   /**
@@ -486,14 +1094,21 @@ class BTreeIndex {
    * index is to be built, in the record
    * @param attrType						Datatype
    * of attribute over which index is built
+   * @param buildMode           Whether to insert the tuples one at a time or
+   * to bulk load them
+   * @param fillFactor          Fraction of each node filled by a bulk load
    * @throws  BadIndexInfoException     If the index file already exists for
    * the corresponding attribute, but values in metapage(relationName,
    * attribute byte offset, attribute type etc.) do not match with values
-   * received through constructor parameters.
+   * received through constructor parameters, or the index was written in
+   * another INDEX_FORMAT_VERSION.
+   * @throws  BadFillFactorException    If buildMode is BULK_BUILD and
+   * fillFactor is not in (0, 1].
    */
   BTreeIndex(const std::string &relationName, std::string &outIndexName,
              BufMgr *bufMgrIn, const int attrByteOffset,
-             const Datatype attrType);
+             const Datatype attrType, const BuildMode buildMode = INSERT_BUILD,
+             const double fillFactor = DEFAULT_FILL_FACTOR);
 
   /**
    * BTreeIndex Destructor.
@@ -520,7 +1135,76 @@ class BTreeIndex {
   const void insertEntry(const void *key, const RecordId rid);
 
   /**
-   * Begin a filtered scan of the index.  For instance, if the method is called
+   * Delete the entry with the pair <value,rid>.
+   * Start from root to recursively find out the leaf holding the entry. A
+   * node, other than the root, left less than half full takes entries from a
+   * neighbouring sibling or, if that has none to spare, is merged with it;
+   * the merge removes a key from the parent, which may in turn run short.
+   * An internal root left without keys is replaced by its only child. Pages
+   * of merged nodes go on the free list of the index file.
+   * @param key			Key of the entry, pointer to integer/double/char
+   *string
+   * @param rid			Record ID of the entry.
+   * @return  False if the index holds no such entry.
+   **/
+  const bool deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Bulk load the given <value,rid> pairs into the index.
+   * The pairs are sorted, together with any entries already in the index, and
+   * the tree is rebuilt bottom-up: leaves are packed left to right and linked
+   * through rightSibPageNo, then each level of non-leaf nodes is packed on top
+   * of the level below until a single root remains. Each node is filled to
+   * the given fraction of its capacity. The pages of the old tree go on the
+   * free list and are reused.
+   * @param entries			Key-record pairs to load. Sorted in place.
+   * @param fillFactor	Fraction of each node to fill, in (0, 1]
+   * @throws  BadIndexInfoException If T is not the type of the key.
+   * @throws  BadFillFactorException If fillFactor is not in (0, 1].
+   **/
+  template <class T>
+  const void bulkLoad(std::vector<RIDKeyPair<T> > &entries,
+                      const double fillFactor = DEFAULT_FILL_FACTOR);
+
+  /**
+   * Open a filtered scan of the index with a cursor of its own. For instance,
+   * if the method is called using ("a",GT,"d",LTE) then the cursor returns
+   * all entries with a value greater than "a" and less than or equal to "d".
+   * Start from root to find out the leaf page that contains the first
+   * RecordID that satisfies the scan parameters, and keep that page pinned
+   * until the cursor moves past it or is ended. Other scans of the index,
+   * including the one of startScan, are not affected.
+   * @param lowVal	Low value of range, pointer to integer / double / char
+   *string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char
+   *string
+   * @param highOp	High operator (LT/LTE)
+   * @return  The cursor, positioned on the first entry in range.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   **/
+  BTreeScanCursor openScan(const void *lowVal, const Operator lowOp,
+                           const void *highVal, const Operator highOp);
+
+  /**
+   * Like openScan, but reports an empty range by returning false instead of
+   * throwing NoSuchKeyFoundException.
+   * @param cursor  Receives the scan; any scan it was running is ended.
+   * @return  False if no key in the B+ tree satisfies the scan criteria.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   **/
+  bool openScan(const void *lowVal, const Operator lowOp, const void *highVal,
+                const Operator highOp, BTreeScanCursor &cursor);
+
+  /**
+   * Begin a filtered scan of the index with the index's own cursor.  For
+   * instance, if the method is called
    * using ("a",GT,"d",LTE) then we should seek all entries with a value
    * greater than "a" and less than or equal to "d".
    * If another scan is already executing, that needs to be ended here.
@@ -556,11 +1240,26 @@ class BTreeIndex {
    **/
   const void scanNext(RecordId &outRid);  // returned record id
 
+  /**
+   * Fetch up to maxEntries of the next index entries that match the scan
+   * started by startScan, without exceptions at the end of the range.
+   * @see BTreeScanCursor::scanNextBatch
+   **/
+  std::size_t scanNextBatch(RecordId *outRids, std::size_t maxEntries,
+                            void *outKeys = NULL);
+
   /**
    * Terminate the current scan. Unpin any pinned pages. Reset scan specific
    *variables.
    * @throws ScanNotInitializedException If no scan has been initialized.
    **/
   const void endScan();
+
+  /**
+   * Set how many leaves scans prefetch ahead of the current one; 0 turns
+   * prefetching off.
+   * @param depth	Number of leaves to prefetch
+   **/
+  void setPrefetchDepth(const int depth) { prefetchDepth = depth; }
 };
 }  // namespace badgerdb
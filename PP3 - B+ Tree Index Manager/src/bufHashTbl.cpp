@@ -10,95 +10,122 @@
 #include "buffer.h"
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
-#include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File *file, const PageId pageNo) {
-  int tmp, value;
-  tmp = (long) file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+std::uint64_t BufHashTbl::hash(const File *file, const PageId pageNo) {
+  // combine the whole pointer with the page number, then scramble all the
+  // bits (murmur3 finalizer) so sequential page numbers spread out
+  std::uint64_t h = (std::uint64_t) (std::uintptr_t) file;
+  h = h * 0x9e3779b97f4a7c15ULL ^ pageNo;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-    : HTSIZE(htSize) {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket *[htSize];
-  for (int i = 0; i < HTSIZE; i++)
-    ht[i] = NULL;
+BufHashTbl::BufHashTbl(int htSize) {
+  // start every partition at most half full for the expected entries
+  std::uint32_t slots = 8;
+  while (slots < 2 * (std::uint32_t) htSize / NUM_PARTITIONS)
+    slots *= 2;
+
+  for (int i = 0; i < NUM_PARTITIONS; i++) {
+    partitions[i].slots = new hashBucket[slots]();
+    partitions[i].mask = slots - 1;
+    partitions[i].size = 0;
+  }
 }
 
 BufHashTbl::~BufHashTbl() {
-  for (int i = 0; i < HTSIZE; i++) {
-    hashBucket *tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete[] ht;
+  for (int i = 0; i < NUM_PARTITIONS; i++)
+    delete[] partitions[i].slots;
 }
 
-void BufHashTbl::insert(const File *file, const PageId pageNo, const FrameId frameNo) {
-  int index = hash(file, pageNo);
+void BufHashTbl::grow(hashPartition &part) {
+  hashBucket *old = part.slots;
+  std::uint32_t oldSlots = part.mask + 1;
+
+  part.slots = new hashBucket[2 * oldSlots]();
+  part.mask = 2 * oldSlots - 1;
 
-  hashBucket *tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-      throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+  for (std::uint32_t i = 0; i < oldSlots; i++) {
+    if (old[i].file == NULL) continue;
+    std::uint32_t index = hash(old[i].file, old[i].pageNo) & part.mask;
+    while (part.slots[index].file != NULL)
+      index = (index + 1) & part.mask;
+    part.slots[index] = old[i];
   }
+  delete[] old;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-    throw HashTableException();
+void BufHashTbl::insert(const File *file, const PageId pageNo, const FrameId frameNo) {
+  std::uint64_t h = hash(file, pageNo);
+  hashPartition &part = partition(h);
+
+  if (2 * (part.size + 1) > part.mask + 1)
+    grow(part);
+
+  std::uint32_t index = h & part.mask;
+  while (part.slots[index].file != NULL) {
+    hashBucket &bucket = part.slots[index];
+    if (bucket.file == file && bucket.pageNo == pageNo)
+      throw HashAlreadyPresentException(bucket.file->filename(), bucket.pageNo, bucket.frameNo);
+    index = (index + 1) & part.mask;
+  }
 
-  tmpBuc->file = (File *) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  part.slots[index].file = (File *) file;
+  part.slots[index].pageNo = pageNo;
+  part.slots[index].frameNo = frameNo;
+  part.size++;
 }
 
-void BufHashTbl::lookup(const File *file, const PageId pageNo, FrameId &frameNo) {
-  int index = hash(file, pageNo);
-  hashBucket *tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
+bool BufHashTbl::lookup(const File *file, const PageId pageNo, FrameId &frameNo) {
+  std::uint64_t h = hash(file, pageNo);
+  hashPartition &part = partition(h);
+
+  std::uint32_t index = h & part.mask;
+  while (part.slots[index].file != NULL) {
+    const hashBucket &bucket = part.slots[index];
+    if (bucket.file == file && bucket.pageNo == pageNo) {
+      frameNo = bucket.frameNo; // return frameNo by reference
+      return true;
     }
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & part.mask;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  return false;
 }
 
-void BufHashTbl::remove(const File *file, const PageId pageNo) {
-
-  int index = hash(file, pageNo);
-  hashBucket *tmpBuc = ht[index];
-  hashBucket *prevBuc = NULL;
+bool BufHashTbl::remove(const File *file, const PageId pageNo) {
+  std::uint64_t h = hash(file, pageNo);
+  hashPartition &part = partition(h);
 
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      if (prevBuc)
-        prevBuc->next = tmpBuc->next;
-      else
-        ht[index] = tmpBuc->next;
+  std::uint32_t index = h & part.mask;
+  while (part.slots[index].file != file || part.slots[index].pageNo != pageNo) {
+    if (part.slots[index].file == NULL)
+      return false;
+    index = (index + 1) & part.mask;
+  }
 
-      delete tmpBuc;
-      return;
-    } else {
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  // shift back any later entry of the probe run whose home slot is not
+  // between the hole and itself, so lookups never stop at the hole early
+  std::uint32_t hole = index;
+  std::uint32_t next = (hole + 1) & part.mask;
+  while (part.slots[next].file != NULL) {
+    std::uint32_t home = hash(part.slots[next].file, part.slots[next].pageNo) & part.mask;
+    if (((next - home) & part.mask) >= ((next - hole) & part.mask)) {
+      part.slots[hole] = part.slots[next];
+      hole = next;
     }
+    next = (next + 1) & part.mask;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  part.slots[hole].file = NULL;
+  part.size--;
+  return true;
 }
 
 }
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
 #include "file.h"
 
 namespace badgerdb {
@@ -16,7 +18,7 @@ namespace badgerdb {
 */
 struct hashBucket {
   /**
-   * pointer a file object (more on this below)
+   * pointer a file object (more on this below). NULL if the slot is empty.
    */
   File *file;
 
@@ -29,41 +31,91 @@ struct hashBucket {
    * frame number of page in the buffer pool
    */
   FrameId frameNo;
+};
+
+/**
+* @brief One independently latched partition of the hash table. Each partition
+* is an open addressing table with linear probing over a power of two number
+* of slots.
+*/
+struct hashPartition {
+  /**
+   * Latch protecting the slots of this partition
+   */
+  std::mutex latch;
+
+  /**
+   * Slots of the partition
+   */
+  hashBucket *slots;
+
+  /**
+   * Number of slots minus one
+   */
+  std::uint32_t mask;
 
   /**
-   * Next node in the hash table
+   * Number of slots in use
    */
-  hashBucket *next;
+  std::uint32_t size;
 };
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* (file, pageNo) is mixed into a 64 bit hash; the high bits pick one of
+* NUM_PARTITIONS partitions and the low bits the home slot within it. Entries
+* are stored inline in the slots, so inserting and removing never allocates,
+* and removal shifts later entries back instead of leaving tombstones. A
+* partition only reallocates its slots when it grows past half full.
+*
+* insert, lookup and remove do no locking themselves; callers must hold
+* latch(file, pageNo) for the entry they touch.
 */
 class BufHashTbl {
- private:
+ public:
   /**
-   *	Size of Hash Table
+   * Number of independently latched partitions of the table
    */
-  int HTSIZE;
+  static const int NUM_PARTITIONS = 64;
+
+ private:
   /**
-   * Actual Hash table object
+   * Partitions of the table
    */
-  hashBucket **ht;
+  hashPartition partitions[NUM_PARTITIONS];
 
   /**
-   * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+   * returns a 64 bit hash value computed using file and pageNo
    *
    * @param file   	File object
    * @param pageNo  Page number in the file
    * @return  			Hash value.
    */
-  int hash(const File *file, const PageId pageNo);
+  static std::uint64_t hash(const File *file, const PageId pageNo);
+
+  /**
+   * returns the partition that holds entries with the given hash value
+   *
+   * @param h   		Hash value
+   * @return  			Partition.
+   */
+  hashPartition &partition(const std::uint64_t h) {
+    return partitions[h >> 58];
+  }
+
+  /**
+   * Double the number of slots in a partition and reinsert its entries.
+   *
+   * @param part  	Partition to grow
+   */
+  void grow(hashPartition &part);
 
  public:
   /**
  * Constructor of BufHashTbl class
+   *
+   * @param htSize  Expected number of entries
    */
   BufHashTbl(const int htSize);  // constructor
 
@@ -72,6 +124,17 @@ class BufHashTbl {
    */
   ~BufHashTbl(); // destructor
 
+  /**
+ * Returns the latch of the partition holding (file, pageNo).
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   * @return  			Latch to hold while accessing the entry.
+   */
+  std::mutex &latch(const File *file, const PageId pageNo) {
+    return partition(hash(file, pageNo)).latch;
+  }
+
   /**
  * Insert entry into hash table mapping (file, pageNo) to frameNo.
    *
@@ -79,7 +142,6 @@ class BufHashTbl {
    * @param pageNo 	Page number in the file
    * @param frameNo Frame number assigned to that page of the file
  * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
- * @throws  HashTableException (optional) if could not create a new bucket as running of memory
    */
   void insert(const File *file, const PageId pageNo, const FrameId frameNo);
 
@@ -89,19 +151,19 @@ class BufHashTbl {
    *
    * @param file  	File object
    * @param pageNo	Page number in the file
-   * @param frameNo Frame number reference
- * @throws HashNotFoundException if the page entry is not found in the hash table
+   * @param frameNo Frame number reference, set if the entry is found
+   * @return  			True if the page entry is found in the hash table
    */
-  void lookup(const File *file, const PageId pageNo, FrameId &frameNo);
+  bool lookup(const File *file, const PageId pageNo, FrameId &frameNo);
 
   /**
  * Delete entry (file,pageNo) from hash table.
    *
    * @param file   	File object
    * @param pageNo  Page number in the file
- * @throws HashNotFoundException if the page entry is not found in the hash table
+   * @return  			True if the page entry was found in the hash table
    */
-  void remove(const File *file, const PageId pageNo);
+  bool remove(const File *file, const PageId pageNo);
 };
 
 }
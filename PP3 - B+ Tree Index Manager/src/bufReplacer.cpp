@@ -0,0 +1,333 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "bufReplacer.h"
+
+namespace badgerdb {
+
+BufReplacer *BufReplacer::create(ReplacementPolicy policy, std::uint32_t numBufs) {
+  switch (policy) {
+    case LRU_K_POLICY:
+      return new LRUKReplacer(numBufs);
+    case TWO_Q_POLICY:
+      return new TwoQReplacer(numBufs);
+    case ARC_POLICY:
+      return new ARCReplacer(numBufs);
+    case CLOCK_POLICY:
+    default:
+      return new ClockReplacer(numBufs);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// CLOCK
+// -----------------------------------------------------------------------------
+
+ClockReplacer::ClockReplacer(std::uint32_t bufs)
+    : numBufs(bufs), clockHand(bufs - 1), refbits(new std::atomic<bool>[bufs]) {
+  for (std::uint32_t i = 0; i < bufs; i++)
+    refbits[i] = false;
+}
+
+bool ClockReplacer::pickVictim(const ClaimFunc &claim, FrameId &frame) {
+  std::uint32_t numScanned = 0;
+
+  while (numScanned < 2 * numBufs)    //Need to scn twice
+  {
+    // advance the clock
+    FrameId hand = advanceClock();
+    numScanned++;
+
+    // has been referenced, clear the bit
+    if (refbits[hand].exchange(false))
+      continue;
+
+    // hasn't been referenced, use it unless someone has it pinned
+    if (claim(hand)) {
+      frame = hand;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ClockReplacer::frameLoaded(FrameId frame, const File *file, PageId pageNo) {
+  refbits[frame] = true;
+}
+
+void ClockReplacer::frameAccessed(FrameId frame) {
+  refbits[frame] = true;
+}
+
+void ClockReplacer::frameFreed(FrameId frame, bool evicted) {
+  refbits[frame] = false;
+}
+
+void ClockReplacer::upcomingVictims(std::size_t count, std::vector<FrameId> &frames) {
+  // the frames the hand reaches next; referenced ones only get a second
+  // chance, which is no reason to leave them dirty
+  FrameId hand = clockHand.load();
+  for (std::uint32_t i = 1; i <= numBufs && i <= count; i++)
+    frames.push_back((hand + i) % numBufs);
+}
+
+// -----------------------------------------------------------------------------
+// Ghost lists
+// -----------------------------------------------------------------------------
+
+void GhostList::push(const File *file, PageId pageNo, std::uint64_t value) {
+  Key key(file, pageNo);
+  auto it = index.find(key);
+  if (it != index.end()) {
+    order.erase(it->second.first);
+    index.erase(it);
+  }
+  order.push_front(key);
+  index[key] = std::make_pair(order.begin(), value);
+}
+
+bool GhostList::remove(const File *file, PageId pageNo, std::uint64_t &value) {
+  auto it = index.find(Key(file, pageNo));
+  if (it == index.end())
+    return false;
+  value = it->second.second;
+  order.erase(it->second.first);
+  index.erase(it);
+  return true;
+}
+
+void GhostList::trim(std::size_t maxSize) {
+  while (order.size() > maxSize) {
+    index.erase(order.back());
+    order.pop_back();
+  }
+}
+
+// -----------------------------------------------------------------------------
+// List based policies
+// -----------------------------------------------------------------------------
+
+const int ListReplacer::FREE_LIST;
+
+ListReplacer::ListReplacer(std::uint32_t bufs, int numLists)
+    : numBufs(bufs), lists(numLists), where(bufs, FREE_LIST), pages(bufs), positions(bufs) {
+  for (FrameId i = 0; i < bufs; i++)
+    positions[i] = lists[FREE_LIST].insert(lists[FREE_LIST].end(), i);
+}
+
+void ListReplacer::moveToFront(FrameId frame, int list) {
+  lists[list].splice(lists[list].begin(), lists[where[frame]], positions[frame]);
+  where[frame] = list;
+}
+
+bool ListReplacer::claimOldest(int list, const ClaimFunc &claim, FrameId &frame) {
+  for (auto it = lists[list].rbegin(); it != lists[list].rend(); ++it) {
+    if (claim(*it)) {
+      frame = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ListReplacer::listOldest(int list, std::size_t count, std::vector<FrameId> &frames) {
+  for (auto it = lists[list].rbegin(); it != lists[list].rend() && count > 0; ++it, count--)
+    frames.push_back(*it);
+}
+
+bool ListReplacer::pickVictim(const ClaimFunc &claim, FrameId &frame) {
+  std::lock_guard<std::mutex> guard(latch);
+  // frames without a page go first
+  return claimOldest(FREE_LIST, claim, frame) || chooseVictim(claim, frame);
+}
+
+void ListReplacer::frameLoaded(FrameId frame, const File *file, PageId pageNo) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (where[frame] != FREE_LIST)
+    removed(frame, where[frame], false);
+  pages[frame] = std::make_pair(file, pageNo);
+  loaded(frame);
+}
+
+void ListReplacer::frameAccessed(FrameId frame) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (where[frame] != FREE_LIST)
+    accessed(frame);
+}
+
+void ListReplacer::frameFreed(FrameId frame, bool evicted) {
+  std::lock_guard<std::mutex> guard(latch);
+  if (where[frame] == FREE_LIST)
+    return;
+  removed(frame, where[frame], evicted);
+  moveToFront(frame, FREE_LIST);
+}
+
+void ListReplacer::upcomingVictims(std::size_t count, std::vector<FrameId> &frames) {
+  std::lock_guard<std::mutex> guard(latch);
+  // frames without a page are taken first but have nothing to clean
+  listVictims(count, frames);
+}
+
+// -----------------------------------------------------------------------------
+// LRU-K
+// -----------------------------------------------------------------------------
+
+LRUKReplacer::LRUKReplacer(std::uint32_t bufs)
+    : ListReplacer(bufs, 2), now(0), keys(bufs) {
+}
+
+void LRUKReplacer::loaded(FrameId frame) {
+  // a page evicted not long ago keeps its last reference as history
+  std::uint64_t previous = 0;
+  history.remove(pages[frame].first, pages[frame].second, previous);
+
+  keys[frame] = HistoryKey(previous, ++now, frame);
+  order.insert(keys[frame]);
+  moveToFront(frame, RESIDENT_LIST);
+}
+
+void LRUKReplacer::accessed(FrameId frame) {
+  order.erase(keys[frame]);
+  keys[frame] = HistoryKey(std::get<1>(keys[frame]), ++now, frame);
+  order.insert(keys[frame]);
+}
+
+void LRUKReplacer::removed(FrameId frame, int from, bool evicted) {
+  order.erase(keys[frame]);
+  if (evicted) {
+    history.push(pages[frame].first, pages[frame].second, std::get<1>(keys[frame]));
+    history.trim(numBufs);
+  }
+}
+
+bool LRUKReplacer::chooseVictim(const ClaimFunc &claim, FrameId &frame) {
+  for (const HistoryKey &key : order) {
+    if (claim(std::get<2>(key))) {
+      frame = std::get<2>(key);
+      return true;
+    }
+  }
+  return false;
+}
+
+void LRUKReplacer::listVictims(std::size_t count, std::vector<FrameId> &frames) {
+  for (auto it = order.begin(); it != order.end() && count > 0; ++it, count--)
+    frames.push_back(std::get<2>(*it));
+}
+
+// -----------------------------------------------------------------------------
+// 2Q
+// -----------------------------------------------------------------------------
+
+TwoQReplacer::TwoQReplacer(std::uint32_t bufs)
+    : ListReplacer(bufs, 3),
+      kin(std::max<std::size_t>(1, bufs / 4)),
+      kout(std::max<std::size_t>(1, bufs / 2)) {
+}
+
+void TwoQReplacer::loaded(FrameId frame) {
+  // only pages referenced again after leaving A1in are considered hot
+  if (a1out.remove(pages[frame].first, pages[frame].second))
+    moveToFront(frame, AM_LIST);
+  else
+    moveToFront(frame, A1IN_LIST);
+}
+
+void TwoQReplacer::accessed(FrameId frame) {
+  // hits in A1in are treated as correlated with the first reference
+  if (where[frame] == AM_LIST)
+    moveToFront(frame, AM_LIST);
+}
+
+void TwoQReplacer::removed(FrameId frame, int from, bool evicted) {
+  if (evicted && from == A1IN_LIST) {
+    a1out.push(pages[frame].first, pages[frame].second);
+    a1out.trim(kout);
+  }
+}
+
+bool TwoQReplacer::chooseVictim(const ClaimFunc &claim, FrameId &frame) {
+  if (lists[A1IN_LIST].size() > kin)
+    return claimOldest(A1IN_LIST, claim, frame) || claimOldest(AM_LIST, claim, frame);
+  return claimOldest(AM_LIST, claim, frame) || claimOldest(A1IN_LIST, claim, frame);
+}
+
+void TwoQReplacer::listVictims(std::size_t count, std::vector<FrameId> &frames) {
+  int first = lists[A1IN_LIST].size() > kin ? A1IN_LIST : AM_LIST;
+  std::size_t listed = frames.size();
+  listOldest(first, count, frames);
+  listed = frames.size() - listed;
+  listOldest(first == A1IN_LIST ? AM_LIST : A1IN_LIST, count - listed, frames);
+}
+
+// -----------------------------------------------------------------------------
+// ARC
+// -----------------------------------------------------------------------------
+
+ARCReplacer::ARCReplacer(std::uint32_t bufs)
+    : ListReplacer(bufs, 3), p(0) {
+}
+
+void ARCReplacer::loaded(FrameId frame) {
+  const File *file = pages[frame].first;
+  PageId pageNo = pages[frame].second;
+
+  if (b1.remove(file, pageNo)) {
+    // T1 was too small: grow its target by |B2| / |B1|, sizes before removal
+    std::size_t delta = std::max<std::size_t>(1, b2.size() / (b1.size() + 1));
+    p = std::min<std::size_t>(numBufs, p + delta);
+    moveToFront(frame, T2_LIST);
+  } else if (b2.remove(file, pageNo)) {
+    // T2 was too small: shrink the target of T1
+    std::size_t delta = std::max<std::size_t>(1, b1.size() / (b2.size() + 1));
+    p = p > delta ? p - delta : 0;
+    moveToFront(frame, T2_LIST);
+  } else {
+    moveToFront(frame, T1_LIST);
+  }
+  trimGhosts();
+}
+
+void ARCReplacer::accessed(FrameId frame) {
+  moveToFront(frame, T2_LIST);
+}
+
+void ARCReplacer::removed(FrameId frame, int from, bool evicted) {
+  if (evicted) {
+    GhostList &ghosts = from == T1_LIST ? b1 : b2;
+    ghosts.push(pages[frame].first, pages[frame].second);
+    trimGhosts();
+  }
+}
+
+void ARCReplacer::trimGhosts() {
+  std::size_t t1 = lists[T1_LIST].size();
+  std::size_t t2 = lists[T2_LIST].size();
+
+  b1.trim(t1 < numBufs ? numBufs - t1 : 0);
+  std::size_t used = t1 + t2 + b1.size();
+  b2.trim(used < 2 * numBufs ? 2 * numBufs - used : 0);
+}
+
+bool ARCReplacer::chooseVictim(const ClaimFunc &claim, FrameId &frame) {
+  if (lists[T1_LIST].size() > p)
+    return claimOldest(T1_LIST, claim, frame) || claimOldest(T2_LIST, claim, frame);
+  return claimOldest(T2_LIST, claim, frame) || claimOldest(T1_LIST, claim, frame);
+}
+
+void ARCReplacer::listVictims(std::size_t count, std::vector<FrameId> &frames) {
+  int first = lists[T1_LIST].size() > p ? T1_LIST : T2_LIST;
+  std::size_t listed = frames.size();
+  listOldest(first, count, frames);
+  listed = frames.size() - listed;
+  listOldest(first == T1_LIST ? T2_LIST : T1_LIST, count - listed, frames);
+}
+
+}
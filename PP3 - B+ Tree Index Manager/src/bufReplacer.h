@@ -0,0 +1,436 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Page replacement policies the buffer manager can be built with.
+ */
+enum ReplacementPolicy {
+  CLOCK_POLICY,
+  LRU_K_POLICY,
+  TWO_Q_POLICY,
+  ARC_POLICY
+};
+
+/**
+ * @brief Decides which frame of the buffer pool to evict next.
+ *
+ * The buffer manager reports every page it loads, every hit on a buffered
+ * page and every frame it empties; the replacer uses these to order the
+ * frames. When a free frame is needed, pickVictim offers frames in eviction
+ * order to a claim callback until one of them can be claimed, so pinned
+ * frames are skipped without the replacer having to know about pins.
+ *
+ * frameLoaded and frameAccessed are called with the page table latch of the
+ * page held; the replacer never calls back into the buffer manager apart from
+ * the claim callback, which must not block.
+ */
+class BufReplacer {
+ public:
+  /**
+   * Callback trying to claim a frame for eviction; returns true on success.
+   */
+  typedef std::function<bool(FrameId)> ClaimFunc;
+
+  /**
+   * Create a replacer for the given policy.
+   *
+   * @param policy  	Replacement policy
+   * @param numBufs 	Number of frames in the buffer pool
+   * @return  			New replacer, owned by the caller.
+   */
+  static BufReplacer *create(ReplacementPolicy policy, std::uint32_t numBufs);
+
+  virtual ~BufReplacer() {}
+
+  /**
+   * Offer frames to claim in eviction order until one is claimed.
+   *
+   * @param claim   	Callback claiming a frame
+   * @param frame   	Claimed frame, returned via this reference
+   * @return  			False if no frame could be claimed
+   */
+  virtual bool pickVictim(const ClaimFunc &claim, FrameId &frame) = 0;
+
+  /**
+   * A page was read or allocated into a frame.
+   *
+   * @param frame   	Frame holding the page
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   */
+  virtual void frameLoaded(FrameId frame, const File *file, PageId pageNo) = 0;
+
+  /**
+   * The page held by a frame was requested again.
+   *
+   * @param frame   	Frame holding the page
+   */
+  virtual void frameAccessed(FrameId frame) = 0;
+
+  /**
+   * A frame no longer holds a page.
+   *
+   * @param frame   	Frame that was emptied
+   * @param evicted 	True if the page was replaced by pickVictim, false if it
+   *                  was flushed or disposed of
+   */
+  virtual void frameFreed(FrameId frame, bool evicted) = 0;
+
+  /**
+   * List the frames pickVictim is likely to offer next, most likely first.
+   * The list is only a hint and may include frames that hold no page or are
+   * pinned.
+   *
+   * @param count   	Maximum number of frames to list
+   * @param frames  	Vector the frames are appended to
+   */
+  virtual void upcomingVictims(std::size_t count, std::vector<FrameId> &frames) = 0;
+};
+
+/**
+ * @brief Single reference bit CLOCK.
+ *
+ * Lock free: a hit only sets the frame's reference bit, and the clock hand is
+ * advanced with a compare-and-swap.
+ */
+class ClockReplacer : public BufReplacer {
+ public:
+  ClockReplacer(std::uint32_t numBufs);
+
+  bool pickVictim(const ClaimFunc &claim, FrameId &frame);
+  void frameLoaded(FrameId frame, const File *file, PageId pageNo);
+  void frameAccessed(FrameId frame);
+  void frameFreed(FrameId frame, bool evicted);
+  void upcomingVictims(std::size_t count, std::vector<FrameId> &frames);
+
+ private:
+  /**
+   * Number of frames in the buffer pool
+   */
+  std::uint32_t numBufs;
+
+  /**
+   * Current position of clockhand in our buffer pool
+   */
+  std::atomic<FrameId> clockHand;
+
+  /**
+   * Has the frame been referenced since the clock hand last passed it
+   */
+  std::unique_ptr<std::atomic<bool>[]> refbits;
+
+  /**
+   * Advance clock to next frame in the buffer pool
+   *
+   * @return The frame the clock hand now points at
+   */
+  FrameId advanceClock() {
+    FrameId hand = clockHand.load();
+    while (!clockHand.compare_exchange_weak(hand, (hand + 1) % numBufs)) {
+    }
+    return (hand + 1) % numBufs;
+  }
+};
+
+/**
+ * @brief Bounded, oldest-first set of pages that are no longer buffered,
+ * each with a value recorded when it was added.
+ */
+class GhostList {
+ public:
+  /**
+   * Add a page as the newest entry, replacing any older entry for it.
+   */
+  void push(const File *file, PageId pageNo, std::uint64_t value = 0);
+
+  /**
+   * Remove a page if present.
+   *
+   * @param value   	Value recorded for the page, returned via this reference
+   * @return  			True if the page was present
+   */
+  bool remove(const File *file, PageId pageNo, std::uint64_t &value);
+
+  bool remove(const File *file, PageId pageNo) {
+    std::uint64_t value;
+    return remove(file, pageNo, value);
+  }
+
+  /**
+   * Drop the oldest entries until at most maxSize are left.
+   */
+  void trim(std::size_t maxSize);
+
+  std::size_t size() const {
+    return order.size();
+  }
+
+ private:
+  typedef std::pair<const File *, PageId> Key;
+
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const {
+      return std::hash<const File *>()(key.first) * 31 + key.second;
+    }
+  };
+
+  /**
+   * Pages, newest first
+   */
+  std::list<Key> order;
+
+  /**
+   * Position in order and recorded value of every page
+   */
+  std::unordered_map<Key, std::pair<std::list<Key>::iterator, std::uint64_t>, KeyHash> index;
+};
+
+/**
+ * @brief Base of the policies that keep frames on recency lists.
+ *
+ * Every frame is on exactly one list: FREE_LIST for frames without a page, or
+ * one of the policy's own lists. Lists are ordered newest first, and all
+ * state is guarded by one latch.
+ */
+class ListReplacer : public BufReplacer {
+ public:
+  bool pickVictim(const ClaimFunc &claim, FrameId &frame);
+  void frameLoaded(FrameId frame, const File *file, PageId pageNo);
+  void frameAccessed(FrameId frame);
+  void frameFreed(FrameId frame, bool evicted);
+  void upcomingVictims(std::size_t count, std::vector<FrameId> &frames);
+
+ protected:
+  /**
+   * List of the frames that hold no page
+   */
+  static const int FREE_LIST = 0;
+
+  /**
+   * @param numBufs 	Number of frames in the buffer pool
+   * @param numLists	Number of lists, including FREE_LIST
+   */
+  ListReplacer(std::uint32_t numBufs, int numLists);
+
+  /**
+   * Number of frames in the buffer pool
+   */
+  std::uint32_t numBufs;
+
+  /**
+   * Lists of frames, newest first
+   */
+  std::vector<std::list<FrameId>> lists;
+
+  /**
+   * List each frame is on
+   */
+  std::vector<int> where;
+
+  /**
+   * Page held by each frame
+   */
+  std::vector<std::pair<const File *, PageId>> pages;
+
+  /**
+   * Move a frame to the front of a list.
+   */
+  void moveToFront(FrameId frame, int list);
+
+  /**
+   * Offer the frames of a list to claim, oldest first.
+   *
+   * @return  			True if a frame was claimed
+   */
+  bool claimOldest(int list, const ClaimFunc &claim, FrameId &frame);
+
+  /**
+   * Append up to count frames of a list to frames, oldest first.
+   */
+  void listOldest(int list, std::size_t count, std::vector<FrameId> &frames);
+
+  /**
+   * Put a frame that just received a page on one of the policy's lists.
+   */
+  virtual void loaded(FrameId frame) = 0;
+
+  /**
+   * Reorder a frame whose page was hit.
+   */
+  virtual void accessed(FrameId frame) = 0;
+
+  /**
+   * Called before a frame leaves list `from` for FREE_LIST.
+   */
+  virtual void removed(FrameId frame, int from, bool evicted) = 0;
+
+  /**
+   * Claim a victim among the frames holding pages.
+   */
+  virtual bool chooseVictim(const ClaimFunc &claim, FrameId &frame) = 0;
+
+  /**
+   * List the frames holding pages in the order chooseVictim offers them.
+   */
+  virtual void listVictims(std::size_t count, std::vector<FrameId> &frames) = 0;
+
+ private:
+  /**
+   * Latch guarding all replacer state
+   */
+  std::mutex latch;
+
+  /**
+   * Position of each frame in its list
+   */
+  std::vector<std::list<FrameId>::iterator> positions;
+};
+
+/**
+ * @brief LRU-K with K = 2.
+ *
+ * Evicts the page whose second most recent reference is oldest; pages
+ * referenced only once go first, in LRU order, so a sequential scan cannot
+ * push out pages that are referenced repeatedly. The last reference time of
+ * evicted pages is remembered for as many pages as there are frames.
+ */
+class LRUKReplacer : public ListReplacer {
+ public:
+  LRUKReplacer(std::uint32_t numBufs);
+
+ protected:
+  void loaded(FrameId frame);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, int from, bool evicted);
+  bool chooseVictim(const ClaimFunc &claim, FrameId &frame);
+  void listVictims(std::size_t count, std::vector<FrameId> &frames);
+
+ private:
+  static const int RESIDENT_LIST = 1;
+
+  /**
+   * (second to last reference, last reference, frame), oldest first. A
+   * second to last reference of 0 means the page was referenced once.
+   */
+  typedef std::tuple<std::uint64_t, std::uint64_t, FrameId> HistoryKey;
+
+  /**
+   * Logical time, advanced on every reference
+   */
+  std::uint64_t now;
+
+  /**
+   * Eviction order of the buffered pages
+   */
+  std::set<HistoryKey> order;
+
+  /**
+   * Key of each frame in order
+   */
+  std::vector<HistoryKey> keys;
+
+  /**
+   * Last reference time of recently evicted pages
+   */
+  GhostList history;
+};
+
+/**
+ * @brief Full 2Q.
+ *
+ * New pages enter a FIFO (A1in) holding about a quarter of the pool. Pages
+ * evicted from it are remembered in A1out; only a page referenced again while
+ * remembered there is admitted to the main LRU list (Am).
+ */
+class TwoQReplacer : public ListReplacer {
+ public:
+  TwoQReplacer(std::uint32_t numBufs);
+
+ protected:
+  void loaded(FrameId frame);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, int from, bool evicted);
+  bool chooseVictim(const ClaimFunc &claim, FrameId &frame);
+  void listVictims(std::size_t count, std::vector<FrameId> &frames);
+
+ private:
+  static const int A1IN_LIST = 1;
+  static const int AM_LIST = 2;
+
+  /**
+   * Target size of A1in
+   */
+  std::size_t kin;
+
+  /**
+   * Maximum size of A1out
+   */
+  std::size_t kout;
+
+  /**
+   * Pages recently evicted from A1in
+   */
+  GhostList a1out;
+};
+
+/**
+ * @brief Adaptive Replacement Cache.
+ *
+ * Buffered pages are split into T1 (seen once recently) and T2 (seen at least
+ * twice); B1 and B2 remember pages evicted from each. A miss that hits in B1
+ * grows the target size p of T1, one that hits in B2 shrinks it, and the
+ * victim is taken from T1 while T1 is larger than p.
+ */
+class ARCReplacer : public ListReplacer {
+ public:
+  ARCReplacer(std::uint32_t numBufs);
+
+ protected:
+  void loaded(FrameId frame);
+  void accessed(FrameId frame);
+  void removed(FrameId frame, int from, bool evicted);
+  bool chooseVictim(const ClaimFunc &claim, FrameId &frame);
+  void listVictims(std::size_t count, std::vector<FrameId> &frames);
+
+ private:
+  static const int T1_LIST = 1;
+  static const int T2_LIST = 2;
+
+  /**
+   * Target size of T1
+   */
+  std::size_t p;
+
+  /**
+   * Pages recently evicted from T1 and T2
+   */
+  GhostList b1, b2;
+
+  /**
+   * Drop ghosts so that |T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c.
+   */
+  void trimGhosts();
+};
+
+}
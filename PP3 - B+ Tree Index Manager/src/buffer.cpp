@@ -5,6 +5,8 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <iostream>
 #include "buffer.h"
@@ -20,8 +22,9 @@ namespace badgerdb {
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-    : numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, ReplacementPolicy policy)
+    : numBufs(bufs), prefetchingFile(NULL), stopPrefetcher(false),
+      bgWriterStopping(false), maxDirtySkips(std::max<std::uint32_t>(1, bufs / 8)) {
   bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) {
@@ -34,10 +37,20 @@ BufMgr::BufMgr(std::uint32_t bufs)
   int htsize = ((((int) (bufs * 1.2)) * 2) / 2) + 1;
   hashTable = new BufHashTbl(htsize);  // allocate the buffer hash table
 
-  clockHand = bufs - 1;
+  replacer = BufReplacer::create(policy, bufs);
 }
 
 BufMgr::~BufMgr() {
+  // stop the background threads before touching the frames
+  stopBgWriter();
+  {
+    std::lock_guard<std::mutex> guard(prefetchMutex);
+    stopPrefetcher = true;
+  }
+  prefetchCond.notify_all();
+  if (prefetcher.joinable())
+    prefetcher.join();
+
   //Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) {
     BufDesc *tmpbuf = &bufDescTable[i];
@@ -48,159 +61,484 @@ BufMgr::~BufMgr() {
 
   delete[] bufDescTable;
   delete[] bufPool;
+  delete hashTable;
+  delete replacer;
 }
 
 void BufMgr::allocBuf(FrameId &frame) {
-  // perform first part of clock algorithm to search for
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  // the replacer offers frames in eviction order; a frame is taken by
+  // claiming it, which fails if someone has it pinned. A few dirty frames
+  // are passed over first, the background writer may get to them.
+  std::uint32_t dirtySkips = 0;
+  std::uint32_t skipLimit = maxDirtySkips;
+  BufReplacer::ClaimFunc claim = [this, &dirtySkips, &skipLimit](FrameId frameNo) {
+    BufDesc &desc = bufDescTable[frameNo];
+    if (desc.pinCnt.load() != 0)
+      return false;
+    if (desc.dirty.load() && dirtySkips < skipLimit) {
+      dirtySkips++;
+      return false;
+    }
+    return desc.Claim();
+  };
+
+  FrameId victim;
+  while (true) {
+    if (!replacer->pickVictim(claim, victim)) {
+      // the only unpinned frames may be dirty ones we passed over
+      if (dirtySkips == 0 || skipLimit == 0) break;
+      skipLimit = 0;
+      continue;
+    }
 
-  while (numScanned < 2 * numBufs)    //Need to scn twice
-  {
-    // advance the clock
-    advanceClock();
-    numScanned++;
-
-    // if invalid, use frame
-    if (!bufDescTable[clockHand].valid) {
-      break;
-    }
-
-    // is valid, check referenced bit
-    if (!bufDescTable[clockHand].refbit) {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0) {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
-      }
-    } else {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+    if (evictFrame(victim)) {
+      replacer->frameFreed(victim, true);
+      frame = victim;
+      return;
     }
+
+    // someone started using the page while it was written back
+    bufDescTable[victim].Release();
   }
 
-  // check for full buffer pool
-  if (!found && numScanned >= 2 * numBufs) {
-    throw BufferExceededException();
+  // full buffer pool
+  throw BufferExceededException();
+} // end allocBuf
+
+bool BufMgr::evictFrame(FrameId frameNo, bool writeBack) {
+  BufDesc *desc = &bufDescTable[frameNo];
+
+  // if invalid, use frame
+  if (!desc->valid) {
+    desc->Reset();
+    return true;
   }
 
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty) {
+  // flush any existing changes to disk if necessary. The page stays in the
+  // hash table until it is written so no one rereads a stale copy from disk.
+  if (desc->dirty.exchange(false) && writeBack) {
+    try {
+      desc->file->writePage(desc->pageNo, bufPool[frameNo]);
+    } catch (...) {
+      // keep the page, still dirty, for a later write to retry
+      desc->dirty = true;
+      desc->Release();
+      throw;
+    }
     bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+  }
+
+  // remove previous entry from hash table, unless someone pinned or
+  // dirtied the page since it was claimed
+  {
+    std::lock_guard<std::mutex> guard(hashTable->latch(desc->file, desc->pageNo));
+    if (desc->pinCnt.load() != BufDesc::CLAIM_BIT || desc->dirty.load())
+      return false;
+    hashTable->remove(desc->file, desc->pageNo);
   }
 
   //Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  desc->Reset();
+  return true;
+}
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+bool BufMgr::reuseRingBuf(BufAccessStrategy &strategy, std::uint32_t &slotNo, FrameId &frame) {
+  BufAccessStrategy::RingSlot slot;
+  {
+    std::lock_guard<std::mutex> guard(strategy.latch);
+    strategy.current = (strategy.current + 1) % strategy.ring.size();
+    slotNo = strategy.current;
+    slot = strategy.ring[slotNo];
+  }
+  if (slot.file == NULL)
+    return false;
+
+  // leave the frame to the pool if it was referenced by anyone else
+  BufDesc *desc = &bufDescTable[slot.frameNo];
+  if (desc->refbit.load() || desc->pinCnt.load() != 0 || !desc->Claim())
+    return false;
+
+  // a frame left empty, e.g. after losing a race to read the same page, is
+  // still the ring's to reuse
+  bool ours;
+  {
+    std::lock_guard<std::mutex> guard(desc->latch);
+    ours = !desc->valid || (desc->file == slot.file && desc->pageNo == slot.pageNo);
+  }
+  if (!ours || desc->refbit.load() || !evictFrame(slot.frameNo)) {
+    desc->Release();
+    return false;
+  }
+
+  replacer->frameFreed(slot.frameNo, false);
+  frame = slot.frameNo;
+  return true;
+}
 
+FrameId BufMgr::installPage(File *file, PageId pageNo, FrameId frameNo,
+                            BufAccessStrategy *strategy, std::uint32_t slotNo, bool pin) {
+  FrameId existing;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+      // another thread may have read the same page in the meantime
+      if (!hashTable->lookup(file, pageNo, existing)) {
+        // set up the entry properly
+        bufDescTable[frameNo].Set(file, pageNo);
+        if (!pin) bufDescTable[frameNo].pinCnt--;
+        replacer->frameLoaded(frameNo, file, pageNo);
+
+        if (strategy != NULL) {
+          // the reference bit now tells whether anyone else hit the page
+          bufDescTable[frameNo].refbit = false;
+          strategy->setSlot(slotNo, frameNo, file, pageNo);
+        }
+
+        // insert in the hash table
+        hashTable->insert(file, pageNo, frameNo);
+        return frameNo;
+      }
+      if (!pin || pinHit(existing, strategy))
+        break;
+    }
+    // the other copy is being written back
+    std::this_thread::yield();
+  }
+  bufDescTable[frameNo].Clear();
+  return existing;
+}
 
-void BufMgr::readPage(File *file, const PageId pageNo, Page *&page) {
+void BufMgr::readPage(File *file, const PageId pageNo, Page *&page,
+                      BufAccessStrategy *strategy) {
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
+  bufStats.accesses++;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+      if (!hashTable->lookup(file, pageNo, frameNo))
+        break;
+      if (pinHit(frameNo, strategy)) {
+        page = &bufPool[frameNo];
+        return;
+      }
+    }
+    // wait until the page is written back, it may stay buffered
+    std::this_thread::yield();
+  }
+
+  //not in the buffer pool, must allocate a new page
+  // alloc a new frame, recycling the strategy's ring if it has one
+  std::uint32_t slotNo = 0;
+  if (strategy == NULL || !reuseRingBuf(*strategy, slotNo, frameNo))
+    allocBuf(frameNo);
+
+  // read the page into the new frame
   try {
-    hashTable->lookup(file, pageNo, frameNo);
+    file->readPageInto(pageNo, bufPool[frameNo]);
+  } catch (...) {
+    bufDescTable[frameNo].Clear();
+    throw;
+  }
+  bufStats.diskreads++;
+
+  page = &bufPool[installPage(file, pageNo, frameNo, strategy, slotNo, true)];
+}
+
+void BufMgr::prefetchPages(File *file, const std::vector<PageId> &pageNos,
+                           BufAccessStrategy *strategy) {
+  for (PageId pageNo : pageNos)
+    queuePrefetch(PrefetchRequest{file, pageNo, 1, NULL, strategy});
+}
+
+void BufMgr::prefetchChain(File *file, PageId pageNo, int count, NextPageFunc next,
+                           BufAccessStrategy *strategy) {
+  if (pageNo != Page::INVALID_NUMBER && count > 0)
+    queuePrefetch(PrefetchRequest{file, pageNo, count, next, strategy});
+}
+
+void BufMgr::queuePrefetch(const PrefetchRequest &request) {
+  {
+    std::lock_guard<std::mutex> guard(prefetchMutex);
+    // prefetching is only a hint; drop requests the prefetcher cannot keep up with
+    if (prefetchQueue.size() >= numBufs)
+      return;
+    prefetchQueue.push_back(request);
+    if (!prefetcher.joinable())
+      prefetcher = std::thread(&BufMgr::prefetchLoop, this);
+  }
+  prefetchCond.notify_all();
+}
+
+void BufMgr::cancelPrefetch(const File *file) {
+  std::unique_lock<std::mutex> lock(prefetchMutex);
+  for (auto it = prefetchQueue.begin(); it != prefetchQueue.end();) {
+    if (it->file == file)
+      it = prefetchQueue.erase(it);
+    else
+      ++it;
+  }
+  prefetchCond.wait(lock, [&] { return prefetchingFile != file; });
+}
+
+void BufMgr::prefetchLoop() {
+  while (true) {
+    PrefetchRequest request;
+    {
+      std::unique_lock<std::mutex> lock(prefetchMutex);
+      prefetchCond.wait(lock, [&] { return stopPrefetcher || !prefetchQueue.empty(); });
+      if (stopPrefetcher)
+        return;
+      request = prefetchQueue.front();
+      prefetchQueue.pop_front();
+      prefetchingFile = request.file;
+    }
+
+    PageId pageNo = request.pageNo;
+    for (int i = 0; i < request.count && pageNo != Page::INVALID_NUMBER; i++)
+      pageNo = prefetchPage(request, pageNo);
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+    {
+      std::lock_guard<std::mutex> guard(prefetchMutex);
+      prefetchingFile = NULL;
+    }
+    prefetchCond.notify_all();
   }
-  catch (HashNotFoundException e) //not in the buffer pool, must allocate a new page
+}
+
+PageId BufMgr::prefetchPage(const PrefetchRequest &request, PageId pageNo) {
+  File *file = request.file;
+  FrameId frameNo = 0;
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+    if (hashTable->lookup(file, pageNo, frameNo)) {
+      if (request.next == NULL || bufDescTable[frameNo].Claimed())
+        return Page::INVALID_NUMBER;
+      // keep the page pinned while its link is read
+      bufDescTable[frameNo].pinCnt++;
+    } else {
+      frameNo = numBufs;
+    }
+  }
+  if (frameNo != numBufs) {
+    PageId nextPageNo = request.next(bufPool[frameNo]);
+    bufDescTable[frameNo].pinCnt--;
+    return nextPageNo;
+  }
+
+  std::uint32_t slotNo = 0;
+  if (request.strategy == NULL || !reuseRingBuf(*request.strategy, slotNo, frameNo)) {
+    // once the ring is full, read-ahead must not take frames from the pool
+    if (request.strategy != NULL) {
+      std::lock_guard<std::mutex> guard(request.strategy->latch);
+      if (request.strategy->ring[slotNo].file != NULL)
+        return Page::INVALID_NUMBER;
+    }
+    try {
+      allocBuf(frameNo);
+    } catch (BufferExceededException &e) {
+      return Page::INVALID_NUMBER;
+    }
+  }
+
+  try {
+    file->readPageInto(pageNo, bufPool[frameNo]);
+  } catch (...) {
+    bufDescTable[frameNo].Clear();
+    return Page::INVALID_NUMBER;
+  }
+  bufStats.diskreads++;
+
+  PageId nextPageNo = request.next != NULL ? request.next(bufPool[frameNo]) : Page::INVALID_NUMBER;
+  installPage(file, pageNo, frameNo, request.strategy, slotNo, false);
+  return nextPageNo;
+}
+
+void BufMgr::startBgWriter(const BgWriterConfig &config) {
+  stopBgWriter();
+  bgWriterStopping = false;
+  bgWriter = std::thread(&BufMgr::bgWriterLoop, this, config);
+}
+
+void BufMgr::stopBgWriter() {
+  {
+    std::lock_guard<std::mutex> guard(bgWriterMutex);
+    bgWriterStopping = true;
+  }
+  bgWriterCond.notify_all();
+  if (bgWriter.joinable())
+    bgWriter.join();
+}
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+void BufMgr::bgWriterLoop(BgWriterConfig config) {
+  std::vector<FrameId> frames;
+  while (true) {
+    std::uint32_t numDirty = 0;
+    for (std::uint32_t i = 0; i < numBufs; i++)
+      if (bufDescTable[i].dirty.load()) numDirty++;
+
+    // above the high watermark, clean whatever is evicted soonest without
+    // pausing; below the low one there is nothing worth writing
+    bool busy = numDirty > config.highWatermark * numBufs;
+    if (numDirty > config.lowWatermark * numBufs) {
+      frames.clear();
+      replacer->upcomingVictims(busy ? numBufs : config.lookahead, frames);
+      std::uint32_t written = 0;
+      for (FrameId frameNo : frames) {
+        if (written >= config.maxPagesPerRound) break;
+        if (cleanFrame(frameNo)) written++;
+      }
+      // nothing could be written, so wait anyway
+      if (written == 0) busy = false;
+    }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    std::unique_lock<std::mutex> lock(bgWriterMutex);
+    if (!busy)
+      bgWriterCond.wait_for(lock, std::chrono::milliseconds(config.delayMs),
+                            [this] { return bgWriterStopping; });
+    if (bgWriterStopping)
+      return;
+  }
+}
+
+bool BufMgr::cleanFrame(FrameId frameNo) {
+  BufDesc *desc = &bufDescTable[frameNo];
+  if (!desc->dirty.load() || desc->pinCnt.load() != 0 || !desc->Claim())
+    return false;
+
+  // readers wait while the frame is claimed, so the page cannot change
+  bool written = false;
+  if (desc->valid && desc->dirty.exchange(false)) {
+    try {
+      desc->file->writePage(desc->pageNo, bufPool[frameNo]);
+      written = true;
+    } catch (...) {
+      // leave the page to be written on eviction
+      desc->dirty = true;
+    }
+  }
+  desc->Release();
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+  if (written) {
+    bufStats.diskwrites++;
+    bufStats.bgwrites++;
   }
+  return written;
 }
 
 void BufMgr::unPinPage(File *file, const PageId pageNo,
                        const bool dirty) {
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+  if (!hashTable->lookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
   // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0) {
+  if (bufDescTable[frameNo].Pins() == 0) {
     throw PageNotPinnedException(file->filename(), pageNo, frameNo);
   } else bufDescTable[frameNo].pinCnt--;
 }
 
 void BufMgr::flushFile(const File *file) {
+  cancelPrefetch(file);
+
   for (std::uint32_t i = 0; i < numBufs; i++) {
     BufDesc *tmpbuf = &(bufDescTable[i]);
-    if (tmpbuf->valid == true && tmpbuf->file == file) {
-      if (tmpbuf->pinCnt > 0)
-        throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
-
-      if (tmpbuf->dirty == true) {
-        //if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-        tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-        tmpbuf->dirty = false;
-      }
+    PageId pageNo;
+    bool valid;
+    {
+      std::lock_guard<std::mutex> guard(tmpbuf->latch);
+      if (tmpbuf->file != file) continue;
+      pageNo = tmpbuf->pageNo;
+      valid = tmpbuf->valid;
+    }
+
+    if (!valid)
+      throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, valid, tmpbuf->refbit);
 
-      hashTable->remove(file, tmpbuf->pageNo);
-      tmpbuf->Clear();
-    } else if (tmpbuf->valid == false && tmpbuf->file == file)
-      throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+    bool claimed = tmpbuf->WaitClaim(file, pageNo);
+    if (!tmpbuf->Holds(file, pageNo)) {
+      // the frame was given to another page before we claimed it
+      if (claimed) tmpbuf->Release();
+      continue;
+    }
+
+    if (!claimed)
+      throw PagePinnedException(file->filename(), pageNo, tmpbuf->frameNo);
+
+    // write the page if dirty and remove it from the hash table
+    if (!evictFrame(i)) {
+      tmpbuf->Release();
+      throw PagePinnedException(file->filename(), pageNo, tmpbuf->frameNo);
+    }
+    replacer->frameFreed(i, false);
+    tmpbuf->Clear();
   }
 }
 
 void BufMgr::disposePage(File *file, const PageId pageNo) {
+  cancelPrefetch(file);
+
   //Deallocate from file altogether
   //See if it is in the buffer pool
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
-
-  // clear the page
-  bufDescTable[frameNo].Clear();
+  bool found;
+  {
+    std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+    found = hashTable->lookup(file, pageNo, frameNo);
+  }
 
-  hashTable->remove(file, pageNo);
+  if (found) {
+    BufDesc *desc = &bufDescTable[frameNo];
+    bool claimed = desc->WaitClaim(file, pageNo);
+    if (!desc->Holds(file, pageNo)) {
+      // the page was evicted before we claimed the frame
+      if (claimed) desc->Release();
+    } else if (!claimed) {
+      throw PagePinnedException(file->filename(), pageNo, frameNo);
+    } else if (!evictFrame(frameNo, false /* writeBack */)) {
+      desc->Release();
+      throw PagePinnedException(file->filename(), pageNo, frameNo);
+    } else {
+      // clear the page
+      replacer->frameFreed(frameNo, false);
+      desc->Clear();
+    }
+  }
 
   // deallocate it in the file
+  std::lock_guard<std::mutex> io(ioMutex);
   file->deletePage(pageNo);
 }
 
 void BufMgr::allocPage(File *file, PageId &pageNo, Page *&page) {
   FrameId frameNo;
+  bufStats.accesses++;
 
   // alloc a new frame
   allocBuf(frameNo);
 
   // allocate a new page in the file
-  //std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  try {
+    std::lock_guard<std::mutex> io(ioMutex);
+    file->allocatePageInto(pageNo, bufPool[frameNo]);
+  } catch (...) {
+    bufDescTable[frameNo].Clear();
+    throw;
+  }
   page = &bufPool[frameNo];
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
 
   // insert in the hash table
+  std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
   hashTable->insert(file, pageNo, frameNo);
+  replacer->frameLoaded(frameNo, file, pageNo);
 }
 
 void BufMgr::printSelf(void) {
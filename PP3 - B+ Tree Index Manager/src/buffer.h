@@ -9,7 +9,14 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "bufReplacer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace badgerdb {
 
@@ -20,12 +27,26 @@ class BufMgr;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* The pin count, dirty and reference bits are atomics so that pinning and
+* unpinning a cached page never takes a lock on the frame. A frame is claimed
+* for a new page by raising its pin count from 0 to CLAIM_BIT with a
+* compare-and-swap; only the thread holding that claim may change which page
+* the frame holds, and it does so under the frame's latch. A page whose frame
+* is claimed is being written back, so readers wait for the claim to go away
+* before pinning it. Pins are counted below CLAIM_BIT, so a claim can be told
+* apart from ordinary pins.
 */
 class BufDesc {
 
   friend class BufMgr;
 
  private:
+  /**
+ * Pin count bit held by a thread that claimed the frame for a new page
+   */
+  static const int CLAIM_BIT = 1 << 30;
+
   /**
  * Pointer to file to which corresponding frame is assigned
    */
@@ -44,12 +65,12 @@ class BufDesc {
   /**
  * Number of times this page has been pinned
    */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
   /**
  * True if page is dirty;  false otherwise
    */
-  bool dirty;
+  std::atomic<bool> dirty;
 
   /**
  * True if page is valid
@@ -59,20 +80,109 @@ class BufDesc {
   /**
  * Has this buffer frame been reference recently
    */
-  bool refbit;
+  std::atomic<bool> refbit;
 
   /**
- * Initialize buffer frame for a new user
+ * Latch guarding file, pageNo and valid while the frame changes pages
    */
-  void Clear() {
-    pinCnt = 0;
+  std::mutex latch;
+
+  /**
+ * Initialize buffer frame for a new user, leaving the pin count alone so
+ * that a claimed frame stays claimed
+   */
+  void Reset() {
+    std::lock_guard<std::mutex> guard(latch);
     file = NULL;
     pageNo = Page::INVALID_NUMBER;
     dirty = false;
     refbit = false;
     valid = false;
+  }
+
+  /**
+ * Initialize buffer frame for a new user and release it
+   */
+  void Clear() {
+    Reset();
+    pinCnt = 0;
   };
 
+  /**
+   * Try to claim an unpinned frame by raising its pin count from 0 to
+   * CLAIM_BIT.
+   *
+   * @return True if the frame was claimed
+   */
+  bool Claim() {
+    int expected = 0;
+    return pinCnt.compare_exchange_strong(expected, CLAIM_BIT);
+  }
+
+  /**
+   * Claim the frame while it holds the given page, waiting out claims held by
+   * other threads.
+   *
+   * @param filePtr	File object
+   * @param pageNum	Page number in the file
+   * @return True if the frame was claimed, false if it is pinned or no longer
+   *         holds the page
+   */
+  bool WaitClaim(const File *filePtr, PageId pageNum) {
+    while (!Claim()) {
+      if (!Holds(filePtr, pageNum)) return false;
+      if ((pinCnt.load() & ~CLAIM_BIT) != 0) return false;
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  /**
+   * Give up a claim taken with Claim(), keeping any pins taken since.
+   */
+  void Release() {
+    pinCnt -= CLAIM_BIT;
+  }
+
+  /**
+   * Returns true if the frame currently holds the given page.
+   *
+   * @param filePtr	File object
+   * @param pageNum	Page number in the file
+   */
+  bool Holds(const File *filePtr, PageId pageNum) {
+    std::lock_guard<std::mutex> guard(latch);
+    return file == filePtr && pageNo == pageNum;
+  }
+
+  /**
+   * Add a pin unless the frame is claimed.
+   *
+   * @return True if the frame was pinned
+   */
+  bool PinUnclaimed() {
+    int pins = pinCnt.load();
+    while ((pins & CLAIM_BIT) == 0) {
+      if (pinCnt.compare_exchange_weak(pins, pins + 1))
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * Returns true if a thread holds a claim on the frame.
+   */
+  bool Claimed() const {
+    return (pinCnt.load() & CLAIM_BIT) != 0;
+  }
+
+  /**
+   * Returns the number of pins, ignoring any claim on the frame.
+   */
+  int Pins() const {
+    return pinCnt.load() & ~CLAIM_BIT;
+  }
+
   /**
    * Set values of member variables corresponding to assignment of frame to a page in the file. Called when a frame
    * in buffer pool is allocated to any page in the file through readPage() or allocPage()
@@ -81,6 +191,7 @@ class BufDesc {
    * @param pageNum	Page number in the file
    */
   void Set(File *filePtr, PageId pageNum) {
+    std::lock_guard<std::mutex> guard(latch);
     file = filePtr;
     pageNo = pageNum;
     pinCnt = 1;
@@ -115,25 +226,30 @@ class BufDesc {
 */
 struct BufStats {
   /**
- * Total number of accesses to buffer pool
+ * Total number of accesses to buffer pool (page reads and allocs)
    */
-  int accesses;
+  std::atomic<int> accesses;
 
   /**
  * Number of pages read from disk (including allocs)
    */
-  int diskreads;
+  std::atomic<int> diskreads;
 
   /**
  * Number of pages written back to disk
    */
-  int diskwrites;
+  std::atomic<int> diskwrites;
+
+  /**
+ * Number of those writes done by the background writer
+   */
+  std::atomic<int> bgwrites;
 
   /**
  * Clear all values
    */
   void clear() {
-    accesses = diskreads = diskwrites = 0;
+    accesses = diskreads = diskwrites = bgwrites = 0;
   }
 
   /**
@@ -144,16 +260,154 @@ struct BufStats {
   }
 };
 
+/**
+* @brief Settings of the buffer manager's background writer
+*/
+struct BgWriterConfig {
+  /**
+ * Pause between two rounds, in milliseconds
+   */
+  unsigned int delayMs;
+
+  /**
+ * Maximum number of pages written per round
+   */
+  std::uint32_t maxPagesPerRound;
+
+  /**
+ * Number of frames, in eviction order, kept clean ahead of the replacer
+   */
+  std::uint32_t lookahead;
+
+  /**
+ * Fraction of dirty frames below which the writer stays idle
+   */
+  double lowWatermark;
+
+  /**
+ * Fraction of dirty frames above which rounds run back to back and look at
+ * every frame
+   */
+  double highWatermark;
+
+  /**
+ * Constructor of BgWriterConfig class
+   */
+  BgWriterConfig(unsigned int delay = 10, std::uint32_t maxPages = 32,
+                 std::uint32_t ahead = 32, double low = 0.05, double high = 0.5)
+      : delayMs(delay), maxPagesPerRound(maxPages), lookahead(ahead),
+        lowWatermark(low), highWatermark(high) {
+  }
+};
+
+/**
+* @brief Ring of frames recycled by a large sequential read.
+*
+* A scan reading pages through a strategy gets at most ringSize frames of the
+* pool: once the ring is full, each new page goes into the frame the ring used
+* ringSize pages ago. A ring frame is only recycled if it is unpinned, still
+* holds the page the ring read into it and has not been hit by anyone else
+* since; otherwise a frame is taken from the pool as usual and replaces it in
+* the ring. Besides its owner, only the buffer manager's prefetcher may use a
+* strategy at the same time.
+*/
+class BufAccessStrategy {
+
+  friend class BufMgr;
+
+ public:
+  /**
+ * Default number of frames in the ring
+   */
+  static const std::uint32_t DEFAULT_RING_SIZE = 16;
+
+  /**
+ * Constructor of BufAccessStrategy class
+   *
+   * @param ringSize	Number of frames in the ring
+   */
+  BufAccessStrategy(std::uint32_t ringSize = DEFAULT_RING_SIZE)
+      : ring(ringSize), current(0) {
+  }
+
+ private:
+  /**
+ * @brief A frame of the ring and the page the ring read into it
+   */
+  struct RingSlot {
+    FrameId frameNo = 0;
+    File *file = NULL;
+    PageId pageNo = Page::INVALID_NUMBER;
+  };
+
+  /**
+ * Frames of the ring; a slot with a NULL file is unused
+   */
+  std::vector<RingSlot> ring;
+
+  /**
+ * Slot the last page was read into
+   */
+  std::uint32_t current;
+
+  /**
+ * Latch guarding the ring against the prefetcher
+   */
+  std::mutex latch;
+
+  /**
+ * Record the page read into the frame of a slot
+   */
+  void setSlot(std::uint32_t slotNo, FrameId frameNo, File *file, PageId pageNo) {
+    std::lock_guard<std::mutex> guard(latch);
+    ring[slotNo].frameNo = frameNo;
+    ring[slotNo].file = file;
+    ring[slotNo].pageNo = pageNo;
+  }
+};
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file
+*
+* readPage, unPinPage, allocPage and flushFile may be called from several
+* threads at once. The page table is striped into independently latched
+* partitions and pins and reference bits are atomic. The default CLOCK policy
+* is lock free; the other replacement policies serialize their bookkeeping on
+* a latch of their own. flushFile and disposePage must not race with other
+* threads using the same file.
+*
+* Pages can be prefetched: a background thread, started by the first
+* prefetch request, reads them into the pool unpinned so that a later
+* readPage finds them buffered.
+*
+* An optional background writer writes dirty, unpinned pages the replacer is
+* about to evict, so that allocBuf mostly finds clean victims. allocBuf itself
+* passes over a few dirty frames before it settles for one.
 */
 class BufMgr {
- private:
+ public:
   /**
- * Current position of clockhand in our buffer pool
+   * Returns the page linked after the given page, or Page::INVALID_NUMBER if
+   * it is the last one of its chain.
    */
-  FrameId clockHand;
+  typedef PageId (*NextPageFunc)(const Page &page);
 
+  /**
+ * Default number of pages sequential readers prefetch ahead
+   */
+  static const int DEFAULT_PREFETCH_DEPTH = 4;
+
+ private:
+  /**
+ * @brief A page, or chain of pages, to prefetch
+   */
+  struct PrefetchRequest {
+    File *file;
+    PageId pageNo;
+    int count;
+    NextPageFunc next;
+    BufAccessStrategy *strategy;
+  };
   /**
  * Number of frames in the buffer pool
    */
@@ -164,6 +418,11 @@ class BufMgr {
    */
   BufHashTbl *hashTable;
 
+  /**
+ * Replacement policy choosing the frames to evict
+   */
+  BufReplacer *replacer;
+
   /**
  * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
    */
@@ -175,7 +434,68 @@ class BufMgr {
   BufStats bufStats;
 
   /**
-   * Allocate a free frame.
+ * Latch held around allocatePage and deletePage, which rewrite page links and
+ * must not run concurrently. Pages are read and written without it.
+   */
+  std::mutex ioMutex;
+
+  /**
+ * Pending prefetch requests, oldest first
+   */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+  /**
+ * Latch guarding prefetchQueue, prefetchingFile and stopPrefetcher
+   */
+  std::mutex prefetchMutex;
+
+  /**
+ * Signalled when a request is queued and when the prefetcher finishes one
+   */
+  std::condition_variable prefetchCond;
+
+  /**
+ * Background thread serving prefetch requests
+   */
+  std::thread prefetcher;
+
+  /**
+ * File of the request the prefetcher is working on, NULL when idle
+   */
+  const File *prefetchingFile;
+
+  /**
+ * Set to make the prefetcher exit
+   */
+  bool stopPrefetcher;
+
+  /**
+ * Background writer thread, if started
+   */
+  std::thread bgWriter;
+
+  /**
+ * Latch guarding bgWriterStopping
+   */
+  std::mutex bgWriterMutex;
+
+  /**
+ * Signalled to stop the background writer
+   */
+  std::condition_variable bgWriterCond;
+
+  /**
+ * Set to make the background writer exit
+   */
+  bool bgWriterStopping;
+
+  /**
+ * Number of dirty frames allocBuf passes over before it takes a dirty victim
+   */
+  std::uint32_t maxDirtySkips;
+
+  /**
+   * Allocate a free frame. The frame is returned claimed, with a pin count of 1.
    *
    * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
    * @throws BufferExceededException If no such buffer is found which can be allocated
@@ -183,12 +503,93 @@ class BufMgr {
   void allocBuf(FrameId &frame);
 
   /**
- * Advance clock to next frame in the buffer pool
+   * Write back and unmap the page held by a frame claimed by the caller.
+   * Fails if another thread pinned or dirtied the page in the meantime.
+   * On success the frame is left claimed and cleared. If the write fails the
+   * page stays dirty, the claim is released and the exception is rethrown.
+   *
+   * @param frameNo	Frame claimed by the caller
+   * @param writeBack	False to drop a dirty page without writing it
+   * @return True if the frame no longer holds a page
+   */
+  bool evictFrame(FrameId frameNo, bool writeBack = true);
+
+  /**
+   * Advance the ring of a strategy and try to recycle the frame in its next
+   * slot. The frame is returned claimed, with a pin count of 1.
+   *
+   * @param strategy	Access strategy of the reader
+   * @param frame   	Frame reference, frame ID of the recycled frame returned via this variable
+   * @return True if the frame could be recycled
    */
-  void advanceClock() {
-    clockHand = (clockHand + 1) % numBufs;
+  bool reuseRingBuf(BufAccessStrategy &strategy, std::uint32_t &slotNo, FrameId &frame);
+
+  /**
+   * Add a page just read into a claimed frame to the page table. If another
+   * thread buffered the page first, the frame is released and the page that
+   * is already buffered is used instead.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   * @param frameNo	Claimed frame holding the page
+   * @param strategy	Access strategy the frame came from, or NULL
+   * @param slotNo	Ring slot of the frame if strategy is not NULL
+   * @param pin    	True to return the page pinned
+   * @return The frame holding the page
+   */
+  FrameId installPage(File *file, PageId pageNo, FrameId frameNo,
+                      BufAccessStrategy *strategy, std::uint32_t slotNo, bool pin);
+
+  /**
+   * Pin a buffered page on a hit, unless its frame is claimed for write-back.
+   * Readers using an access strategy do not mark the page as referenced.
+   * Called with the page table latch of the page held.
+   *
+   * @return False if the frame is claimed and the caller must retry
+   */
+  bool pinHit(FrameId frameNo, BufAccessStrategy *strategy) {
+    if (!bufDescTable[frameNo].PinUnclaimed())
+      return false;
+    if (strategy == NULL) {
+      // set the referenced bit
+      bufDescTable[frameNo].refbit = true;
+      replacer->frameAccessed(frameNo);
+    }
+    return true;
   }
 
+  /**
+   * Queue a prefetch request, starting the prefetcher if needed.
+   */
+  void queuePrefetch(const PrefetchRequest &request);
+
+  /**
+   * Body of the prefetcher thread.
+   */
+  void prefetchLoop();
+
+  /**
+   * Read a page into the pool unpinned if it is not buffered yet.
+   *
+   * @param request	Request the page belongs to
+   * @param pageNo  Page number in the file
+   * @return The page linked after it, or Page::INVALID_NUMBER
+   */
+  PageId prefetchPage(const PrefetchRequest &request, PageId pageNo);
+
+  /**
+   * Body of the background writer thread.
+   */
+  void bgWriterLoop(BgWriterConfig config);
+
+  /**
+   * Write a dirty page back if its frame is unpinned, leaving it buffered.
+   *
+   * @param frameNo	Frame holding the page
+   * @return True if the page was written
+   */
+  bool cleanFrame(FrameId frameNo);
+
  public:
   /**
  * Actual buffer pool from which frames are allocated
@@ -197,8 +598,11 @@ class BufMgr {
 
   /**
  * Constructor of BufMgr class
+   *
+   * @param bufs   	Number of frames in the buffer pool
+   * @param policy  Replacement policy used to pick the frames to evict
    */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, ReplacementPolicy policy = CLOCK_POLICY);
 
   /**
  * Destructor of BufMgr class
@@ -213,8 +617,56 @@ class BufMgr {
    * @param file   	File object
    * @param PageNo  Page number in the file to be read
    * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+   * @param strategy	Ring of frames to read the page into on a miss, or NULL to take a frame from the whole pool
    */
-  void readPage(File *file, const PageId PageNo, Page *&page);
+  void readPage(File *file, const PageId PageNo, Page *&page,
+                BufAccessStrategy *strategy = NULL);
+
+  /**
+   * Ask for pages to be read into the buffer pool in the background. Pages
+   * already buffered are skipped, and errors reading a page are ignored.
+   *
+   * @param file   	File object
+   * @param pageNos	Page numbers in the file
+   * @param strategy	Ring of frames to read the pages into, or NULL
+   */
+  void prefetchPages(File *file, const std::vector<PageId> &pageNos,
+                     BufAccessStrategy *strategy = NULL);
+
+  /**
+   * Ask for a chain of pages to be read into the buffer pool in the
+   * background, starting at pageNo and following the link returned by next
+   * from each page to the next.
+   *
+   * @param file   	File object
+   * @param pageNo  First page of the chain
+   * @param count  	Number of pages to prefetch
+   * @param next   	Returns the page linked after a page
+   * @param strategy	Ring of frames to read the pages into, or NULL
+   */
+  void prefetchChain(File *file, PageId pageNo, int count, NextPageFunc next,
+                     BufAccessStrategy *strategy = NULL);
+
+  /**
+   * Drop pending prefetch requests for a file and wait until the prefetcher
+   * no longer works on it. Called by flushFile and disposePage, and by an
+   * index before it changes its tree.
+   *
+   * @param file   	File object
+   */
+  void cancelPrefetch(const File *file);
+
+  /**
+   * Start the background writer, restarting it if it is running.
+   *
+   * @param config 	Rate and watermarks of the writer
+   */
+  void startBgWriter(const BgWriterConfig &config = BgWriterConfig());
+
+  /**
+   * Stop the background writer if it is running.
+   */
+  void stopBgWriter();
 
   /**
    * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -223,6 +675,7 @@ class BufMgr {
    * @param PageNo  Page number
    * @param dirty		True if the page to be unpinned needs to be marked dirty
  * @throws  PageNotPinnedException If the page is not already pinned
+ * @throws  HashNotFoundException If the page is not in the buffer pool
    */
   void unPinPage(File *file, const PageId PageNo, const bool dirty);
 
@@ -253,9 +706,19 @@ class BufMgr {
    *
    * @param file   	File object
    * @param PageNo  Page number
+ * @throws  PagePinnedException If the page is pinned in the buffer pool
    */
   void disposePage(File *file, const PageId PageNo);
 
+  /**
+ * Latch held by the buffer manager while it allocates or deletes a page.
+ * Following the page links of a file directly, e.g. with a FileIterator,
+ * while the buffer manager may be changing them must be done holding it.
+   */
+  std::mutex &fileLatch() {
+    return ioMutex;
+  }
+
   /**
  * Print member variable values.
    */
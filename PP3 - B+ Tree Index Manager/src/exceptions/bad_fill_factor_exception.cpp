@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bad_fill_factor_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+BadFillFactorException::BadFillFactorException(double fillFactor)
+    : BadgerDbException(""), fillFactor_(fillFactor) {
+  std::stringstream ss;
+  ss << "Fill factor " << fillFactor_ << " is not in (0, 1].";
+  message_.assign(ss.str());
+}
+
+}
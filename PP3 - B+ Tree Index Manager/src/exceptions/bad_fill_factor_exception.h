@@ -0,0 +1,41 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a bulk load is asked for a fill
+ *        factor outside (0, 1].
+ */
+class BadFillFactorException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a bad fill factor exception for the given fill factor.
+   *
+   * @param fillFactor  Fill factor that was rejected.
+   */
+  explicit BadFillFactorException(double fillFactor);
+
+  /**
+   * Returns the fill factor that was rejected.
+   */
+  virtual double fillFactor() const { return fillFactor_; }
+
+ protected:
+  /**
+   * Fill factor that was rejected.
+   */
+  const double fillFactor_;
+};
+
+}
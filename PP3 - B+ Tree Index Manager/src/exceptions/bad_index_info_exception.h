@@ -14,28 +14,29 @@
 namespace badgerdb {
 
 /**
- * @brief An exception that is thrown when a file operation is requested for a
- *        filename that doesn't exist.
+ * @brief An exception that is thrown when the meta page of an existing index
+ *        file does not match the index being opened.
  */
 class BadIndexInfoException : public BadgerDbException {
  public:
   /**
-   * Constructs a file not found exception for the given file.
+   * Constructs a bad index info exception with the given reason.
    *
-   * @param name  Name of file that doesn't exist.
+   * @param reason  Why the index info was rejected.
    */
   explicit BadIndexInfoException(const std::string &reason);
 
   /**
-   * Returns the name of the file that caused this exception.
+   * Returns the reason the index info was rejected.
    */
   virtual const std::string &reason() const { return reason_; }
 
  protected:
   /**
-   * Name of file that caused this exception.
+   * Reason the index info was rejected. Stored by value since the exception
+   * usually outlives the string it was constructed from.
    */
-  const std::string &reason_;
+  const std::string reason_;
 };
 
 }
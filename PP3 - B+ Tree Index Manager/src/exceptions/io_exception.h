@@ -0,0 +1,54 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when the operating system fails to read
+ *        or write a file.
+ */
+class IOException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an I/O exception for the given file.
+   *
+   * @param name      Name of file that was accessed.
+   * @param operation Operation that failed.
+   * @param error     errno value reported for the failure.
+   */
+  IOException(const std::string &name, const std::string &operation,
+              const int error);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string &filename() const { return filename_; }
+
+  /**
+   * Returns the errno value reported for the failure.
+   */
+  virtual int error() const { return error_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * errno value reported for the failure.
+   */
+  const int error_;
+};
+
+}
@@ -0,0 +1,279 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "external_sort.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace badgerdb {
+
+template <class T>
+const std::size_t ExternalSort<T>::DEFAULT_RUN_ENTRIES;
+template <class T>
+const std::size_t ExternalSort<T>::DEFAULT_FAN_IN;
+template <class T>
+const std::size_t ExternalSort<T>::ENTRIES_PER_PAGE;
+
+template <class T>
+ExternalSort<T>::ExternalSort(BufMgr *bufMgrIn, const std::string &tempNameIn,
+                           int numWriters, std::size_t runEntriesIn,
+                           std::size_t fanInIn)
+    : bufMgr(bufMgrIn),
+      tempName(tempNameIn),
+      runEntries(std::max<std::size_t>(runEntriesIn, 1)),
+      fanIn(std::max<std::size_t>(fanInIn, 2)),
+      buffers(numWriters > 0 ? numWriters : 1),
+      numEntries(0),
+      spilledRuns(0),
+      finished(false) {
+  if (File::exists(tempName))
+    File::remove(tempName);
+  file = new BlobFile(tempName, true);
+}
+
+template <class T>
+ExternalSort<T>::~ExternalSort() {
+  endMerge();
+  bufMgr->flushFile(file);
+  delete file;
+  File::remove(tempName);
+}
+
+template <class T>
+void ExternalSort<T>::add(int writer, const RIDKeyPair<T> &entry) {
+  std::vector<RIDKeyPair<T> > &buffer = buffers[writer];
+  buffer.push_back(entry);
+  if (buffer.size() >= runEntries)
+    spill(buffer);
+}
+
+template <class T>
+void ExternalSort<T>::spill(std::vector<RIDKeyPair<T> > &buffer) {
+  std::sort(buffer.begin(), buffer.end());
+
+  Run run;
+  run.size = buffer.size();
+  for (std::size_t first = 0; first < buffer.size(); first += ENTRIES_PER_PAGE) {
+    const std::size_t count = std::min(ENTRIES_PER_PAGE, buffer.size() - first);
+    PageId pageNo;
+    Page *page;
+    bufMgr->allocPage(file, pageNo, page);
+    std::memcpy(reinterpret_cast<char *>(page), &buffer[first],
+                count * sizeof(RIDKeyPair<T>));
+    bufMgr->unPinPage(file, pageNo, true);
+    run.pages.push_back(pageNo);
+  }
+  buffer.clear();
+
+  std::lock_guard<std::mutex> guard(runsLatch);
+  runs.push_back(std::move(run));
+  spilledRuns++;
+}
+
+template <class T>
+void ExternalSort<T>::finish() {
+  // sort what is left in the buffers, one thread per writer
+  std::vector<std::thread> threads;
+  for (std::size_t w = 1; w < buffers.size(); w++)
+    threads.push_back(std::thread([this, w]() {
+      std::sort(buffers[w].begin(), buffers[w].end());
+    }));
+  std::sort(buffers[0].begin(), buffers[0].end());
+  for (std::thread &thread : threads)
+    thread.join();
+
+  for (std::vector<RIDKeyPair<T> > &buffer : buffers) {
+    if (buffer.empty())
+      continue;
+    Run run;
+    run.size = buffer.size();
+    run.entries.swap(buffer);
+    runs.push_back(std::move(run));
+  }
+
+  numEntries = 0;
+  for (const Run &run : runs)
+    numEntries += run.size;
+
+  reduceRuns();
+  std::vector<const Run *> inputs;
+  for (const Run &run : runs)
+    inputs.push_back(&run);
+  startMerge(inputs);
+  finished = true;
+}
+
+template <class T>
+bool ExternalSort<T>::next(RIDKeyPair<T> &entry) {
+  return finished && mergeNext(entry);
+}
+
+template <class T>
+void ExternalSort<T>::reduceRuns() {
+  while (runs.size() > fanIn) {
+    std::vector<Run> merged;
+    for (std::size_t first = 0; first < runs.size(); first += fanIn) {
+      const std::size_t last = std::min(first + fanIn, runs.size());
+      if (last - first == 1) {
+        merged.push_back(std::move(runs[first]));
+        continue;
+      }
+
+      std::vector<const Run *> inputs;
+      for (std::size_t i = first; i < last; i++)
+        inputs.push_back(&runs[i]);
+      startMerge(inputs);
+
+      // write the merged pairs out a page at a time
+      Run output;
+      output.size = 0;
+      PageId pageNo = Page::INVALID_NUMBER;
+      Page *page = NULL;
+      std::size_t inPage = 0;
+      RIDKeyPair<T> entry;
+      while (mergeNext(entry)) {
+        if (page == NULL) {
+          bufMgr->allocPage(file, pageNo, page);
+          output.pages.push_back(pageNo);
+        }
+        std::memcpy(reinterpret_cast<char *>(page) + inPage * sizeof(entry),
+                    &entry, sizeof(entry));
+        output.size++;
+        if (++inPage == ENTRIES_PER_PAGE) {
+          bufMgr->unPinPage(file, pageNo, true);
+          page = NULL;
+          inPage = 0;
+        }
+      }
+      if (page != NULL)
+        bufMgr->unPinPage(file, pageNo, true);
+      endMerge();
+
+      merged.push_back(std::move(output));
+      spilledRuns++;
+    }
+    runs.swap(merged);
+  }
+}
+
+template <class T>
+void ExternalSort<T>::startMerge(const std::vector<const Run *> &inputs) {
+  endMerge();
+  for (const Run *run : inputs) {
+    RunReader reader;
+    reader.run = run;
+    reader.position = 0;
+    reader.pageNo = Page::INVALID_NUMBER;
+    reader.page = NULL;
+    if (run->size > 0) {
+      if (run->pages.empty()) {
+        reader.head = run->entries[0];
+      } else {
+        reader.pageNo = run->pages[0];
+        bufMgr->readPage(file, reader.pageNo, reader.page);
+        std::memcpy(&reader.head, reader.page, sizeof(reader.head));
+      }
+    }
+    readers.push_back(reader);
+  }
+
+  // play the games bottom-up: readers are the leaves k to 2k - 1 of a
+  // complete binary tree, each internal node keeps the loser and passes the
+  // winner up
+  const int k = readers.size();
+  tree.assign(std::max(k, 1), 0);
+  if (k == 0)
+    return;
+  std::vector<int> winners(2 * k);
+  for (int i = 0; i < k; i++)
+    winners[k + i] = i;
+  for (int n = k - 1; n > 0; n--) {
+    const int a = winners[2 * n];
+    const int b = winners[2 * n + 1];
+    winners[n] = before(b, a) ? b : a;
+    tree[n] = before(b, a) ? a : b;
+  }
+  tree[0] = winners[1];
+}
+
+template <class T>
+bool ExternalSort<T>::mergeNext(RIDKeyPair<T> &entry) {
+  if (readers.empty())
+    return false;
+  int winner = tree[0];
+  RunReader &reader = readers[winner];
+  if (reader.position >= reader.run->size)
+    return false;
+  entry = reader.head;
+  advance(reader);
+
+  // replay the games on the path from the winner's leaf to the root
+  const int k = readers.size();
+  for (int n = (winner + k) / 2; n > 0; n /= 2) {
+    if (before(tree[n], winner))
+      std::swap(tree[n], winner);
+  }
+  tree[0] = winner;
+  return true;
+}
+
+template <class T>
+void ExternalSort<T>::endMerge() {
+  for (RunReader &reader : readers) {
+    if (reader.page != NULL)
+      bufMgr->unPinPage(file, reader.pageNo, false);
+  }
+  readers.clear();
+  tree.clear();
+}
+
+template <class T>
+bool ExternalSort<T>::advance(RunReader &reader) {
+  const Run &run = *reader.run;
+  reader.position++;
+  if (run.pages.empty()) {
+    if (reader.position >= run.size)
+      return false;
+    reader.head = run.entries[reader.position];
+    return true;
+  }
+
+  const std::size_t slot = reader.position % ENTRIES_PER_PAGE;
+  if (reader.position >= run.size || slot == 0) {
+    bufMgr->unPinPage(file, reader.pageNo, false);
+    reader.page = NULL;
+  }
+  if (reader.position >= run.size)
+    return false;
+  if (slot == 0) {
+    reader.pageNo = run.pages[reader.position / ENTRIES_PER_PAGE];
+    bufMgr->readPage(file, reader.pageNo, reader.page);
+  }
+  std::memcpy(&reader.head,
+              reinterpret_cast<const char *>(reader.page) + slot * sizeof(reader.head),
+              sizeof(reader.head));
+  return true;
+}
+
+template <class T>
+bool ExternalSort<T>::before(int a, int b) const {
+  const RunReader &x = readers[a];
+  const RunReader &y = readers[b];
+  if (x.position >= x.run->size)
+    return false;
+  if (y.position >= y.run->size)
+    return true;
+  return x.head < y.head;
+}
+
+template class ExternalSort<int>;
+template class ExternalSort<double>;
+template class ExternalSort<StringKey>;
+
+}
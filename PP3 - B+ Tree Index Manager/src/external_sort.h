@@ -0,0 +1,239 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "btree.h"
+
+namespace badgerdb {
+
+/**
+ * @brief External merge sort of key-record pairs with keys of type T, for
+ * building an index over a relation that does not fit in memory.
+ *
+ * Pairs are added by a number of writers, each with a buffer of its own, so
+ * the workers of a ParallelScan can add them at the same time without
+ * locking. A writer whose buffer is full sorts it and spills it as a run to a
+ * BlobFile written through the buffer manager. finish() sorts the buffers
+ * left over, one thread per writer, and keeps them in memory as runs of their
+ * own. If there are more runs than the merge fan-in, groups of runs are merged
+ * into longer runs until there are few enough. The sorted pairs are then read
+ * with next(), which merges the remaining runs with a loser tree.
+ *
+ * A spilled run is a list of pages of the temporary file, each packed with
+ * ENTRIES_PER_PAGE pairs; runs written at the same time interleave their
+ * pages. The temporary file is removed when the sort is destroyed.
+ *
+ * Instantiated for the key types of BTreeIndex: int, double and StringKey.
+ */
+template <class T>
+class ExternalSort {
+ public:
+  /**
+   * Pairs a writer buffers before spilling a run.
+   */
+  static const std::size_t DEFAULT_RUN_ENTRIES = 1 << 16;
+
+  /**
+   * Runs merged at once; one page of each is pinned while merging.
+   */
+  static const std::size_t DEFAULT_FAN_IN = 16;
+
+  /**
+   * Pairs in a page of a spilled run.
+   */
+  static const std::size_t ENTRIES_PER_PAGE =
+      Page::SIZE / sizeof(RIDKeyPair<T>);
+
+  /**
+   * Creates the sort and its temporary file, replacing any file of that name.
+   *
+   * @param bufMgr      Buffer manager runs are written and read through.
+   * @param tempName    Name of the temporary file.
+   * @param numWriters  Number of writers adding pairs.
+   * @param runEntries  Pairs a writer buffers before spilling a run.
+   * @param fanIn       Runs merged at once, at least 2.
+   */
+  ExternalSort(BufMgr *bufMgr, const std::string &tempName, int numWriters,
+               std::size_t runEntries = DEFAULT_RUN_ENTRIES,
+               std::size_t fanIn = DEFAULT_FAN_IN);
+
+  /**
+   * Releases the runs and removes the temporary file.
+   */
+  ~ExternalSort();
+
+  /**
+   * Adds a pair. Different writers may call this at the same time, a single
+   * writer may not.
+   *
+   * @param writer  Number of the writer, from 0 to numWriters - 1.
+   * @param entry   Pair to add.
+   */
+  void add(int writer, const RIDKeyPair<T> &entry);
+
+  /**
+   * Ends the adding of pairs and prepares the merge. Must be called once,
+   * after every writer is done and before next().
+   */
+  void finish();
+
+  /**
+   * Returns the number of pairs added, once finish() has been called.
+   */
+  std::size_t size() const { return numEntries; }
+
+  /**
+   * Returns the number of runs spilled to the temporary file, counting the
+   * runs written by merges.
+   */
+  std::size_t numSpilledRuns() const { return spilledRuns; }
+
+  /**
+   * Sets entry to the next pair in sorted order.
+   *
+   * @return  False once every pair has been returned.
+   */
+  bool next(RIDKeyPair<T> &entry);
+
+ private:
+  /**
+   * A sorted run, either spilled to pages of the temporary file or kept in
+   * memory.
+   */
+  struct Run {
+    std::vector<PageId> pages;
+    std::vector<RIDKeyPair<T> > entries;
+    std::size_t size;
+  };
+
+  /**
+   * Position of a merge in one run. Keeps the run's current page pinned.
+   */
+  struct RunReader {
+    const Run *run;
+    std::size_t position;
+    PageId pageNo;
+    Page *page;
+    RIDKeyPair<T> head;
+  };
+
+  /**
+   * Sorts a buffer and writes it to the temporary file as a new run.
+   */
+  void spill(std::vector<RIDKeyPair<T> > &buffer);
+
+  /**
+   * Merges groups of runs into longer runs until there are at most fanIn.
+   */
+  void reduceRuns();
+
+  /**
+   * Starts merging the given runs: positions a reader at the head of each and
+   * builds the loser tree over them.
+   */
+  void startMerge(const std::vector<const Run *> &inputs);
+
+  /**
+   * Takes the smallest head of the merge into entry and advances its run.
+   * Returns false once the merge is done.
+   */
+  bool mergeNext(RIDKeyPair<T> &entry);
+
+  /**
+   * Unpins the pages still pinned by the merge and forgets its readers.
+   */
+  void endMerge();
+
+  /**
+   * Moves a reader to the next pair of its run, pinning the next page when
+   * it crosses into one. Returns false at the end of the run.
+   */
+  bool advance(RunReader &reader);
+
+  /**
+   * True if the head of reader a comes before the head of reader b. Readers
+   * at the end of their run come last.
+   */
+  bool before(int a, int b) const;
+
+  /**
+   * Buffer manager runs are written and read through.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Temporary file of the spilled runs.
+   */
+  BlobFile *file;
+
+  /**
+   * Name of the temporary file.
+   */
+  std::string tempName;
+
+  /**
+   * Pairs a writer buffers before spilling a run.
+   */
+  std::size_t runEntries;
+
+  /**
+   * Runs merged at once.
+   */
+  std::size_t fanIn;
+
+  /**
+   * Buffer of each writer.
+   */
+  std::vector<std::vector<RIDKeyPair<T> > > buffers;
+
+  /**
+   * Latch guarding runs while writers spill.
+   */
+  std::mutex runsLatch;
+
+  /**
+   * Sorted runs not merged yet.
+   */
+  std::vector<Run> runs;
+
+  /**
+   * Number of pairs added.
+   */
+  std::size_t numEntries;
+
+  /**
+   * Number of runs written to the temporary file.
+   */
+  std::size_t spilledRuns;
+
+  /**
+   * Readers of the runs of the current merge.
+   */
+  std::vector<RunReader> readers;
+
+  /**
+   * Loser tree of the current merge: tree[0] is the reader with the smallest
+   * head, tree[n] the loser of the game at internal node n.
+   */
+  std::vector<int> tree;
+
+  /**
+   * True once finish() has been called.
+   */
+  bool finished;
+};
+
+}
@@ -9,6 +9,7 @@
 #include "file.h"
 
 #include <cassert>
+#include <cstddef>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
@@ -26,6 +27,39 @@ namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+File::HeaderMap File::open_headers_;
+
+// On disk a page holds the start of its header, up to the page number, then
+// its data, then its page number and used list links.  Writing a page back
+// replaces the first two with one call and leaves the rest, which only
+// allocatePage and deletePage change, alone.
+static const std::size_t HEADER_START_SIZE =
+    offsetof(PageHeader, current_page_number);
+static const std::size_t HEADER_END_SIZE = sizeof(PageHeader) - HEADER_START_SIZE;
+
+static_assert(offsetof(PageHeader, next_page_number) ==
+                      offsetof(PageHeader, current_page_number) +
+                          sizeof(PageId) &&
+                  offsetof(PageHeader, prev_page_number) ==
+                      offsetof(PageHeader, next_page_number) + sizeof(PageId) &&
+                  sizeof(PageHeader) ==
+                      offsetof(PageHeader, prev_page_number) + sizeof(PageId),
+              "The page number and links must come last in PageHeader.");
+
+/**
+ * Fills iov with the parts of a page in their order on disk.
+ */
+static void pageParts(const PageHeader &header, const char *data,
+                      struct iovec iov[3]) {
+  char *start = reinterpret_cast<char *>(const_cast<PageHeader *>(&header));
+  iov[0].iov_base = start;
+  iov[0].iov_len = HEADER_START_SIZE;
+  iov[1].iov_base = const_cast<char *>(data);
+  iov[1].iov_len = Page::DATA_SIZE;
+  iov[2].iov_base = start + HEADER_START_SIZE;
+  iov[2].iov_len = HEADER_END_SIZE;
+}
+IOBackend File::default_backend_ = PREAD_IO;
 
 void File::remove(const std::string &filename) {
   if (!exists(filename)) {
@@ -67,7 +101,8 @@ File::File(const std::string &name, const bool create_new) : filename_(name) {
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */};
     writeHeader(header);
   }
 }
@@ -77,25 +112,28 @@ void File::openIfNeeded(const bool create_new) {
       open_counts_.end()) {  // exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
+    header_ = open_headers_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
       if (already_exists) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
+    // New files are truncated on open.
+    stream_.reset(FileIO::open(default_backend_, filename_, create_new));
+    header_.reset(new CachedHeader());
+    if (!create_new) {
+      stream_->read(&header_->header, sizeof(FileHeader), 0 /* offset */);
+    }
     open_streams_[filename_] = stream_;
+    open_headers_[filename_] = header_;
     open_counts_[filename_] = 1;
   }
 }
@@ -104,25 +142,20 @@ void File::close() {
   if (open_counts_[filename_] > 0) --open_counts_[filename_];
 
   stream_.reset();
+  header_.reset();
   assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
     open_streams_.erase(filename_);
+    open_headers_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
-FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char *>(&header), sizeof(FileHeader));
-  return header;
-}
-
 void File::writeHeader(const FileHeader &header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
-  stream_->flush();
+  stream_->write(&header, sizeof(FileHeader), 0 /* offset */);
+  std::lock_guard<std::mutex> guard(header_->latch);
+  header_->header = header;
 }
 
 PageFile PageFile::create(const std::string &filename) {
@@ -151,142 +184,179 @@ PageFile &PageFile::operator=(const PageFile &rhs) {
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePageInto(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePageInto(PageId &new_page_number, Page &new_page) {
+  FileHeader header = readHeader();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+    // only the links of the free page are needed, not its contents
+    const PageHeader free_header = readPageHeader(header.first_free_page);
+    new_page.initialize();
     new_page.set_page_number(header.first_free_page);
     new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    header.first_free_page = free_header.next_page_number;
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
+    // Free pages are reused last deleted first, so the used pages before this
+    // one are the ones there were when it was deleted, and it goes back after
+    // the page it followed then.  That keeps the list in page number order.
+    const PageId previous_page_number = free_header.prev_page_number;
+    PageId next_page_number;
+    if (previous_page_number == Page::INVALID_NUMBER) {
+      next_page_number = header.first_used_page;
       header.first_used_page = new_page.page_number();
     } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
+      next_page_number =
+          readPageHeader(previous_page_number).next_page_number;
+      setNextPage(previous_page_number, new_page.page_number());
     }
+    if (next_page_number == Page::INVALID_NUMBER) {
+      header.last_used_page = new_page.page_number();
+    } else {
+      setPreviousPage(next_page_number, new_page.page_number());
+    }
+    new_page.set_next_page_number(next_page_number);
+    new_page.set_prev_page_number(previous_page_number);
 
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   } else {
+    new_page.initialize();
     new_page.set_page_number(header.num_pages);
     new_page_number = new_page.page_number();
 
     if (header.first_used_page == Page::INVALID_NUMBER) {
       header.first_used_page = new_page.page_number();
+      header.last_used_page = new_page.page_number();
     } else {
       // If we have pages allocated, we need to add the new page to the tail
       // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+      appendToUsedList(header, new_page);
     }
     ++header.num_pages;
   }
   writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_,
-              existing_page);
-  }
   writeHeader(header);
+}
 
-  return new_page;
+void PageFile::appendToUsedList(FileHeader &header, Page &new_page) {
+  // only the link in the tail's header changes
+  setNextPage(header.last_used_page, new_page.page_number());
+
+  new_page.set_next_page_number(Page::INVALID_NUMBER);
+  new_page.set_prev_page_number(header.last_used_page);
+  header.last_used_page = new_page.page_number();
+}
+
+std::uint64_t PageFile::headerFieldPosition(const PageId page_number,
+                                            const std::size_t offset) {
+  assert(offset >= HEADER_START_SIZE);
+  return pagePosition(page_number) + Page::DATA_SIZE + offset;
+}
+
+void PageFile::setNextPage(const PageId page_number, const PageId next_page) {
+  stream_->write(&next_page, sizeof(PageId),
+                 headerFieldPosition(page_number,
+                                     offsetof(PageHeader, next_page_number)));
+}
+
+void PageFile::setPreviousPage(const PageId page_number,
+                               const PageId previous_page) {
+  stream_->write(&previous_page, sizeof(PageId),
+                 headerFieldPosition(page_number,
+                                     offsetof(PageHeader, prev_page_number)));
 }
 
 Page PageFile::readPage(const PageId page_number) const {
-  FileHeader header = readHeader();
+  Page page;
+  readPageInto(page_number, page);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page &page) const {
+  const FileHeader &header = readHeader();
 
   if (page_number >= header.num_pages) {
     throw InvalidPageException(page_number, filename_);
   }
-  return readPage(page_number, false /* allow_free */);
+  readPageInto(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char *>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char *>(&page.data_[0]), Page::DATA_SIZE);
+void PageFile::readPageInto(const PageId page_number, Page &page,
+                            const bool allow_free) const {
+  struct iovec iov[3];
+  pageParts(page.header_, &page.data_[0], iov);
+  stream_->readv(iov, 3, pagePosition(page_number));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page &new_page) {
-  PageHeader header = readPageHeader(new_page_number);
-  if (header.current_page_number == Page::INVALID_NUMBER) {
-    // Page has been deleted since it was read.
-    throw InvalidPageException(new_page_number, filename_);
-  }
-  // Page on disk may have had its next page pointer updated since it was read;
-  // we don't modify that, but we do keep all the other modifications to the
-  // page header.
-  const PageId next_page_number = header.next_page_number;
-  header = new_page.header_;
-  header.next_page_number = next_page_number;
-  writePage(new_page_number, header, new_page);
+  // The page on disk may have had its links updated since it was read, so
+  // they are not written, nor is the page number, which marks the page used
+  // or free.
+  struct iovec iov[3];
+  pageParts(new_page.header_, &new_page.data_[0], iov);
+  stream_->writev(iov, 2, pagePosition(new_page_number));
 }
 
 void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
 
-  Page existing_page = readPage(page_number);
-  Page previous_page;
+  if (page_number == Page::INVALID_NUMBER || page_number >= header.num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  // only the links of the page are needed, not its contents
+  const PageHeader existing_header = readPageHeader(page_number);
+  if (existing_header.current_page_number == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const PageId previous_page_number = existing_header.prev_page_number;
+  const PageId next_page_number = existing_header.next_page_number;
   // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  // the next page in line; otherwise update the page that points to this one.
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    setNextPage(previous_page_number, next_page_number);
+  }
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = previous_page_number;
+  } else {
+    setPreviousPage(next_page_number, previous_page_number);
   }
-  // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
+  // Clear the page and add it to the head of the free list.  It remembers the
+  // page it followed, where allocatePage puts it back.
+  Page free_page;
+  free_page.set_next_page_number(header.first_free_page);
+  free_page.set_prev_page_number(previous_page_number);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_,
-              previous_page);
-  }
-  writePage(page_number, existing_page.header_, existing_page);
+  writePage(page_number, free_page.header_, free_page);
   writeHeader(header);
 }
 
+void PageFile::readPages(const PageId first_page_number,
+                         const std::uint32_t count,
+                         std::vector<Page> &pages) const {
+  FileHeader header = readHeader();
+  if (first_page_number == Page::INVALID_NUMBER ||
+      first_page_number + count > header.num_pages) {
+    throw InvalidPageException(first_page_number + count - 1, filename_);
+  }
+
+  pages.resize(count);
+  std::vector<struct iovec> iov(3 * count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    pageParts(pages[i].header_, &pages[i].data_[0], &iov[3 * i]);
+  }
+  stream_->readv(iov.data(), iov.size(), pagePosition(first_page_number));
+}
+
 FileIterator PageFile::begin() {
   const FileHeader &header = readHeader();
   return FileIterator(this, header.first_used_page);
@@ -298,17 +368,16 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader &header,
                          const Page &new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char *>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char *>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  struct iovec iov[3];
+  pageParts(header, &new_page.data_[0], iov);
+  stream_->writev(iov, 3, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
-  PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char *>(&header), sizeof(PageHeader));
+  PageHeader header = PageHeader();
+  stream_->read(reinterpret_cast<char *>(&header) + HEADER_START_SIZE,
+                HEADER_END_SIZE,
+                headerFieldPosition(page_number, HEADER_START_SIZE));
   return header;
 }
 
@@ -338,34 +407,40 @@ BlobFile &BlobFile::operator=(const BlobFile &rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
+  allocatePageInto(new_page_number, new_page);
+  return new_page;
+}
+
+void BlobFile::allocatePageInto(PageId &new_page_number, Page &new_page) {
+  FileHeader header = readHeader();
+  new_page.initialize();
 
   new_page_number = header.num_pages;
 
   if (header.first_used_page == Page::INVALID_NUMBER) {
     header.first_used_page = header.num_pages;
   }
+  header.last_used_page = header.num_pages;
 
   ++header.num_pages;
 
   writePage(new_page_number, new_page);
   writeHeader(header);
-
-  return new_page;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char *>(&page), Page::SIZE);
+  readPageInto(page_number, page);
   return page;
 }
 
+void BlobFile::readPageInto(const PageId page_number, Page &page) const {
+  stream_->read(&page, Page::SIZE, pagePosition(page_number));
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page &new_page) {
-  stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char *>(&new_page), Page::SIZE);
-  stream_->flush();
+  stream_->write(&new_page, Page::SIZE, pagePosition(new_page_number));
 }
 
 // delePage should not be called for a blob_file, not supported
@@ -8,11 +8,13 @@
 
 #pragma once
 
-#include <fstream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "file_io.h"
 #include "page.h"
 
 namespace badgerdb {
@@ -43,6 +45,12 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file, so pages can be appended
+   * to the used list without walking it.
+   */
+  PageId last_used_page;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +60,8 @@ struct FileHeader {
   bool operator==(const FileHeader &rhs) const {
     return num_pages == rhs.num_pages && num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page;
   }
 };
 
@@ -60,16 +69,37 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a FileIO object doing I/O on an underlying file on
+ * disk.  Files contain fixed-sized pages, and they never deallocate space
+ * (though they do reuse deleted pages if possible).  If multiple File objects
+ * refer to the same underlying file, they will share the FileIO object in
+ * memory.
  * If a file that has already been opened (possibly by another query), then the
  * File class detects this (by looking in the open_streams_ map) and just
- * returns a file object with the already created stream for the file without
- * actually opening the UNIX file again.
+ * returns a file object with the already created FileIO object for the file
+ * without actually opening the UNIX file again.
+ *
+ * Files are opened with the default backend, PREAD_IO unless changed with
+ * setDefaultBackend.  Every page access names its position in the file, so
+ * with either backend pages may be read, and different pages written, from
+ * several threads at once.  This holds while a page is allocated or deleted
+ * too: that rewrites only the link fields of other pages' headers, which
+ * reads and writes of pages leave alone, and updates the cached file header
+ * under a latch of its own.
  *
- * @warning This class is not threadsafe.
+ * The file header is read from disk when a file is first opened and is then
+ * cached in memory, shared like the FileIO object; writes of the header go
+ * through to the file.  Each used page of a PageFile records the previous
+ * used page in its header as well as the next, so pages are unlinked from the
+ * used list, and linked back in when reused, without walking it.
+ *
+ * Writes are not forced to disk as they are made; sync() is the durability
+ * point.  In group commit mode (setGroupCommit) writes are also batched in
+ * memory and coalesced, see FileIO.
+ *
+ * @warning Opening and closing files is not threadsafe.  allocatePage and
+ *          deletePage must not run concurrently with each other or with a
+ *          FileIterator on the same file.
  */
 
 class File {
@@ -109,6 +139,22 @@ class File {
    */
   static bool exists(const std::string &filename);
 
+  /**
+   * Sets the backend used by files opened from now on.  Files that are
+   * already open keep their backend, and so do File objects opened later for
+   * the same underlying file.
+   *
+   * @param backend   I/O backend.
+   */
+  static void setDefaultBackend(const IOBackend backend) {
+    default_backend_ = backend;
+  }
+
+  /**
+   * Returns the backend used by files opened from now on.
+   */
+  static IOBackend defaultBackend() { return default_backend_; }
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -122,6 +168,15 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file, building it in place in the given page
+   * (e.g. a buffer frame) instead of returning a copy.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   */
+  virtual void allocatePageInto(PageId &new_page_number, Page &new_page) = 0;
+
   /**
    * Reads an existing page from the file.
    *
@@ -132,6 +187,18 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file straight into the given page (e.g. a
+   * buffer frame) instead of returning a copy.  The contents of the given
+   * page are undefined if an exception is thrown.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPageInto(const PageId page_number, Page &page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -155,6 +222,47 @@ class File {
    */
   const std::string &filename() const { return filename_; }
 
+  /**
+   * Returns the backend this file does its I/O with.
+   */
+  IOBackend backend() const { return stream_->backend(); }
+
+  /**
+   * Writes out any batched writes and forces everything written to the file
+   * so far to disk.  Concurrent calls share one fdatasync.
+   *
+   * @throws  IOException   If a write or the sync fails.
+   */
+  void sync() { stream_->sync(); }
+
+  /**
+   * Turns group commit mode on or off for the underlying file, so for all
+   * File objects using it.  In group commit mode writes are held in memory
+   * until sync() or until more than batch_size bytes are pending.
+   *
+   * @param batch_size  Pending bytes that trigger writing them out, or 0 to
+   *                    turn group commit mode off.
+   */
+  void setGroupCommit(const std::size_t batch_size = DEFAULT_GROUP_COMMIT_BYTES) {
+    stream_->setGroupCommit(batch_size);
+  }
+
+  /**
+   * Returns the I/O object of the underlying file, e.g. for its counters.
+   */
+  const FileIO &io() const { return *stream_; }
+
+  /**
+   * Default batch size of group commit mode.
+   */
+  static const std::size_t DEFAULT_GROUP_COMMIT_BYTES = 1 << 20;
+
+  /**
+   * Returns one past the highest page number of the file.  Every page
+   * numbered from 1 up to it is either used or on the free list.
+   */
+  PageId endPageNo() const { return readHeader().num_pages; }
+
   /**
    * Returns pageid of first page in the file.
    *
@@ -170,14 +278,14 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
+  static std::uint64_t pagePosition(const PageId page_number) {
     return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
   }
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing FileIO object.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -188,18 +296,21 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file in <stream_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file.
    *
    * @return  The file header.
    */
-  FileHeader readHeader() const;
+  FileHeader readHeader() const {
+    std::lock_guard<std::mutex> guard(header_->latch);
+    return header_->header;
+  }
 
   /**
    * Writes the given header to the disk as the header for this file.
@@ -208,11 +319,20 @@ class File {
    */
   void writeHeader(const FileHeader &header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  typedef std::map<std::string, std::shared_ptr<FileIO> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  /**
+   * Cached header of an open file, with the latch guarding it.
+   */
+  struct CachedHeader {
+    std::mutex latch;
+    FileHeader header;
+  };
+
+  typedef std::map<std::string, std::shared_ptr<CachedHeader> > HeaderMap;
 
   /**
-   * Streams for opened files.
+   * FileIO objects for opened files.
    */
   static StreamMap open_streams_;
 
@@ -221,15 +341,30 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Cached headers of opened files.
+   */
+  static HeaderMap open_headers_;
+
+  /**
+   * Backend for files opened from now on.
+   */
+  static IOBackend default_backend_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * I/O on underlying filesystem object.
+   */
+  std::shared_ptr<FileIO> stream_;
+
+  /**
+   * Cached header of underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<CachedHeader> header_;
 
   friend class FileIterator;
 };
@@ -300,6 +435,14 @@ class PageFile : public File {
    */
   Page allocatePage(PageId &new_page_number);
 
+  /**
+   * Allocates a new page in the file, building it in the given page.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page &new_page);
+
   /**
    * Reads an existing page from the file.
    *
@@ -311,8 +454,21 @@ class PageFile : public File {
   Page readPage(const PageId page_number) const;
 
   /**
-   * Writes a page into the file at the given page number.
-   * No bounds checking is performed.
+   * Reads an existing page from the file straight into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page &page) const;
+
+  /**
+   * Writes a page into the file at the given page number with one vectored
+   * write.  The page's number and its links in the used list are left as
+   * they are on disk; the rest of its header and its data are replaced.  No
+   * bounds checking is performed, and a page deleted since it was read stays
+   * free: what is written to it is dropped when the page is reused.
    *
    * @param page_number Number of page whose contents to replace.
    * @param new_page    Page to write.
@@ -326,6 +482,21 @@ class PageFile : public File {
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Reads a run of consecutive pages with one vectored read.  Free (unused)
+   * pages in the run are returned as well; their page_number() is
+   * Page::INVALID_NUMBER.
+   *
+   * @param first_page_number   Number of first page to read.
+   * @param count               Number of pages to read.
+   * @param pages               Vector the pages are read into, resized to
+   *                            count.
+   * @throws  InvalidPageException  If the run extends past the end of the
+   *                                file.
+   */
+  void readPages(const PageId first_page_number, const std::uint32_t count,
+                 std::vector<Page> &pages) const;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -343,19 +514,21 @@ class PageFile : public File {
 
  private:
   /**
-   * Reads a page from the file.  If <allow_free> is not set, an exception
-   * will be thrown if the page read from disk is not currently in use.
+   * Reads a page from the file into the given page.  If <allow_free> is not
+   * set, an exception will be thrown if the page read from disk is not
+   * currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; reading past the end of the file
+   * yields a free page.
    *
    * @param page_number   Number of page to read.
+   * @param page          Page to read into.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPageInto(const PageId page_number, Page &page,
+                    const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -370,14 +543,54 @@ class PageFile : public File {
                  const Page &new_page);
 
   /**
-   * Reads only the header of the given page from disk (not the record data
-   * or slot table).  No bounds checking is performed.
+   * Reads only the number and the used list links of the given page from
+   * disk, which are stored after its data; the other fields of the returned
+   * header are zero.  No bounds checking is performed.
    *
    * @param page_number   Number of page whose header is to be read.
    * @return  Header of page.
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Returns the position in the file of a field of the header of the given
+   * page that is stored after its data.
+   *
+   * @param page_number   Number of page.
+   * @param offset        Offset of the field in PageHeader, at least that of
+   *                      the page number.
+   * @return  Position of the field in file.
+   */
+  static std::uint64_t headerFieldPosition(const PageId page_number,
+                                           const std::size_t offset);
+
+  /**
+   * Links a page that is being allocated after the tail of the used list,
+   * updating the tail's header on disk.  The list must not be empty.
+   *
+   * @param header    File header, whose last used page is updated.
+   * @param new_page  Page being allocated.
+   */
+  void appendToUsedList(FileHeader &header, Page &new_page);
+
+  /**
+   * Sets the next used page in the header of the given page on disk, writing
+   * only that field.  No bounds checking is performed.
+   *
+   * @param page_number   Number of page whose link is to be written.
+   * @param next_page     Number of its next used page.
+   */
+  void setNextPage(const PageId page_number, const PageId next_page);
+
+  /**
+   * Sets the previous used page in the header of the given page on disk,
+   * writing only that field.  No bounds checking is performed.
+   *
+   * @param page_number     Number of page whose link is to be written.
+   * @param previous_page   Number of its previous used page.
+   */
+  void setPreviousPage(const PageId page_number, const PageId previous_page);
+
   friend class FileIterator;
 };
 
@@ -449,6 +662,14 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId &new_page_number);
 
+  /**
+   * Allocates a new page in the file, building it in the given page.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param new_page          Page to hold the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page &new_page);
+
   /**
    * Reads an existing page from the file.
    *
@@ -459,6 +680,14 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file straight into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   */
+  void readPageInto(const PageId page_number, Page &page) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -0,0 +1,382 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "file_io.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "exceptions/io_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Returns errno, or EIO if the failure did not set it.
+ */
+int lastError() { return errno != 0 ? errno : EIO; }
+
+/**
+ * Drops the first done bytes from a list of buffers.
+ */
+void advance(std::vector<struct iovec> &iov, std::size_t &first,
+             std::size_t done) {
+  while (done > 0 && first < iov.size()) {
+    std::size_t step = std::min(done, iov[first].iov_len);
+    iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + step;
+    iov[first].iov_len -= step;
+    done -= step;
+    if (iov[first].iov_len == 0) ++first;
+  }
+  while (first < iov.size() && iov[first].iov_len == 0) ++first;
+}
+
+}  // namespace
+
+FileIO *FileIO::open(const IOBackend backend, const std::string &name,
+                     const bool create_new) {
+  if (backend == STREAM_IO) {
+    return new StreamFileIO(name, create_new);
+  }
+  return new FdFileIO(name, create_new);
+}
+
+FileIO::FileIO(const std::string &name)
+    : filename_(name),
+      pending_bytes_(0),
+      batch_size_(0),
+      syncing_(false),
+      sync_requested_(0),
+      sync_completed_(0),
+      read_calls_(0),
+      write_calls_(0),
+      sync_calls_(0) {}
+
+void FileIO::readv(const struct iovec *iov, const int count,
+                   const std::uint64_t offset) {
+  std::uint64_t end = offset;
+  for (int i = 0; i < count; ++i) {
+    end += iov[i].iov_len;
+  }
+
+  // Copy the pending writes overlapping the range before reading the file: if
+  // they are written out meanwhile, the file holds the same bytes.
+  std::vector<std::pair<std::uint64_t, std::string> > overlays;
+  {
+    std::lock_guard<std::mutex> guard(pending_latch_);
+    if (!pending_.empty()) {
+      auto it = pending_.upper_bound(offset);
+      if (it != pending_.begin()) --it;
+      for (; it != pending_.end() && it->first < end; ++it) {
+        if (it->first + it->second.size() > offset) overlays.push_back(*it);
+      }
+    }
+  }
+
+  readFile(iov, count, offset);
+  ++read_calls_;
+
+  for (const auto &overlay : overlays) {
+    std::uint64_t overlay_end = overlay.first + overlay.second.size();
+    std::uint64_t position = offset;
+    for (int i = 0; i < count; ++i) {
+      std::uint64_t from = std::max(position, overlay.first);
+      std::uint64_t to = std::min(position + iov[i].iov_len, overlay_end);
+      if (from < to) {
+        std::memcpy(static_cast<char *>(iov[i].iov_base) + (from - position),
+                    overlay.second.data() + (from - overlay.first), to - from);
+      }
+      position += iov[i].iov_len;
+    }
+  }
+}
+
+void FileIO::writev(const struct iovec *iov, const int count,
+                    const std::uint64_t offset) {
+  std::unique_lock<std::mutex> guard(pending_latch_);
+  if (batch_size_ == 0) {
+    guard.unlock();
+    write_calls_ += writeFile(iov, count, offset);
+    return;
+  }
+
+  std::string data;
+  for (int i = 0; i < count; ++i) {
+    data.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+  }
+  std::uint64_t start = offset;
+  std::uint64_t end = offset + data.size();
+
+  // Merge with the pending writes it overlaps. Adjacent ones are left apart;
+  // they are coalesced when written out.
+  auto it = pending_.upper_bound(start);
+  if (it != pending_.begin()) {
+    auto previous = std::prev(it);
+    if (previous->first + previous->second.size() > start) it = previous;
+  }
+  auto first = it;
+  std::uint64_t merged_start = start;
+  std::uint64_t merged_end = end;
+  for (; it != pending_.end() && it->first < end; ++it) {
+    merged_start = std::min<std::uint64_t>(merged_start, it->first);
+    merged_end = std::max<std::uint64_t>(merged_end,
+                                         it->first + it->second.size());
+  }
+  if (merged_start != start || merged_end != end) {
+    std::string merged(merged_end - merged_start, '\0');
+    for (auto old = first; old != it; ++old) {
+      merged.replace(old->first - merged_start, old->second.size(),
+                     old->second);
+    }
+    merged.replace(start - merged_start, data.size(), data);
+    data.swap(merged);
+  }
+  for (auto old = first; old != it; ++old) {
+    pending_bytes_ -= old->second.size();
+  }
+  pending_.erase(first, it);
+  pending_bytes_ += data.size();
+  pending_[merged_start].swap(data);
+
+  if (pending_bytes_ > batch_size_) {
+    writePendingLocked();
+  }
+}
+
+void FileIO::writePending() {
+  std::lock_guard<std::mutex> guard(pending_latch_);
+  writePendingLocked();
+}
+
+void FileIO::writePendingLocked() {
+  // one vectored write per run of adjacent pending writes
+  std::vector<struct iovec> run;
+  std::uint64_t run_start = 0, run_end = 0;
+  for (auto &write : pending_) {
+    if (!run.empty() && write.first != run_end) {
+      write_calls_ += writeFile(run.data(), run.size(), run_start);
+      run.clear();
+    }
+    if (run.empty()) run_start = run_end = write.first;
+    struct iovec iov = {&write.second[0], write.second.size()};
+    run.push_back(iov);
+    run_end += write.second.size();
+  }
+  if (!run.empty()) {
+    write_calls_ += writeFile(run.data(), run.size(), run_start);
+  }
+  // only forget the writes once all of them made it to the file
+  pending_.clear();
+  pending_bytes_ = 0;
+}
+
+void FileIO::sync() {
+  std::unique_lock<std::mutex> lock(sync_latch_);
+  const std::uint64_t ticket = ++sync_requested_;
+  while (sync_completed_ < ticket) {
+    if (syncing_) {
+      // a sync that may have started before our writes; wait and try again
+      sync_done_.wait(lock);
+      continue;
+    }
+
+    // lead a sync covering every request made so far
+    syncing_ = true;
+    const std::uint64_t covered = sync_requested_;
+    lock.unlock();
+    try {
+      writePending();
+      syncFile();
+    } catch (...) {
+      lock.lock();
+      syncing_ = false;
+      sync_done_.notify_all();
+      throw;
+    }
+    ++sync_calls_;
+    lock.lock();
+    syncing_ = false;
+    sync_completed_ = covered;
+    sync_done_.notify_all();
+  }
+}
+
+void FileIO::setGroupCommit(const std::size_t batch_size) {
+  std::lock_guard<std::mutex> guard(pending_latch_);
+  batch_size_ = batch_size;
+  if (batch_size_ == 0) {
+    writePendingLocked();
+  }
+}
+
+// -----------------------------------------------------------------------------
+// std::fstream
+// -----------------------------------------------------------------------------
+
+StreamFileIO::StreamFileIO(const std::string &name, const bool create_new)
+    : FileIO(name) {
+  std::ios_base::openmode mode =
+      std::fstream::in | std::fstream::out | std::fstream::binary;
+  if (create_new) {
+    // New files have to be truncated on open.
+    mode = mode | std::fstream::trunc;
+  }
+  errno = 0;
+  stream_.open(name, mode);
+  if (!stream_) {
+    throw IOException(filename_, "open", lastError());
+  }
+}
+
+StreamFileIO::~StreamFileIO() {
+  try {
+    writePending();
+  } catch (...) {
+  }
+}
+
+void StreamFileIO::readFile(const struct iovec *iov, const int count,
+                            const std::uint64_t offset) {
+  std::lock_guard<std::mutex> guard(latch_);
+  stream_.seekg(offset, std::ios::beg);
+  for (int i = 0; i < count; ++i) {
+    char *buffer = static_cast<char *>(iov[i].iov_base);
+    stream_.read(buffer, iov[i].iov_len);
+    std::size_t done = stream_.gcount();
+    if (done < iov[i].iov_len) {
+      // past the end of the file
+      std::memset(buffer + done, 0, iov[i].iov_len - done);
+      stream_.clear();
+    }
+  }
+}
+
+int StreamFileIO::writeFile(const struct iovec *iov, const int count,
+                            const std::uint64_t offset) {
+  std::lock_guard<std::mutex> guard(latch_);
+  errno = 0;
+  stream_.seekp(offset, std::ios::beg);
+  for (int i = 0; i < count; ++i) {
+    stream_.write(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+  }
+  if (!stream_) {
+    stream_.clear();
+    throw IOException(filename_, "write", lastError());
+  }
+  return 1;
+}
+
+void StreamFileIO::syncFile() {
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    errno = 0;
+    stream_.flush();
+    if (!stream_) {
+      stream_.clear();
+      throw IOException(filename_, "write", lastError());
+    }
+  }
+
+  // a stream has no descriptor to sync, but syncing any descriptor of the
+  // file forces out its data
+  int fd = ::open(filename_.c_str(), O_RDONLY);
+  if (fd < 0 || ::fdatasync(fd) != 0) {
+    int error = lastError();
+    if (fd >= 0) ::close(fd);
+    throw IOException(filename_, "sync", error);
+  }
+  ::close(fd);
+}
+
+// -----------------------------------------------------------------------------
+// File descriptor
+// -----------------------------------------------------------------------------
+
+FdFileIO::FdFileIO(const std::string &name, const bool create_new)
+    : FileIO(name) {
+  int flags = O_RDWR;
+  if (create_new) {
+    flags |= O_CREAT | O_TRUNC;
+  }
+  fd_ = ::open(name.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    throw IOException(filename_, "open", lastError());
+  }
+}
+
+FdFileIO::~FdFileIO() {
+  try {
+    writePending();
+  } catch (...) {
+  }
+  ::close(fd_);
+}
+
+void FdFileIO::readFile(const struct iovec *iov, const int count,
+                        const std::uint64_t offset) {
+  // the kernel may transfer less than asked for, so keep going from where it
+  // stopped
+  std::vector<struct iovec> rest(iov, iov + count);
+  std::size_t first = 0;
+  std::uint64_t position = offset;
+  advance(rest, first, 0);
+  while (first < rest.size()) {
+    int batch = std::min<std::size_t>(rest.size() - first, IOV_MAX);
+    ssize_t done = ::preadv(fd_, &rest[first], batch, position);
+    if (done < 0) {
+      if (errno == EINTR) continue;
+      throw IOException(filename_, "read", lastError());
+    }
+    if (done == 0) {
+      // past the end of the file
+      for (; first < rest.size(); ++first) {
+        std::memset(rest[first].iov_base, 0, rest[first].iov_len);
+      }
+      break;
+    }
+    position += done;
+    advance(rest, first, done);
+  }
+}
+
+int FdFileIO::writeFile(const struct iovec *iov, const int count,
+                        const std::uint64_t offset) {
+  std::vector<struct iovec> rest(iov, iov + count);
+  std::size_t first = 0;
+  std::uint64_t position = offset;
+  int calls = 0;
+  advance(rest, first, 0);
+  while (first < rest.size()) {
+    int batch = std::min<std::size_t>(rest.size() - first, IOV_MAX);
+    ssize_t done = ::pwritev(fd_, &rest[first], batch, position);
+    ++calls;
+    if (done < 0) {
+      if (errno == EINTR) continue;
+      throw IOException(filename_, "write", lastError());
+    }
+    position += done;
+    advance(rest, first, done);
+  }
+  return calls;
+}
+
+void FdFileIO::syncFile() {
+  if (::fdatasync(fd_) != 0) {
+    throw IOException(filename_, "sync", lastError());
+  }
+}
+
+}  // namespace badgerdb
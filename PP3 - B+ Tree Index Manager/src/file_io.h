@@ -0,0 +1,305 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace badgerdb {
+
+/**
+ * @brief Ways of doing I/O on the filesystem file behind a File.
+ */
+enum IOBackend {
+  /**
+   * A std::fstream; every access seeks the shared stream position.
+   */
+  STREAM_IO,
+
+  /**
+   * A raw file descriptor accessed with pread/pwrite and preadv/pwritev.
+   */
+  PREAD_IO
+};
+
+/**
+ * @brief Positional reads and writes on an open filesystem file.
+ *
+ * Every call names the offset it accesses, so calls on the same object may be
+ * made from several threads at once. Reads past the end of the file fill the
+ * rest of the buffer with zeros.
+ *
+ * Writes are handed to the operating system without forcing them to disk;
+ * sync() is the only durability point. Concurrent sync() calls are grouped:
+ * a caller arriving while a sync is in progress waits for it to finish and
+ * then shares a single sync with all other callers that arrived meanwhile.
+ *
+ * In group commit mode, writes are also held in memory until sync() or until
+ * more than the batch size is pending, and are then written in file order,
+ * with writes to adjacent bytes coalesced into one vectored write. Reads see
+ * pending writes.
+ */
+class FileIO {
+ public:
+  /**
+   * Opens a filesystem file.
+   *
+   * @param backend     Backend to access the file with.
+   * @param name        Name of file.
+   * @param create_new  Whether to create (and truncate) the file.
+   * @return  New FileIO object, owned by the caller.
+   * @throws  IOException   If the file cannot be opened.
+   */
+  static FileIO *open(const IOBackend backend, const std::string &name,
+                      const bool create_new);
+
+  virtual ~FileIO() {}
+
+  /**
+   * Returns the backend this object uses.
+   */
+  virtual IOBackend backend() const = 0;
+
+  /**
+   * Reads size bytes at the given offset.
+   *
+   * @throws  IOException   If the read fails.
+   */
+  void read(void *buffer, const std::size_t size, const std::uint64_t offset) {
+    struct iovec iov = {buffer, size};
+    readv(&iov, 1, offset);
+  }
+
+  /**
+   * Writes size bytes at the given offset.
+   *
+   * @throws  IOException   If the write fails.
+   */
+  void write(const void *buffer, const std::size_t size,
+             const std::uint64_t offset) {
+    struct iovec iov = {const_cast<void *>(buffer), size};
+    writev(&iov, 1, offset);
+  }
+
+  /**
+   * Reads consecutive bytes starting at the given offset into several
+   * buffers, in one system call where the backend allows it.
+   *
+   * @param iov     Buffers to fill, in file order.
+   * @param count   Number of buffers.
+   * @param offset  Offset of the first byte.
+   * @throws  IOException   If the read fails.
+   */
+  void readv(const struct iovec *iov, const int count,
+             const std::uint64_t offset);
+
+  /**
+   * Writes several buffers to consecutive bytes starting at the given offset,
+   * in one system call where the backend allows it.
+   *
+   * @param iov     Buffers to write, in file order.
+   * @param count   Number of buffers.
+   * @param offset  Offset of the first byte.
+   * @throws  IOException   If the write fails.
+   */
+  void writev(const struct iovec *iov, const int count,
+              const std::uint64_t offset);
+
+  /**
+   * Writes out pending writes and forces all data written so far to disk.
+   *
+   * @throws  IOException   If a write or the sync fails.
+   */
+  void sync();
+
+  /**
+   * Turns group commit mode on or off. Turning it off writes out pending
+   * writes.
+   *
+   * @param batch_size  Bytes of pending writes that trigger writing them out,
+   *                    or 0 to turn group commit mode off.
+   */
+  void setGroupCommit(const std::size_t batch_size);
+
+  /**
+   * Returns the number of reads made so far.
+   */
+  std::uint64_t readCalls() const { return read_calls_; }
+
+  /**
+   * Returns the number of write system calls made so far.
+   */
+  std::uint64_t writeCalls() const { return write_calls_; }
+
+  /**
+   * Returns the number of syncs made so far.
+   */
+  std::uint64_t syncCalls() const { return sync_calls_; }
+
+ protected:
+  /**
+   * @param name  Name of the file, used in error messages.
+   */
+  explicit FileIO(const std::string &name);
+
+  /**
+   * Reads from the file itself, ignoring pending writes.
+   */
+  virtual void readFile(const struct iovec *iov, const int count,
+                        const std::uint64_t offset) = 0;
+
+  /**
+   * Writes to the file itself, returning the number of system calls made.
+   */
+  virtual int writeFile(const struct iovec *iov, const int count,
+                        const std::uint64_t offset) = 0;
+
+  /**
+   * Forces the data written to the file to disk.
+   */
+  virtual void syncFile() = 0;
+
+  /**
+   * Writes out all pending writes. Derived classes call this from their
+   * destructors, while the file is still open.
+   */
+  void writePending();
+
+  /**
+   * Name of the file.
+   */
+  std::string filename_;
+
+ private:
+  /**
+   * Writes out all pending writes. Called with pending_latch_ held.
+   */
+  void writePendingLocked();
+
+  /**
+   * Latch guarding pending_, pending_bytes_ and batch_size_.
+   */
+  std::mutex pending_latch_;
+
+  /**
+   * Pending writes by offset; no two of them overlap.
+   */
+  std::map<std::uint64_t, std::string> pending_;
+
+  /**
+   * Number of bytes in pending_.
+   */
+  std::size_t pending_bytes_;
+
+  /**
+   * Pending bytes that trigger writing them out, 0 if not in group commit
+   * mode.
+   */
+  std::size_t batch_size_;
+
+  /**
+   * True while a thread is syncing.
+   */
+  bool syncing_;
+
+  /**
+   * Number of sync requests so far.
+   */
+  std::uint64_t sync_requested_;
+
+  /**
+   * Number of sync requests satisfied by completed syncs.
+   */
+  std::uint64_t sync_completed_;
+
+  /**
+   * Latch guarding syncing_, sync_requested_ and sync_completed_.
+   */
+  std::mutex sync_latch_;
+
+  /**
+   * Signalled when a sync completes.
+   */
+  std::condition_variable sync_done_;
+
+  /**
+   * Counters of reads, write system calls and syncs.
+   */
+  std::atomic<std::uint64_t> read_calls_, write_calls_, sync_calls_;
+};
+
+/**
+ * @brief FileIO on a std::fstream.
+ *
+ * The stream position is shared by all accesses, so each seek and the read or
+ * write following it are done under a latch. Writes stay in the stream's
+ * buffer until it fills up or the file is synced.
+ */
+class StreamFileIO : public FileIO {
+ public:
+  StreamFileIO(const std::string &name, const bool create_new);
+  ~StreamFileIO();
+
+  IOBackend backend() const { return STREAM_IO; }
+
+ protected:
+  void readFile(const struct iovec *iov, const int count,
+                const std::uint64_t offset);
+  int writeFile(const struct iovec *iov, const int count,
+                const std::uint64_t offset);
+  void syncFile();
+
+ private:
+  /**
+   * Latch serializing use of the stream.
+   */
+  std::mutex latch_;
+
+  /**
+   * Stream for the file.
+   */
+  std::fstream stream_;
+};
+
+/**
+ * @brief FileIO on a raw file descriptor.
+ *
+ * Uses pread/pwrite and preadv/pwritev, which take the offset as an argument
+ * and leave the descriptor's file position alone, so no locking is needed.
+ * sync() uses fdatasync.
+ */
+class FdFileIO : public FileIO {
+ public:
+  FdFileIO(const std::string &name, const bool create_new);
+  ~FdFileIO();
+
+  IOBackend backend() const { return PREAD_IO; }
+
+ protected:
+  void readFile(const struct iovec *iov, const int count,
+                const std::uint64_t offset);
+  int writeFile(const struct iovec *iov, const int count,
+                const std::uint64_t offset);
+  void syncFile();
+
+ private:
+  /**
+   * File descriptor of the file.
+   */
+  int fd_;
+};
+
+}  // namespace badgerdb
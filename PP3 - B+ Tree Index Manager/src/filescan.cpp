@@ -6,98 +6,164 @@
  */
 
 #include "filescan.h"
+#include <algorithm>
+#include <cstring>
 #include "exceptions/end_of_file_exception.h"
 
 namespace badgerdb {
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr) {
+/**
+ * Returns the page following the given one in its file.
+ */
+static PageId nextPageInFile(const Page &page) {
+  return page.next_page_number();
+}
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr,
+                   BufAccessStrategy *accessStrategy) {
   file = new PageFile(name, false);    //dont create new file
   bufMgr = bufferMgr;
+  strategy = accessStrategy;
   curDirtyFlag = false;
   curPage = NULL;
+  prefetchDepth = BufMgr::DEFAULT_PREFETCH_DEPTH;
+  projectionWidth = 0;
+  pageSelected = false;
+
+  // other scans may be allocating or deleting pages of the same file
+  std::lock_guard<std::mutex> io(bufMgr->fileLatch());
   filePageIter = file->begin();
 }
 
 FileScan::~FileScan() {
   // generally must unpin last page of the scan
   if (curPage != NULL) {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.page_number(), curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
-    filePageIter = file->begin();
   }
   bufMgr->flushFile(file);
   delete file;
 }
 
-void FileScan::scanNext(RecordId &outRid) {
-  std::string rec;
+void FileScan::readCurPage() {
+  bufMgr->readPage(file, filePageIter.page_number(), curPage, strategy);
 
-  if (filePageIter == file->end()) {
+  // the links in buffered page headers may be stale if the file grew since
+  // the pages were read, which is good enough to prefetch
+  if (prefetchDepth > 0)
+    bufMgr->prefetchChain(file, curPage->next_page_number(), prefetchDepth,
+                          nextPageInFile, strategy);
+
+  pageSelected = !predicate.empty() &&
+                 predicate.selectSlots(*curPage, pageSelection);
+
+  // get the first record off the page
+  pageRecordIter = curPage->begin();
+}
+
+void FileScan::scanNext(RecordId &outRid) {
+  if (!nextRecord()) {
     throw EndOfFileException();
   }
 
-  // special case of the first record of the first page of the file
-  if (curPage == NULL) {
-    // need to get the first page of the file
-    filePageIter = file->begin();
-    if (filePageIter == file->end()) {
-      throw EndOfFileException();
+  // curRec points at a valid record
+  // return rid of the record
+  outRid = pageRecordIter.getCurrentRecord();
+  return;
+}
+
+std::size_t FileScan::scanNextBatch(ScanRecord *batch, std::size_t maxRecords) {
+  if (maxRecords == 0 || !nextRecord())
+    return 0;
+
+  // take records off the current page only, so all views stay valid
+  std::size_t count = 0;
+  while (true) {
+    batch[count].rid = pageRecordIter.getCurrentRecord();
+    batch[count].record = pageRecordIter.view();
+    if (++count == maxRecords)
+      break;
+    PageIterator next = pageRecordIter;
+    while (++next != curPage->end() && !qualifies(next)) {
     }
+    if (next == curPage->end())
+      break;
+    pageRecordIter = next;
+  }
+  return count;
+}
 
-    // read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
-    curDirtyFlag = false;
+void FileScan::setProjection(const std::vector<ScanField> &fields) {
+  projection = fields;
+  projectionWidth = 0;
+  for (const ScanField &field : projection)
+    projectionWidth += field.width;
+}
 
-    // get the first record off the page
-    pageRecordIter = curPage->begin();
+std::size_t FileScan::scanNextProjected(char *out, RecordId *rids,
+                                        std::size_t maxRecords) {
+  std::size_t count = 0;
+  while (count < maxRecords && nextRecord()) {
+    RecordView record = pageRecordIter.view();
+    if (rids != NULL)
+      rids[count] = pageRecordIter.getCurrentRecord();
+    for (const ScanField &field : projection) {
+      std::size_t available = 0;
+      if (field.offset < record.size())
+        available = std::min(field.width, record.size() - field.offset);
+      std::memcpy(out, record.data() + field.offset, available);
+      std::memset(out + available, 0, field.width - available);
+      out += field.width;
+    }
+    count++;
+  }
+  return count;
+}
 
-    if (pageRecordIter != curPage->end()) {
-      // get pointer to record
-      rec = *pageRecordIter;
+bool FileScan::nextRecord() {
+  if (filePageIter == file->end()) {
+    return false;
+  }
 
-      outRid = pageRecordIter.getCurrentRecord();
-      return;
-    }
+  if (curPage == NULL) {
+    // read the first page of the file
+    readCurPage();
+    curDirtyFlag = false;
+  } else {
+    // First try and get the next record off the current page
+    pageRecordIter++;
   }
 
-  // Loop, looking for a record that satisfied the predicate.
-  // First try and get the next record off the current page
-  pageRecordIter++;
+  while (true) {
+    // skip the records failing the predicate
+    while (pageRecordIter != curPage->end() && !qualifies(pageRecordIter))
+      pageRecordIter++;
+    if (pageRecordIter != curPage->end())
+      return true;
 
-  while (pageRecordIter == curPage->end()) {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.page_number(), curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
 
-    filePageIter++;
+    {
+      std::lock_guard<std::mutex> io(bufMgr->fileLatch());
+      filePageIter++;
+    }
     if (filePageIter == file->end()) {
-      curPage = NULL;
-      throw EndOfFileException();
+      return false;
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
-
-    // get the first record off the page
-    pageRecordIter = curPage->begin();
+    readCurPage();
   }
-
-  // curRec points at a valid record
-  // see if the record satisfies the scan's predicate
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
-  // return rid of the record
-  outRid = pageRecordIter.getCurrentRecord();
-  return;
 }
 
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page
-std::string FileScan::getRecord() {
-  return *pageRecordIter;
+RecordView FileScan::getRecord() {
+  return pageRecordIter.view();
 }
 
 // mark current page of scan dirty
@@ -14,28 +14,111 @@
 #include "buffer.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
+#include "page_filter.h"
+#include "scan_predicate.h"
 
 namespace badgerdb {
 
+/**
+ * @brief A record returned by FileScan::scanNextBatch.
+ */
+struct ScanRecord {
+  /**
+   * ID of the record.
+   */
+  RecordId rid;
+
+  /**
+   * Bytes of the record in the pinned page of the scan.
+   */
+  RecordView record;
+};
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
  */
 class FileScan {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Open a scan of the relation. A scan given a BufAccessStrategy recycles the
+   * strategy's ring of frames instead of filling the whole buffer pool.
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr,
+           BufAccessStrategy *strategy = NULL);
 
   ~FileScan();
 
+  /**
+   * Batch size that takes a page of all but the smallest records at once.
+   */
+  static const std::size_t DEFAULT_BATCH_SIZE = 256;
+
   //return RecordId of next record that satisfies the scan
   void scanNext(RecordId &outRid);
 
-  //read current record, returning pointer and length
-  std::string getRecord();
+  /**
+   * Fills batch with up to maxRecords of the next records of the scan, all
+   * from the same page, and returns how many; 0 once the scan has reached the
+   * end of the file. Never throws EndOfFileException. The views stay valid
+   * until the next call that advances the scan, and getRecord() and
+   * markDirty() apply to the last record of the batch.
+   */
+  std::size_t scanNextBatch(ScanRecord *batch, std::size_t maxRecords);
+
+  /**
+   * Restrict the scan to records satisfying the predicate. It is evaluated on
+   * the records in the pinned page; scanNext, scanNextBatch and
+   * scanNextProjected skip the other records without copying them. Predicates
+   * on int and double fields are evaluated for a whole page as it is read
+   * with ScanPredicate::selectSlots.
+   */
+  void setPredicate(const ScanPredicate &scanPredicate) {
+    predicate = scanPredicate;
+    pageSelected = false;
+  }
+
+  /**
+   * Set the fields scanNextProjected copies out of each record, in order.
+   */
+  void setProjection(const std::vector<ScanField> &fields);
+
+  /**
+   * Bytes of one projected row: the sum of the widths of the projection.
+   */
+  std::size_t projectedWidth() const {
+    return projectionWidth;
+  }
+
+  /**
+   * Copies the projected fields of up to maxRecords of the next records of
+   * the scan into out, one row of projectedWidth() bytes after another, and
+   * returns how many; 0 at the end of the file. Unlike scanNextBatch the rows
+   * may come from several pages. Fields reaching past the end of a record are
+   * padded with zeros. Never throws EndOfFileException.
+   *
+   * @param out         Buffer of maxRecords * projectedWidth() bytes.
+   * @param rids        Array for the ids of the records, or NULL.
+   * @param maxRecords  Largest number of rows to return.
+   */
+  std::size_t scanNextProjected(char *out, RecordId *rids,
+                                std::size_t maxRecords);
+
+  //read current record, returning pointer and length. The view points into
+  //the pinned page of the scan and is valid until the next scanNext
+  RecordView getRecord();
 
   //marks current page of scan dirty
   void markDirty();
 
+  /**
+   * Set how many pages ahead of the current one are prefetched; 0 turns
+   * prefetching off. Defaults to BufMgr::DEFAULT_PREFETCH_DEPTH.
+   */
+  void setPrefetchDepth(int depth) {
+    prefetchDepth = depth;
+  }
+
  private:
   /**
    * File which is being scanned.
@@ -47,6 +130,11 @@ class FileScan {
    */
   BufMgr *bufMgr;
 
+  /**
+   * Access strategy pages are read with, or NULL for normal replacement.
+   */
+  BufAccessStrategy *strategy;
+
   /**
    * Current page being scanned.
    */
@@ -55,10 +143,68 @@ class FileScan {
   FileIterator filePageIter;
   PageIterator pageRecordIter;
 
+  /**
+   * Number of pages to prefetch ahead of the current one
+   */
+  int prefetchDepth;
+
+  /**
+   * Read the page of filePageIter into curPage and prefetch the pages after
+   * it.
+   */
+  void readCurPage();
+
+  /**
+   * Move pageRecordIter to the next record of the scan, moving on to later
+   * pages as needed. Returns false at the end of the file.
+   */
+  bool nextRecord();
+
   /**
    * True if page has been updated
    */
   bool curDirtyFlag;
+
+  /**
+   * Condition records must satisfy to be returned.
+   */
+  ScanPredicate predicate;
+
+  /**
+   * Fields copied out by scanNextProjected.
+   */
+  std::vector<ScanField> projection;
+
+  /**
+   * Sum of the widths of the projection.
+   */
+  std::size_t projectionWidth;
+
+  /**
+   * Records of curPage satisfying the predicate, one bit per slot, when
+   * pageSelected.
+   */
+  std::vector<std::uint64_t> pageSelection;
+
+  /**
+   * True if the predicate was evaluated on all of curPage at once into
+   * pageSelection when the page was read.
+   */
+  bool pageSelected;
+
+  /**
+   * True if the record of the given iterator on curPage satisfies the
+   * predicate.
+   */
+  bool qualifies(const PageIterator &iter) const {
+    if (predicate.empty())
+      return true;
+    if (pageSelected)
+      return PageFilter::isSelected(pageSelection.data(),
+                                    iter.getCurrentRecord().slot_number);
+    RecordView record = iter.view();
+    return predicate.matches(record.data(), record.size());
+  }
 };
 
 }
@@ -0,0 +1,251 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "heap_file.h"
+
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include "file_iterator.h"
+#include "page_iterator.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+const std::uint32_t HeapFile::FSM_UNIT;
+const char HeapFile::FSM_SUFFIX[] = ".fsm";
+
+HeapFile::HeapFile(const std::string &relationName, BufMgr *bufMgrIn)
+    : bufMgr(bufMgrIn), numMapPages(0) {
+  std::fill(candidates, candidates + NUM_UNITS, Page::INVALID_NUMBER);
+  std::memset(nonEmpty, 0, sizeof(nonEmpty));
+
+  const std::string mapName = relationName + FSM_SUFFIX;
+  const bool relationExists = File::exists(relationName);
+  file = new PageFile(relationName, !relationExists);
+
+  if (relationExists && File::exists(mapName)) {
+    mapFile = new BlobFile(mapName, false);
+    loadMap();
+    return;
+  }
+
+  // a map without its relation belongs to an earlier relation of that name
+  if (File::exists(mapName))
+    File::remove(mapName);
+  mapFile = new BlobFile(mapName, true);
+
+  PageId metaPageNo;
+  Page *metaPage;
+  bufMgr->allocPage(mapFile, metaPageNo, metaPage);
+  assert(metaPageNo == 1);
+  std::memset(reinterpret_cast<char *>(metaPage), 0, Page::SIZE);
+  bufMgr->unPinPage(mapFile, metaPageNo, true);
+
+  if (relationExists)
+    buildMap();
+}
+
+HeapFile::~HeapFile() {
+  bufMgr->flushFile(file);
+  bufMgr->flushFile(mapFile);
+  delete mapFile;
+  delete file;
+}
+
+void HeapFile::loadMap() {
+  Page *page;
+  bufMgr->readPage(mapFile, 1, page);
+  numMapPages = reinterpret_cast<FreeSpaceMapMetaInfo *>(page)->numMapPages;
+  bufMgr->unPinPage(mapFile, 1, false);
+
+  freeUnits.assign(numMapPages * PAGES_PER_MAP_PAGE, 0);
+  nextCandidate.assign(freeUnits.size(), Page::INVALID_NUMBER);
+  prevCandidate.assign(freeUnits.size(), Page::INVALID_NUMBER);
+  for (PageId i = 0; i < numMapPages; i++) {
+    bufMgr->readPage(mapFile, i + 2, page);
+    const std::uint8_t *units = reinterpret_cast<const std::uint8_t *>(page);
+    for (std::uint32_t j = 0; j < PAGES_PER_MAP_PAGE; j++) {
+      PageId pageNo = i * PAGES_PER_MAP_PAGE + j;
+      freeUnits[pageNo] = units[j];
+      if (units[j] > 0)
+        linkCandidate(pageNo, units[j]);
+    }
+    bufMgr->unPinPage(mapFile, i + 2, false);
+  }
+}
+
+void HeapFile::buildMap() {
+  FileIterator iter;
+  {
+    std::lock_guard<std::mutex> io(bufMgr->fileLatch());
+    iter = file->begin();
+  }
+  while (iter != file->end()) {
+    PageId pageNo = iter.page_number();
+    Page *page;
+    bufMgr->readPage(file, pageNo, page);
+    std::uint8_t units = unitsOf(page->getFreeSpace());
+    bufMgr->unPinPage(file, pageNo, false);
+    setFreeUnits(pageNo, units);
+
+    std::lock_guard<std::mutex> io(bufMgr->fileLatch());
+    iter++;
+  }
+}
+
+void HeapFile::setFreeUnits(PageId pageNo, std::uint8_t units) {
+  if (pageNo >= freeUnits.size()) {
+    freeUnits.resize(pageNo + 1, 0);
+    nextCandidate.resize(pageNo + 1, Page::INVALID_NUMBER);
+    prevCandidate.resize(pageNo + 1, Page::INVALID_NUMBER);
+  }
+  if (freeUnits[pageNo] == units)
+    return;
+  if (freeUnits[pageNo] > 0)
+    unlinkCandidate(pageNo, freeUnits[pageNo]);
+  freeUnits[pageNo] = units;
+  if (units > 0)
+    linkCandidate(pageNo, units);
+
+  Page *page;
+  const PageId mapIndex = pageNo / PAGES_PER_MAP_PAGE;
+  while (numMapPages <= mapIndex) {
+    PageId mapPageNo;
+    bufMgr->allocPage(mapFile, mapPageNo, page);
+    assert(mapPageNo == numMapPages + 2);
+    std::memset(reinterpret_cast<char *>(page), 0, Page::SIZE);
+    bufMgr->unPinPage(mapFile, mapPageNo, true);
+    numMapPages++;
+
+    bufMgr->readPage(mapFile, 1, page);
+    reinterpret_cast<FreeSpaceMapMetaInfo *>(page)->numMapPages = numMapPages;
+    bufMgr->unPinPage(mapFile, 1, true);
+  }
+
+  bufMgr->readPage(mapFile, mapIndex + 2, page);
+  reinterpret_cast<std::uint8_t *>(page)[pageNo % PAGES_PER_MAP_PAGE] = units;
+  bufMgr->unPinPage(mapFile, mapIndex + 2, true);
+}
+
+void HeapFile::linkCandidate(PageId pageNo, std::uint8_t units) {
+  const PageId first = candidates[units];
+  nextCandidate[pageNo] = first;
+  prevCandidate[pageNo] = Page::INVALID_NUMBER;
+  if (first != Page::INVALID_NUMBER)
+    prevCandidate[first] = pageNo;
+  candidates[units] = pageNo;
+  nonEmpty[units / 64] |= 1ULL << (units % 64);
+}
+
+void HeapFile::unlinkCandidate(PageId pageNo, std::uint8_t units) {
+  const PageId next = nextCandidate[pageNo];
+  const PageId prev = prevCandidate[pageNo];
+  if (prev != Page::INVALID_NUMBER)
+    nextCandidate[prev] = next;
+  else
+    candidates[units] = next;
+  if (next != Page::INVALID_NUMBER)
+    prevCandidate[next] = prev;
+  if (candidates[units] == Page::INVALID_NUMBER)
+    nonEmpty[units / 64] &= ~(1ULL << (units % 64));
+}
+
+bool HeapFile::findCandidate(std::uint32_t units, PageId &pageNo) {
+  // the fullest pages with enough room come first, keeping emptier pages for
+  // larger records
+  for (std::uint32_t word = units / 64; word < NUM_UNITS / 64; word++) {
+    std::uint64_t bits = nonEmpty[word];
+    if (word == units / 64)
+      bits &= ~0ULL << (units % 64);
+    if (bits != 0) {
+      pageNo = candidates[word * 64 + __builtin_ctzll(bits)];
+      return true;
+    }
+  }
+  return false;
+}
+
+RecordId HeapFile::insertRecord(const std::string &record) {
+  // room for the record and a new slot, in whole units
+  const std::uint32_t needed =
+      (record.length() + sizeof(PageSlot) + FSM_UNIT - 1) / FSM_UNIT;
+
+  PageId pageNo;
+  Page *page;
+  while (findCandidate(needed, pageNo)) {
+    try {
+      bufMgr->readPage(file, pageNo, page);
+    } catch (const InvalidPageException &) {
+      // the page was deleted behind the map's back
+      setFreeUnits(pageNo, 0);
+      continue;
+    }
+    if (page->hasSpaceForRecord(record)) {
+      RecordId rid = page->insertRecord(record);
+      std::uint8_t units = unitsOf(page->getFreeSpace());
+      bufMgr->unPinPage(file, pageNo, true);
+      setFreeUnits(pageNo, units);
+      return rid;
+    }
+    // the map overstated the free space; since the page has less room than
+    // needed its entry changes, so it is not found again
+    std::uint8_t units = unitsOf(page->getFreeSpace());
+    bufMgr->unPinPage(file, pageNo, false);
+    setFreeUnits(pageNo, units);
+  }
+
+  bufMgr->allocPage(file, pageNo, page);
+  if (!page->hasSpaceForRecord(record)) {
+    std::uint16_t freeBytes = page->getFreeSpace();
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->disposePage(file, pageNo);
+    throw InsufficientSpaceException(pageNo, record.length(), freeBytes);
+  }
+  RecordId rid = page->insertRecord(record);
+  std::uint8_t units = unitsOf(page->getFreeSpace());
+  bufMgr->unPinPage(file, pageNo, true);
+  setFreeUnits(pageNo, units);
+  return rid;
+}
+
+void HeapFile::deleteRecord(const RecordId &rid) {
+  Page *page;
+  bufMgr->readPage(file, rid.page_number, page);
+  try {
+    page->deleteRecord(rid);
+  } catch (...) {
+    bufMgr->unPinPage(file, rid.page_number, false);
+    throw;
+  }
+  const bool empty = page->begin() == page->end();
+  std::uint8_t units = unitsOf(page->getFreeSpace());
+  bufMgr->unPinPage(file, rid.page_number, true);
+
+  if (empty) {
+    bufMgr->disposePage(file, rid.page_number);
+    units = 0;
+  }
+  setFreeUnits(rid.page_number, units);
+}
+
+std::string HeapFile::getRecord(const RecordId &rid) {
+  Page *page;
+  bufMgr->readPage(file, rid.page_number, page);
+  std::string record;
+  try {
+    record = page->getRecord(rid);
+  } catch (...) {
+    bufMgr->unPinPage(file, rid.page_number, false);
+    throw;
+  }
+  bufMgr->unPinPage(file, rid.page_number, false);
+  return record;
+}
+
+}
@@ -0,0 +1,214 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief The meta page of a free-space map, the first page of its file.
+ */
+struct FreeSpaceMapMetaInfo {
+  /**
+   * Number of map pages following the meta page.
+   */
+  PageId numMapPages;
+};
+
+/**
+ * @brief A relation of records stored in the pages of a PageFile, with a
+ * free-space map so records are inserted into existing pages with room
+ * instead of always at the end.
+ *
+ * The free-space map is kept in a BlobFile named after the relation with
+ * FSM_SUFFIX appended. Its first page is a FreeSpaceMapMetaInfo, the pages
+ * after it hold one byte per heap page: the page's free space in units of
+ * FSM_UNIT bytes, rounded down, or 0 for pages that are not in use. The map is
+ * read into memory when the relation is opened, and built from the heap pages
+ * if the relation has no map yet. Pages with room are kept in one list per
+ * free space byte, linked through arrays indexed by page number, so a page for
+ * a record is found without scanning and moves between lists in constant time.
+ *
+ * All pages are accessed through the buffer manager. Pages left empty by
+ * deleteRecord are disposed of, and are reused by the file for new pages.
+ *
+ * @warning This class is not threadsafe.
+ */
+class HeapFile {
+ public:
+  /**
+   * Bytes of free space per unit in the free-space map.
+   */
+  static const std::uint32_t FSM_UNIT = 32;
+
+  /**
+   * Suffix of the name of the free-space map file.
+   */
+  static const char FSM_SUFFIX[];
+
+  /**
+   * Opens the relation with the given name, creating it if it does not exist.
+   *
+   * @param relationName  Name of the relation file.
+   * @param bufMgrIn      Buffer manager pages are read through.
+   */
+  HeapFile(const std::string &relationName, BufMgr *bufMgrIn);
+
+  /**
+   * Flushes the pages of the relation and of its free-space map.
+   */
+  ~HeapFile();
+
+  /**
+   * Inserts a record into a page with enough room for it, allocating a new
+   * page if no page has.
+   *
+   * @param record  Bytes that compose the record.
+   * @return  ID of the new record.
+   * @throws  InsufficientSpaceException  If the record is larger than a page.
+   */
+  RecordId insertRecord(const std::string &record);
+
+  /**
+   * Deletes a record, disposing of its page if no records are left on it.
+   *
+   * @param rid  ID of the record.
+   * @throws  InvalidRecordException  If there is no such record.
+   */
+  void deleteRecord(const RecordId &rid);
+
+  /**
+   * Returns a copy of a record.
+   *
+   * @param rid  ID of the record.
+   * @throws  InvalidRecordException  If there is no such record.
+   */
+  std::string getRecord(const RecordId &rid);
+
+  /**
+   * Returns the free space of a page recorded in the free-space map, in
+   * bytes rounded down to a multiple of FSM_UNIT; 0 for pages not in use.
+   */
+  std::uint32_t freeSpace(const PageId pageNo) const {
+    return pageNo < freeUnits.size() ? freeUnits[pageNo] * FSM_UNIT : 0;
+  }
+
+  /**
+   * Returns the file the records are stored in.
+   */
+  PageFile *getFile() { return file; }
+
+ private:
+  /**
+   * Heap pages covered by each page of the free-space map.
+   */
+  static const std::uint32_t PAGES_PER_MAP_PAGE = Page::SIZE;
+
+  /**
+   * Number of distinct values of a free-space map entry.
+   */
+  static const std::uint32_t NUM_UNITS = 256;
+
+  /**
+   * Returns the free-space map entry for a page with the given free space.
+   */
+  static std::uint8_t unitsOf(std::uint16_t freeBytes) {
+    return std::min<std::uint32_t>(freeBytes / FSM_UNIT, NUM_UNITS - 1);
+  }
+
+  /**
+   * Reads the free-space map into memory.
+   */
+  void loadMap();
+
+  /**
+   * Records the free space of every used heap page, for a relation which has
+   * no free-space map.
+   */
+  void buildMap();
+
+  /**
+   * Sets the free-space map entry of a page, in memory and in the map file.
+   *
+   * @param pageNo  Number of the heap page.
+   * @param units   New entry.
+   */
+  void setFreeUnits(PageId pageNo, std::uint8_t units);
+
+  /**
+   * Adds a page to the front of the list for the given free-space map entry.
+   */
+  void linkCandidate(PageId pageNo, std::uint8_t units);
+
+  /**
+   * Removes a page from the list for the given free-space map entry.
+   */
+  void unlinkCandidate(PageId pageNo, std::uint8_t units);
+
+  /**
+   * Finds a page whose free-space map entry is at least the given one.
+   *
+   * @param units   Smallest entry wanted.
+   * @param pageNo  Set to the page found.
+   * @return  True if there is such a page.
+   */
+  bool findCandidate(std::uint32_t units, PageId &pageNo);
+
+  /**
+   * Buffer manager pages are read through.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * File holding the records.
+   */
+  PageFile *file;
+
+  /**
+   * File holding the free-space map.
+   */
+  BlobFile *mapFile;
+
+  /**
+   * Number of map pages in mapFile.
+   */
+  PageId numMapPages;
+
+  /**
+   * Free-space map entry of each heap page, by page number.
+   */
+  std::vector<std::uint8_t> freeUnits;
+
+  /**
+   * First page of the list of pages with each free-space map entry, or
+   * Page::INVALID_NUMBER if there is none. Every page with an entry above 0 is
+   * on exactly the list for its entry.
+   */
+  PageId candidates[NUM_UNITS];
+
+  /**
+   * Next and previous page on the list of each page, by page number, or
+   * Page::INVALID_NUMBER at the ends of the list.
+   */
+  std::vector<PageId> nextCandidate, prevCandidate;
+
+  /**
+   * Bit set for every list in candidates that is not empty.
+   */
+  std::uint64_t nonEmpty[NUM_UNITS / 64];
+};
+
+}
@@ -0,0 +1,171 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "key_search.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_SEARCH_X86
+#endif
+
+namespace badgerdb {
+
+/**
+ * The scalar kernel.
+ */
+template <class T>
+static int scalarSearch(const T *keys, int len, T key, bool includeKey) {
+  return static_cast<int>((includeKey ? std::lower_bound(keys, keys + len, key)
+                                      : std::upper_bound(keys, keys + len, key)) -
+                          keys);
+}
+
+#ifdef KEY_SEARCH_X86
+
+// The vector kernels narrow the search to a window of four registers of keys
+// holding the match, then count the keys of the window before the match.
+// Since the keys before the match are a prefix of the array, the window may
+// start early so that it ends inside it.
+
+/**
+ * Counts the keys of the eight at p which come before the match.
+ */
+template <bool INCLUDE_KEY>
+__attribute__((target("avx2")))
+static inline int countBeforeAvx2(const int *p, int key) {
+  const __m256i keys = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  const __m256i k = _mm256_set1_epi32(key);
+  const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+      INCLUDE_KEY ? _mm256_cmpgt_epi32(k, keys) : _mm256_cmpgt_epi32(keys, k)));
+  return INCLUDE_KEY ? __builtin_popcount(mask) : 8 - __builtin_popcount(mask);
+}
+
+/**
+ * Counts the keys of the four at p which come before the match.
+ */
+template <bool INCLUDE_KEY>
+__attribute__((target("avx2")))
+static inline int countBeforeAvx2(const double *p, double key) {
+  const __m256d cmp = _mm256_cmp_pd(_mm256_loadu_pd(p), _mm256_set1_pd(key),
+                                    INCLUDE_KEY ? _CMP_LT_OQ : _CMP_NGT_UQ);
+  return __builtin_popcount(_mm256_movemask_pd(cmp));
+}
+
+template <bool INCLUDE_KEY, class T>
+__attribute__((target("avx2")))
+static int searchAvx2(const T *keys, int len, T key) {
+  const int lanes = 32 / sizeof(T);
+  const int window = 4 * lanes;
+  if (len < window)
+    return KeySearch::branchless<INCLUDE_KEY>(keys, len, key);
+
+  int n = len;
+  const T *base = KeySearch::narrow<INCLUDE_KEY>(keys, n, key, window);
+  const int first = std::min(static_cast<int>(base - keys), len - window);
+  int count = 0;
+  for (int i = 0; i < window; i += lanes)
+    count += countBeforeAvx2<INCLUDE_KEY>(keys + first + i, key);
+  return first + count;
+}
+
+/**
+ * Counts the keys of the sixteen at p which come before the match.
+ */
+template <bool INCLUDE_KEY>
+__attribute__((target("avx512f")))
+static inline int countBeforeAvx512(const int *p, int key) {
+  const __m512i keys = _mm512_loadu_si512(p);
+  const __m512i k = _mm512_set1_epi32(key);
+  return __builtin_popcount(INCLUDE_KEY ? _mm512_cmplt_epi32_mask(keys, k)
+                                        : _mm512_cmple_epi32_mask(keys, k));
+}
+
+/**
+ * Counts the keys of the eight at p which come before the match.
+ */
+template <bool INCLUDE_KEY>
+__attribute__((target("avx512f")))
+static inline int countBeforeAvx512(const double *p, double key) {
+  return __builtin_popcount(
+      _mm512_cmp_pd_mask(_mm512_loadu_pd(p), _mm512_set1_pd(key),
+                         INCLUDE_KEY ? _CMP_LT_OQ : _CMP_NGT_UQ));
+}
+
+template <bool INCLUDE_KEY, class T>
+__attribute__((target("avx512f")))
+static int searchAvx512(const T *keys, int len, T key) {
+  const int lanes = 64 / sizeof(T);
+  const int window = 4 * lanes;
+  if (len < window)
+    return KeySearch::branchless<INCLUDE_KEY>(keys, len, key);
+
+  int n = len;
+  const T *base = KeySearch::narrow<INCLUDE_KEY>(keys, n, key, window);
+  const int first = std::min(static_cast<int>(base - keys), len - window);
+  int count = 0;
+  for (int i = 0; i < window; i += lanes)
+    count += countBeforeAvx512<INCLUDE_KEY>(keys + first + i, key);
+  return first + count;
+}
+
+#endif
+
+/**
+ * Runs a kernel on an array of ints or doubles.
+ */
+template <class T>
+static int searchWith(SearchKernel kernel, const T *keys, int len, T key,
+                      bool includeKey) {
+  switch (std::min(kernel, KeySearch::bestKernel())) {
+#ifdef KEY_SEARCH_X86
+    case AVX512_SEARCH:
+      return includeKey ? searchAvx512<true>(keys, len, key)
+                        : searchAvx512<false>(keys, len, key);
+    case AVX2_SEARCH:
+      return includeKey ? searchAvx2<true>(keys, len, key)
+                        : searchAvx2<false>(keys, len, key);
+#endif
+    case BRANCHLESS_SEARCH:
+      return includeKey ? KeySearch::branchless<true>(keys, len, key)
+                        : KeySearch::branchless<false>(keys, len, key);
+    default:
+      return scalarSearch(keys, len, key, includeKey);
+  }
+}
+
+/**
+ * Asks CPUID for the fastest kernel the machine supports.
+ */
+static SearchKernel detectKernel() {
+#ifdef KEY_SEARCH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return AVX512_SEARCH;
+  if (__builtin_cpu_supports("avx2"))
+    return AVX2_SEARCH;
+#endif
+  return BRANCHLESS_SEARCH;
+}
+
+SearchKernel KeySearch::bestKernel() {
+  static const SearchKernel best = detectKernel();
+  return best;
+}
+
+int KeySearch::search(const int *keys, int len, int key, bool includeKey,
+                      SearchKernel kernel) {
+  return searchWith(kernel, keys, len, key, includeKey);
+}
+
+int KeySearch::search(const double *keys, int len, double key, bool includeKey,
+                      SearchKernel kernel) {
+  return searchWith(kernel, keys, len, key, includeKey);
+}
+
+}
@@ -0,0 +1,130 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+namespace badgerdb {
+
+/**
+ * @brief Implementations of the KeySearch kernels, from slowest to fastest.
+ */
+enum SearchKernel {
+  /**
+   * Binary search with std::lower_bound and std::upper_bound.
+   */
+  SCALAR_SEARCH,
+
+  /**
+   * Binary search whose steps pick the next half with a conditional move
+   * instead of a branch.
+   */
+  BRANCHLESS_SEARCH,
+
+  /**
+   * Branchless binary search down to a block of keys, which is then counted
+   * eight ints or four doubles at a time with AVX2.
+   */
+  AVX2_SEARCH,
+
+  /**
+   * As AVX2_SEARCH, counting sixteen ints or eight doubles at a time with
+   * AVX-512.
+   */
+  AVX512_SEARCH
+};
+
+/**
+ * @brief Searches of the sorted key array of a B+ tree node.
+ *
+ * A search returns the position of the first key not less than the key
+ * searched for, or with includeKey false the first key greater than it; len
+ * if there is none. This is the number of keys before that position, which
+ * is what the vector kernels count.
+ *
+ * int and double keys use the kernel picked at runtime with CPUID; on other
+ * than x86 machines only the scalar kernels are available. Asking for a
+ * kernel the machine does not support runs the best one it does. Other key
+ * types are searched with the branchless kernel.
+ */
+class KeySearch {
+ public:
+  /**
+   * Returns the fastest kernel the machine supports.
+   */
+  static SearchKernel bestKernel();
+
+  /**
+   * Searches a sorted array of ints.
+   *
+   * @param keys        Sorted keys.
+   * @param len         Number of keys.
+   * @param key         Key to search for.
+   * @param includeKey  Whether a key equal to key is a match.
+   * @param kernel      Implementation to use.
+   * @return  Position of the first match, or len.
+   */
+  static int search(const int *keys, int len, int key, bool includeKey,
+                    SearchKernel kernel = bestKernel());
+
+  /**
+   * Searches a sorted array of doubles. NaN keys are not supported.
+   *
+   * @see search(const int *, int, int, bool, SearchKernel)
+   */
+  static int search(const double *keys, int len, double key, bool includeKey,
+                    SearchKernel kernel = bestKernel());
+
+  /**
+   * Searches a sorted array of keys of any type with operator<, using the
+   * branchless kernel.
+   *
+   * @see search(const int *, int, int, bool, SearchKernel)
+   */
+  template <class T>
+  static int search(const T *keys, int len, const T &key, bool includeKey) {
+    return includeKey ? branchless<true>(keys, len, key)
+                      : branchless<false>(keys, len, key);
+  }
+
+  /**
+   * True if a key comes before the first match for key: if it is less than
+   * key, or with INCLUDE_KEY false not greater than it.
+   */
+  template <bool INCLUDE_KEY, class T>
+  static bool before(const T &a, const T &key) {
+    return INCLUDE_KEY ? a < key : !(key < a);
+  }
+
+  /**
+   * Narrows the search to at most window keys without branching on the keys:
+   * every key before the returned base comes before the match, and the match
+   * is at most base + the returned length.
+   */
+  template <bool INCLUDE_KEY, class T>
+  static const T *narrow(const T *keys, int &len, const T &key, int window) {
+    const T *base = keys;
+    while (len > window) {
+      const int half = len / 2;
+      base = before<INCLUDE_KEY>(base[half], key) ? base + half : base;
+      len -= half;
+    }
+    return base;
+  }
+
+  /**
+   * The branchless kernel.
+   */
+  template <bool INCLUDE_KEY, class T>
+  static int branchless(const T *keys, int len, const T &key) {
+    if (len == 0)
+      return 0;
+    const T *base = narrow<INCLUDE_KEY>(keys, len, key, 1);
+    return static_cast<int>(base - keys) + before<INCLUDE_KEY>(*base, key);
+  }
+};
+
+}
@@ -7,19 +7,40 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 #include <vector>
+#include <sys/resource.h>
 #include "btree.h"
+#include "exceptions/bad_fill_factor_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scan_param_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/io_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
+#include "external_sort.h"
 #include "file_iterator.h"
 #include "filescan.h"
+#include "heap_file.h"
+#include "key_search.h"
 #include "page.h"
+#include "page_filter.h"
+#include "parallel_scan.h"
 #include "page_iterator.h"
 
 #define checkPassFail(a, b)                                         \
@@ -77,11 +98,25 @@ void createRelationRandom(int rel = relationSize);
 
 std::vector<int> *createTrueRandom(int from, int to, int rate);
 
-void intTests();
+void intTests(BuildMode buildMode = INSERT_BUILD,
+              double fillFactor = DEFAULT_FILL_FACTOR);
 
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
             Operator highOp, std::vector<int> *ret_vector = nullptr);
 
+void doubleTests(BuildMode buildMode = INSERT_BUILD);
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp);
+
+void stringTests(BuildMode buildMode = INSERT_BUILD);
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp);
+
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp,
+              const void *highVal, Operator highOp);
+
 void indexTests();
 
 void test1_contiguous_ascending();
@@ -93,6 +128,31 @@ void test6_contiguous_ascending_stress();
 void test7_contiguous_descending_stress();
 void test8_contiguous_random_stress();
 void test9_error_test();
+void test10_bulk_load_random();
+void test11_bulk_load_random_stress();
+void test12_reopen_index();
+void test13_concurrent_buffer();
+void test14_replacement_policies();
+void test15_scan_ring_buffer();
+void test16_prefetch();
+void test17_background_writer();
+void test18_io_backends();
+void test19_group_commit();
+void test20_append_pages();
+void test21_free_space_map();
+void test22_record_view();
+void test23_read_into();
+void test24_batch_scan();
+void test25_scan_pushdown();
+void test26_simd_filter();
+void test27_parallel_scan();
+void test28_external_sort();
+void test29_typed_keys();
+void test30_node_counts();
+void test31_key_search();
+void test32_scan_cursors();
+void test33_batch_index_scan();
+void test34_delete_entries();
 
 void randomIntTests(std::vector<int> *sortedvec);
 
@@ -102,6 +162,88 @@ void test_int_out_of_bound();
 
 void deleteRelation();
 
+double bufferReadThroughput(PageFile *file, int workingSet, int numThreads,
+                            int opsPerThread);
+
+void bufferReadWriteStress(PageFile *file, int numPages, int numThreads,
+                           int opsPerThread,
+                           ReplacementPolicy policy = CLOCK_POLICY);
+
+int sumCounters(PageFile *file, int numPages);
+
+double lookupHitRateWithScans(ReplacementPolicy policy, int numKeys,
+                              int hotKeys, int rounds, int lookupsPerRound);
+
+double lookupHitRateDuringScan(BufAccessStrategy *strategy, int hotKeys,
+                               int recordsPerBatch, int lookupsPerBatch);
+
+int timedScans(int prefetchDepth, int numKeys);
+
+int insertWithBgWriter(bool useBgWriter, int numKeys, int &foregroundWrites);
+
+long ioBackendBenchmark(IOBackend backend, int numPages, int numOps);
+
+long bulkCreate(IOBackend backend, bool groupCommit, int numRecords);
+
+int loadRecords(int numRecords);
+
+std::uint64_t deleteAllPages(int numPages);
+
+int countPages(PageFile *file);
+
+double missLatency(PageFile *file, int numPages, int rounds);
+
+long batchScanSum(std::size_t batchSize, int &numRecords, int &numBatches);
+
+int pushdownScan(const ScanPredicate &predicate, long &sum);
+
+std::vector<Page> filterPages(int numPages);
+
+int selectionMismatches(const Page &page, const ScanPredicate &reference,
+                        const std::vector<std::uint64_t> &selection,
+                        std::size_t count);
+
+double filterNanos(const std::vector<Page> &pages, FilterKernel kernel,
+                   int rounds, std::size_t &numSelected);
+
+double matchLoopNanos(const std::vector<Page> &pages,
+                      const ScanPredicate &predicate, int rounds,
+                      std::size_t &numSelected);
+
+long parallelScanSum(int numWorkers, std::size_t morselPages,
+                     const ScanPredicate &predicate, int &numRecords);
+
+std::vector<PageId> scannedPages(int numWorkers);
+
+std::size_t externalSortCheck(int numWriters, int numEntries,
+                              std::size_t runEntries, std::size_t fanIn,
+                              int &numOutOfOrder);
+
+int countLeafEntries(const std::string &indexName, int &numBadLeaves);
+
+int countThinNonLeaves(BlobFile &indexFile, PageId pageNo);
+
+int searchMismatches(SearchKernel kernel, int len, int &numSearches);
+
+double searchNanos(SearchKernel kernel, const std::vector<int> &keys,
+                   const std::vector<int> &probes, long &sum);
+
+int drainCursor(BTreeScanCursor &cursor);
+
+int batchMismatches(BTreeIndex *index, const void *lowVal, Operator lowOp,
+                    const void *highVal, Operator highOp,
+                    std::size_t batchSize, int &numEntries);
+
+double shortScansNanos(BTreeIndex *index, bool batched, int numScans,
+                       long &numEntries);
+
+std::vector<RIDKeyPair<int> > relationEntries();
+
+int treeViolations(const std::string &indexName, bool checkFill,
+                   int &numEntries, int &height);
+
+long indexFilePages(const std::string &indexName);
+
 // ##################################################################### //
 // ##################################################################### //
 // ##################################################################### //
@@ -149,8 +291,7 @@ int main(int argc, char **argv) {
         fscan.scanNext(scanRid);
         // Assuming RECORD.i is our key, lets extract the key, which we know is
         // INTEGER and whose byte offset is also know inside the record.
-        std::string recordStr = fscan.getRecord();
-        const char *record = recordStr.c_str();
+        const char *record = fscan.getRecord().data();
         int key = *((int *)(record + offsetof(RECORD, i)));
         std::cout << "Extracted : " << key << std::endl;
       }
@@ -171,6 +312,32 @@ int main(int argc, char **argv) {
   test7_contiguous_descending_stress();
   test8_contiguous_random_stress();
   test9_error_test();
+  deleteIndexFile();
+  test10_bulk_load_random();
+  test11_bulk_load_random_stress();
+  test12_reopen_index();
+  test13_concurrent_buffer();
+  test14_replacement_policies();
+  test15_scan_ring_buffer();
+  test16_prefetch();
+  test17_background_writer();
+  test18_io_backends();
+  test19_group_commit();
+  test20_append_pages();
+  test21_free_space_map();
+  test22_record_view();
+  test23_read_into();
+  test24_batch_scan();
+  test25_scan_pushdown();
+  test26_simd_filter();
+  test27_parallel_scan();
+  test28_external_sort();
+  test29_typed_keys();
+  test30_node_counts();
+  test31_key_search();
+  test32_scan_cursors();
+  test33_batch_index_scan();
+  test34_delete_entries();
 
   return 1;
 }
@@ -262,6 +429,125 @@ void test8_contiguous_random_stress() {
   deleteRelation();
 }
 
+void test10_bulk_load_random() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test10_bulk_load_random" << std::endl;
+  createRelationRandom();
+  intTests(BULK_BUILD);
+  deleteIndexFile();
+
+  // fill factors outside (0, 1] are rejected, before any index file is
+  // created by the constructor or any entry is loaded by bulkLoad
+  const double badFillFactors[] = {0, -0.5, 1.5, std::nan("")};
+  int numRejected = 0;
+  for (double fillFactor : badFillFactors) {
+    try {
+      BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                       INTEGER, BULK_BUILD, fillFactor);
+    } catch (BadFillFactorException e) {
+      numRejected++;
+    }
+  }
+  checkPassFail(numRejected, 4);
+  checkPassFail(File::exists(intIndexName), false);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    numRejected = 0;
+    for (double fillFactor : badFillFactors) {
+      std::vector<RIDKeyPair<int> > none;
+      try {
+        index.bulkLoad(none, fillFactor);
+      } catch (BadFillFactorException e) {
+        numRejected++;
+      }
+    }
+    checkPassFail(numRejected, 4);
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize);
+  }
+  deleteIndexFile();
+  deleteRelation();
+
+  // with the smallest fill factor every leaf holds one entry and every
+  // non-leaf node still gets at least two children
+  const int relationSizes[] = {2, 3, 5, 7, 9, 100};
+  int numThin = 0;
+  for (int size : relationSizes) {
+    createRelationRandom(size);
+    {
+      BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                       INTEGER, BULK_BUILD, 0.001);
+      checkPassFail(intScan(&index, -1, GT, size, LT), size);
+    }
+    {
+      BlobFile indexFile(intIndexName, false);
+      Page page = indexFile.readPage(indexFile.getFirstPageNo());
+      numThin += countThinNonLeaves(
+          indexFile, reinterpret_cast<IndexMetaInfo *>(&page)->rootPageNo);
+    }
+    deleteIndexFile();
+    deleteRelation();
+  }
+  checkPassFail(numThin, 0);
+}
+
+/**
+ * Returns the number of non-leaf nodes with fewer than two children in the
+ * subtree of an INTEGER index rooted at the given page.
+ */
+int countThinNonLeaves(BlobFile &indexFile, PageId pageNo) {
+  Page page = indexFile.readPage(pageNo);
+  const NonLeafNodeInt *node = reinterpret_cast<NonLeafNodeInt *>(&page);
+  if (node->level == -1) return 0;
+  int numThin = node->count < 1 ? 1 : 0;
+  for (int i = 0; i <= node->count; i++)
+    numThin += countThinNonLeaves(indexFile, node->pageNoArray[i]);
+  return numThin;
+}
+
+void test11_bulk_load_random_stress() {
+  // A low fill factor gives more than two levels of non-leaf nodes
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test11_bulk_load_random_stress" << std::endl;
+  createRelationRandom(350000);
+  intTests(BULK_BUILD, 0.5);
+  deleteIndexFile();
+  deleteRelation();
+}
+
+void test12_reopen_index() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test12_reopen_index" << std::endl;
+  createRelationRandom();
+  intTests();
+
+  // The index file now exists, so it is opened from its meta page instead of
+  // being rebuilt from the relation.
+  std::cout << "Reopen the index" << std::endl;
+  bufMgr->clearBufStats();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    if (bufMgr->getBufStats().diskreads == 1)
+      std::cout << "Reopen Test 1 Passed." << std::endl;
+    else
+      std::cout << "Reopen Test 1 Failed." << std::endl;
+  }
+  intTests();
+
+  std::cout << "Reopen the index with a different attribute type" << std::endl;
+  try {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     DOUBLE);
+    std::cout << "BadIndexInfoException Test 1 Failed." << std::endl;
+  } catch (BadIndexInfoException e) {
+    std::cout << "BadIndexInfoException Test 1 Passed." << std::endl;
+  }
+
+  deleteIndexFile();
+  deleteRelation();
+}
+
 // ##################################################################### //
 // ##################################################################### //
 // ##################################################################### //
@@ -287,10 +573,10 @@ void randomIntTests(std::vector<int> *sortedvec) {
     std::cout << "Random int test failed at line no:" << __LINE__ << std::endl;
 }
 
-void intTests() {
+void intTests(BuildMode buildMode, double fillFactor) {
   std::cout << "Create a B+ Tree index on the integer field" << std::endl;
   BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
+                   INTEGER, buildMode, fillFactor);
 
   // run some tests
   checkPassFail(intScan(&index, 25, GT, 40, LT), 14);
@@ -302,6 +588,38 @@ void intTests() {
   checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000);
 }
 
+void doubleTests(BuildMode buildMode) {
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                   DOUBLE, buildMode);
+
+  // run some tests
+  checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14);
+  checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16);
+  checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3);
+  checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4);
+  checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0);
+  checkPassFail(doubleScan(&index, 300, GT, 400, LT), 99);
+  checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000);
+  checkPassFail(doubleScan(&index, 24.5, GT, 40.5, LT), 16);
+  checkPassFail(doubleScan(&index, 0.25, GTE, 0.75, LTE), 0);
+}
+
+void stringTests(BuildMode buildMode) {
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                   STRING, buildMode);
+
+  // run some tests
+  checkPassFail(stringScan(&index, 25, GT, 40, LT), 14);
+  checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16);
+  checkPassFail(stringScan(&index, -3, GT, 3, LT), 3);
+  checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4);
+  checkPassFail(stringScan(&index, 0, GT, 1, LT), 0);
+  checkPassFail(stringScan(&index, 300, GT, 400, LT), 99);
+  checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000);
+}
+
 void test_int_out_of_bound() {
   std::cout << "Create a B+ Tree index on the integer field" << std::endl;
   BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
@@ -500,187 +818,3001 @@ std::vector<int> *createTrueRandom(int from, int to, int rate) {
 // ##################################################################### //
 // ##################################################################### //
 // ##################################################################### //
-// ######################      Error Tests      ######################## //
+// ######################     Test Buffer       ######################## //
 // ##################################################################### //
 // ##################################################################### //
 // ##################################################################### //
 
-void test9_error_test() {
-  std::cout << "Error handling tests" << std::endl;
-  std::cout << "--------------------" << std::endl;
-  // Given error test
+void test13_concurrent_buffer() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test13_concurrent_buffer" << std::endl;
 
+  // Every page holds a single record with a counter, starting at 0.
+  const int numPages = 400;
   try {
     File::remove(relationName);
   } catch (FileNotFoundException e) {
   }
-
   file1 = new PageFile(relationName, true);
+  for (int i = 0; i < numPages; i++) {
+    int counter = 0;
+    PageId new_page_number;
+    Page new_page = file1->allocatePage(new_page_number);
+    new_page.insertRecord(
+        std::string(reinterpret_cast<char *>(&counter), sizeof(counter)));
+    file1->writePage(new_page_number, new_page);
+  }
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+  // Readers hitting a working set that fits in the buffer pool.
+  std::cout << "Cached read throughput" << std::endl;
+  for (int numThreads = 1; numThreads <= 8; numThreads *= 2) {
+    double opsPerSec = bufferReadThroughput(file1, 50, numThreads, 200000);
+    std::cout << "threads:" << numThreads << " ops/sec:" << (long)opsPerSec
+              << std::endl;
+  }
 
-  // Insert a bunch of tuples into the relation.
-  for (int i = 0; i < 10; i++) {
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = (double)i;
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+  // Readers and writers over more pages than the buffer pool holds.
+  const ReplacementPolicy policies[] = {CLOCK_POLICY, LRU_K_POLICY,
+                                        TWO_Q_POLICY, ARC_POLICY};
+  for (ReplacementPolicy policy : policies)
+    bufferReadWriteStress(file1, numPages, 4, 10000, policy);
 
-    while (1) {
-      try {
-        new_page.insertRecord(new_data);
-        break;
-      } catch (InsufficientSpaceException e) {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
-      }
+  // a page that cannot be written back stays buffered and dirty, and is
+  // written once it can be
+  {
+    const int total = sumCounters(file1, numPages);
+    BufMgr mgr(10);
+    Page *page;
+    RecordId rid = {1, 1};
+    mgr.readPage(file1, 1, page);
+    int counter = *reinterpret_cast<const int *>(page->getRecord(rid).data());
+    counter++;
+    page->updateRecord(
+        rid, std::string(reinterpret_cast<char *>(&counter), sizeof(counter)));
+    mgr.unPinPage(file1, 1, true);
+
+    // writes fail with EFBIG while the file size limit is below the page
+    struct rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &limit);
+    struct rlimit lowered = limit;
+    lowered.rlim_cur = 1;
+    void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    setrlimit(RLIMIT_FSIZE, &lowered);
+    bool thrown = false;
+    try {
+      mgr.flushFile(file1);
+    } catch (IOException e) {
+      thrown = true;
     }
+    setrlimit(RLIMIT_FSIZE, &limit);
+    signal(SIGXFSZ, handler);
+    checkPassFail(thrown, true);
+
+    mgr.readPage(file1, 1, page);
+    checkPassFail(
+        *reinterpret_cast<const int *>(page->getRecord(rid).data()), counter);
+    mgr.unPinPage(file1, 1, false);
+    mgr.flushFile(file1);
+    checkPassFail(sumCounters(file1, numPages), total + 1);
   }
 
-  file1->writePage(new_page_number, new_page);
-
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
-
-  int int2 = 2;
-  int int5 = 5;
+  deleteRelation();
+}
 
-  // Scan Tests
-  std::cout << "Call endScan before startScan" << std::endl;
-  try {
-    index.endScan();
-    std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
-  } catch (ScanNotInitializedException e) {
-    std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
+double bufferReadThroughput(PageFile *file, int workingSet, int numThreads,
+                            int opsPerThread) {
+  BufMgr mgr(100);
+  std::atomic<int> errors(0);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < numThreads; t++) {
+    workers.emplace_back([&, t]() {
+      unsigned int seed = t + 1;
+      for (int k = 0; k < opsPerThread; k++) {
+        PageId pageNo = 1 + rand_r(&seed) % workingSet;
+        Page *page;
+        mgr.readPage(file, pageNo, page);
+        if (page->page_number() != pageNo) errors++;
+        mgr.unPinPage(file, pageNo, false);
+      }
+    });
   }
+  for (std::thread &worker : workers) worker.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  // throws PagePinnedException if a pin was lost
+  mgr.flushFile(file);
+  checkPassFail(errors.load(), 0);
+  return (double)numThreads * opsPerThread / elapsed.count();
+}
 
-  std::cout << "Call scanNext before startScan" << std::endl;
-  try {
-    RecordId foo;
-    index.scanNext(foo);
-    std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
-  } catch (ScanNotInitializedException e) {
-    std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+int sumCounters(PageFile *file, int numPages) {
+  int total = 0;
+  for (int i = 1; i <= numPages; i++) {
+    Page page = file->readPage(i);
+    RecordId rid = {(PageId)i, 1};
+    total += *reinterpret_cast<const int *>(page.getRecord(rid).data());
   }
+  return total;
+}
 
-  std::cout << "Scan with bad lowOp" << std::endl;
-  try {
-    index.startScan(&int2, LTE, &int5, LTE);
-    std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
-  } catch (BadOpcodesException e) {
-    std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+void bufferReadWriteStress(PageFile *file, int numPages, int numThreads,
+                           int opsPerThread, ReplacementPolicy policy) {
+  std::cout << "Read/write stress with eviction, policy " << policy
+            << std::endl;
+  int before = sumCounters(file, numPages);
+  std::atomic<int> numWrites(0);
+  {
+    BufMgr mgr(100, policy);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; t++) {
+      workers.emplace_back([&, t]() {
+        // each thread only modifies its own pages, but all of them compete
+        // for the same frames
+        unsigned int seed = t + 1;
+        for (int k = 0; k < opsPerThread; k++) {
+          PageId pageNo =
+              1 + t + numThreads * (rand_r(&seed) % (numPages / numThreads));
+          bool write = rand_r(&seed) % 2 == 0;
+          Page *page;
+          mgr.readPage(file, pageNo, page);
+          if (write) {
+            RecordId rid = {pageNo, 1};
+            int counter =
+                *reinterpret_cast<const int *>(page->getRecord(rid).data());
+            counter++;
+            page->updateRecord(rid, std::string(reinterpret_cast<char *>(
+                                                    &counter),
+                                                sizeof(counter)));
+            numWrites++;
+          }
+          mgr.unPinPage(file, pageNo, write);
+        }
+      });
+    }
+    for (std::thread &worker : workers) worker.join();
+    mgr.flushFile(file);
   }
 
-  std::cout << "Scan with bad highOp" << std::endl;
-  try {
-    index.startScan(&int2, GTE, &int5, GTE);
-    std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
-  } catch (BadOpcodesException e) {
-    std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
+  // every update must have reached the file exactly once
+  checkPassFail(sumCounters(file, numPages) - before, numWrites.load());
+}
+
+void test14_replacement_policies() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test14_replacement_policies" << std::endl;
+  createRelationForward(30000);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULK_BUILD);
   }
 
-  std::cout << "Scan with bad range" << std::endl;
-  try {
-    index.startScan(&int5, GTE, &int2, LTE);
-    std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
-  } catch (BadScanrangeException e) {
-    std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+  // Point lookups, mostly on a working set that fits in the pool, with a
+  // full scan of the relation, three times the size of the pool, after
+  // every batch.
+  const ReplacementPolicy policies[] = {CLOCK_POLICY, LRU_K_POLICY,
+                                        TWO_Q_POLICY, ARC_POLICY};
+  const char *names[] = {"CLOCK", "LRU-2", "2Q", "ARC"};
+  double clockHitRate = 0;
+  for (int i = 0; i < 4; i++) {
+    double hitRate = lookupHitRateWithScans(policies[i], 30000, 4000, 11, 500);
+    std::cout << "policy:" << names[i] << " lookup hit rate:" << hitRate
+              << std::endl;
+    if (policies[i] == CLOCK_POLICY)
+      clockHitRate = hitRate;
+    else if (hitRate > clockHitRate)
+      std::cout << "Scan Resistance Test " << i << " Passed." << std::endl;
+    else
+      std::cout << "Scan Resistance Test " << i << " Failed." << std::endl;
   }
 
+  deleteIndexFile();
   deleteRelation();
 }
 
-// ##################################################################### //
-// ##################################################################### //
-// ##################################################################### //
-// ######################         Helper        ######################## //
-// ##################################################################### //
-// ##################################################################### //
-// ##################################################################### //
-void indexTests() {
-  intTests();
-  deleteIndexFile();
-}
+double lookupHitRateWithScans(ReplacementPolicy policy, int numKeys,
+                              int hotKeys, int rounds, int lookupsPerRound) {
+  BufMgr mgr(100, policy);
+  unsigned int seed = 1;
+  int errors = 0;
+  long accesses = 0, diskreads = 0;
+  {
+    BTreeIndex index(relationName, intIndexName, &mgr, offsetof(tuple, i),
+                     INTEGER);
+    for (int round = 0; round < rounds; round++) {
+      mgr.clearBufStats();
+      for (int k = 0; k < lookupsPerRound; k++) {
+        // four out of five lookups go to the hot keys
+        int key = rand_r(&seed) % 5 == 0 ? rand_r(&seed) % numKeys
+                                         : rand_r(&seed) % hotKeys;
+        RecordId scanRid;
+        Page *page;
+        index.startScan(&key, GTE, &key, LTE);
+        index.scanNext(scanRid);
+        mgr.readPage(file1, scanRid.page_number, page);
+        if (reinterpret_cast<const RECORD *>(
+                page->getRecord(scanRid).data())->i != key)
+          errors++;
+        mgr.unPinPage(file1, scanRid.page_number, false);
+        index.endScan();
+      }
+      // the first batch only warms up the pool
+      if (round > 0) {
+        accesses += mgr.getBufStats().accesses;
+        diskreads += mgr.getBufStats().diskreads;
+      }
 
-void deleteRelation() {
-  if (file1) {
-    bufMgr->flushFile(file1);
-    delete file1;
-    file1 = NULL;
-  }
-  try {
-    File::remove(relationName);
-  } catch (FileNotFoundException e) {
+      FileScan scan(relationName, &mgr);
+      try {
+        RecordId scanRid;
+        while (1) scan.scanNext(scanRid);
+      } catch (EndOfFileException e) {
+      }
+    }
   }
-}
+  mgr.flushFile(file1);
 
-void deleteIndexFile() {
-  try {
-    File::remove(intIndexName);
-  } catch (FileNotFoundException e) {
-  }
+  checkPassFail(errors, 0);
+  return 1.0 - (double)diskreads / accesses;
 }
 
-int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
-            Operator highOp, std::vector<int> *ret_vector) {
-  RecordId scanRid;
-  Page *curPage;
-
-  std::cout << "Scan for ";
-  if (lowOp == GT) {
-    std::cout << "(";
-  } else {
-    std::cout << "[";
-  }
-  std::cout << lowVal << "," << highVal;
-  if (highOp == LT) {
-    std::cout << ")";
-  } else {
-    std::cout << "]";
+void test15_scan_ring_buffer() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test15_scan_ring_buffer" << std::endl;
+  createRelationForward(30000);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULK_BUILD);
   }
-  std::cout << std::endl;
 
-  int numResults = 0;
+  // Point lookups on a working set that fits in the pool, interleaved with a
+  // full scan of a relation three times the size of the pool.
+  double poolHitRate = lookupHitRateDuringScan(NULL, 6000, 100, 5);
+  std::cout << "scan through pool lookup hit rate:" << poolHitRate
+            << std::endl;
 
-  try {
-    index->startScan(&lowVal, lowOp, &highVal, highOp);
-  } catch (NoSuchKeyFoundException e) {
-    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
-    return 0;
-  }
+  BufAccessStrategy ring;
+  double ringHitRate = lookupHitRateDuringScan(&ring, 6000, 100, 5);
+  std::cout << "scan through ring lookup hit rate:" << ringHitRate
+            << std::endl;
 
-  while (1) {
-    try {
-      index->scanNext(scanRid);
-      bufMgr->readPage(file1, scanRid.page_number, curPage);
-      RECORD myRec = *(
-          reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
-      bufMgr->unPinPage(file1, scanRid.page_number, false);
+  if (ringHitRate > 0.99 && ringHitRate > poolHitRate)
+    std::cout << "Ring Buffer Test 1 Passed." << std::endl;
+  else
+    std::cout << "Ring Buffer Test 1 Failed." << std::endl;
 
-      if (ret_vector) ret_vector->push_back(myRec.i);
+  deleteIndexFile();
+  deleteRelation();
+}
 
-      if (numResults < 5) {
-        std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-        std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s
-                  << ":" << std::endl;
-      } else if (numResults == 5) {
-        std::cout << "..." << std::endl;
+double lookupHitRateDuringScan(BufAccessStrategy *strategy, int hotKeys,
+                               int recordsPerBatch, int lookupsPerBatch) {
+  BufMgr mgr(100);
+  unsigned int seed = 1;
+  int errors = 0, numScanned = 0;
+  long accesses = 0, diskreads = 0;
+  {
+    BTreeIndex index(relationName, intIndexName, &mgr, offsetof(tuple, i),
+                     INTEGER);
+    FileScan scan(relationName, &mgr, strategy);
+    bool done = false;
+    for (int batch = 0; !done; batch++) {
+      mgr.clearBufStats();
+      for (int k = 0; k < lookupsPerBatch; k++) {
+        int key = rand_r(&seed) % hotKeys;
+        RecordId scanRid;
+        Page *page;
+        index.startScan(&key, GTE, &key, LTE);
+        index.scanNext(scanRid);
+        mgr.readPage(file1, scanRid.page_number, page);
+        if (reinterpret_cast<const RECORD *>(
+                page->getRecord(scanRid).data())->i != key)
+          errors++;
+        mgr.unPinPage(file1, scanRid.page_number, false);
+        index.endScan();
+      }
+      // the first batches only warm up the pool
+      if (batch >= 20) {
+        accesses += mgr.getBufStats().accesses;
+        diskreads += mgr.getBufStats().diskreads;
       }
-    } catch (IndexScanCompletedException e) {
-      break;
-    }
 
-    numResults++;
+      try {
+        RecordId scanRid;
+        for (int r = 0; r < recordsPerBatch; r++, numScanned++)
+          scan.scanNext(scanRid);
+      } catch (EndOfFileException e) {
+        done = true;
+      }
+    }
   }
+  mgr.flushFile(file1);
 
-  if (numResults >= 5) {
+  checkPassFail(errors, 0);
+  checkPassFail(numScanned, 30000);
+  return 1.0 - (double)diskreads / accesses;
+}
+
+void test16_prefetch() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test16_prefetch" << std::endl;
+  createRelationForward(30000);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, BULK_BUILD);
+  }
+
+  // Explicitly prefetched pages are read unpinned and then found buffered.
+  {
+    BufMgr mgr(100);
+    std::vector<PageId> pageNos;
+    for (PageId i = 1; i <= 20; i++) pageNos.push_back(i);
+    mgr.prefetchPages(file1, pageNos);
+    int errors = 0;
+    for (PageId pageNo : pageNos) {
+      Page *page;
+      mgr.readPage(file1, pageNo, page);
+      if (page->page_number() != pageNo) errors++;
+      mgr.unPinPage(file1, pageNo, false);
+    }
+    // throws PagePinnedException if a prefetched page was left pinned
+    mgr.flushFile(file1);
+    checkPassFail(errors, 0);
+  }
+
+  // Full file scans and index range scans, without and with read-ahead.
+  checkPassFail(timedScans(0, 30000), 2 * 30000);
+  checkPassFail(timedScans(BufMgr::DEFAULT_PREFETCH_DEPTH, 30000), 2 * 30000);
+
+  deleteIndexFile();
+  deleteRelation();
+}
+
+int timedScans(int prefetchDepth, int numKeys) {
+  BufMgr mgr(100);
+  int numRecords = 0;
+  long checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    FileScan scan(relationName, &mgr);
+    scan.setPrefetchDepth(prefetchDepth);
+    try {
+      RecordId scanRid;
+      while (1) {
+        scan.scanNext(scanRid);
+        checksum += reinterpret_cast<const RECORD *>(scan.getRecord().data())->i;
+        numRecords++;
+      }
+    } catch (EndOfFileException e) {
+    }
+  }
+  std::chrono::duration<double> fileScanTime =
+      std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  {
+    BTreeIndex index(relationName, intIndexName, &mgr, offsetof(tuple, i),
+                     INTEGER);
+    index.setPrefetchDepth(prefetchDepth);
+    int low = 0, high = numKeys;
+    index.startScan(&low, GTE, &high, LT);
+    try {
+      RecordId scanRid;
+      while (1) {
+        index.scanNext(scanRid);
+        checksum -= scanRid.slot_number;
+        numRecords++;
+      }
+    } catch (IndexScanCompletedException e) {
+    }
+    index.endScan();
+  }
+  std::chrono::duration<double> indexScanTime =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << "prefetch depth:" << prefetchDepth
+            << " file scan ms:" << (long)(fileScanTime.count() * 1000)
+            << " index scan ms:" << (long)(indexScanTime.count() * 1000)
+            << " checksum:" << checksum << std::endl;
+  return numRecords;
+}
+
+void test17_background_writer() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test17_background_writer" << std::endl;
+  createRelationRandom(100000);
+
+  // Build an index by inserts through a small pool, so that most victims
+  // are dirty, first writing them back on eviction and then with the
+  // background writer cleaning ahead of the replacer. How many writes the
+  // writer takes over depends on when it gets to run, so the counts are
+  // only printed.
+  int withoutWriter = 0, withWriter = 0;
+  checkPassFail(insertWithBgWriter(false, 100000, withoutWriter), 100000);
+  checkPassFail(insertWithBgWriter(true, 100000, withWriter), 100000);
+  std::cout << "foreground writes without writer:" << withoutWriter
+            << " with writer:" << withWriter << std::endl;
+  deleteRelation();
+
+  // The writer cleans every dirty unpinned page by itself, writing what is
+  // buffered, and leaves the pages buffered.
+  const int numPages = 40;
+  file1 = new PageFile(relationName, true);
+  for (int i = 0; i < numPages; i++) {
+    int counter = 0;
+    PageId pageNo;
+    Page page = file1->allocatePage(pageNo);
+    page.insertRecord(
+        std::string(reinterpret_cast<char *>(&counter), sizeof(counter)));
+    file1->writePage(pageNo, page);
+  }
+  {
+    BufMgr mgr(50);
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++) {
+      Page *page;
+      RecordId rid = {pageNo, 1};
+      int counter = pageNo * 10;
+      mgr.readPage(file1, pageNo, page);
+      page->updateRecord(rid, std::string(reinterpret_cast<char *>(&counter),
+                                          sizeof(counter)));
+      mgr.unPinPage(file1, pageNo, true);
+    }
+    mgr.clearBufStats();
+    mgr.startBgWriter(BgWriterConfig(1, 64, 64, 0, 0.5));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (mgr.getBufStats().bgwrites < numPages &&
+           std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    mgr.stopBgWriter();
+    checkPassFail(mgr.getBufStats().bgwrites.load(), numPages);
+    checkPassFail(mgr.getBufStats().diskwrites.load(), numPages);
+
+    int numStale = 0;
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++) {
+      RecordId rid = {pageNo, 1};
+      Page page = file1->readPage(pageNo);
+      if (*reinterpret_cast<const int *>(page.getRecord(rid).data()) !=
+          (int)pageNo * 10)
+        numStale++;
+    }
+    checkPassFail(numStale, 0);
+
+    // still buffered: reading them again needs no disk read
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++) {
+      Page *page;
+      mgr.readPage(file1, pageNo, page);
+      mgr.unPinPage(file1, pageNo, false);
+    }
+    checkPassFail(mgr.getBufStats().diskreads.load(), 0);
+  }
+  deleteRelation();
+}
+
+int insertWithBgWriter(bool useBgWriter, int numKeys, int &foregroundWrites) {
+  BufMgr mgr(50);
+  if (useBgWriter) mgr.startBgWriter(BgWriterConfig(1));
+  int numRecords = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    BTreeIndex index(relationName, intIndexName, &mgr, offsetof(tuple, i),
+                     INTEGER);
+    int low = 0, high = numKeys;
+    index.startScan(&low, GTE, &high, LT);
+    try {
+      RecordId scanRid;
+      while (1) {
+        index.scanNext(scanRid);
+        numRecords++;
+      }
+    } catch (IndexScanCompletedException e) {
+    }
+    index.endScan();
+  }
+  std::chrono::duration<double> buildTime =
+      std::chrono::steady_clock::now() - start;
+  mgr.stopBgWriter();
+
+  const BufStats &stats = mgr.getBufStats();
+  foregroundWrites = stats.diskwrites - stats.bgwrites;
+  std::cout << "background writer:" << useBgWriter
+            << " foreground writes:" << foregroundWrites
+            << " background writes:" << stats.bgwrites
+            << " ms:" << (long)(buildTime.count() * 1000) << std::endl;
+  deleteIndexFile();
+  return numRecords;
+}
+
+void test18_io_backends() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test18_io_backends" << std::endl;
+
+  // Both backends must read back the same data, page by page, in batches and
+  // from several threads at once.
+  long streamChecksum = ioBackendBenchmark(STREAM_IO, 2000, 20000);
+  long preadChecksum = ioBackendBenchmark(PREAD_IO, 2000, 20000);
+  checkPassFail(streamChecksum, preadChecksum);
+  checkPassFail(File::defaultBackend(), PREAD_IO);
+}
+
+long ioBackendBenchmark(IOBackend backend, int numPages, int numOps) {
+  const char *name = backend == STREAM_IO ? "fstream" : "pread";
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+
+  // Every page holds one record with its page number and a version.
+  IOBackend oldBackend = File::defaultBackend();
+  File::setDefaultBackend(backend);
+  PageFile *file = new PageFile(relationName, true);
+  File::setDefaultBackend(oldBackend);
+  checkPassFail(file->backend(), backend);
+  std::vector<RecordId> rids(numPages + 1);
+  for (int i = 0; i < numPages; i++) {
+    int fields[2] = {i + 1, 0};
+    PageId pageNo;
+    Page page = file->allocatePage(pageNo);
+    rids[pageNo] = page.insertRecord(
+        std::string(reinterpret_cast<char *>(fields), sizeof(fields)));
+    file->writePage(pageNo, page);
+  }
+
+  unsigned int seed = 1;
+  int errors = 0;
+  long checksum = 0;
+
+  // Random single page reads.
+  auto start = std::chrono::steady_clock::now();
+  for (int op = 0; op < numOps; op++) {
+    PageId pageNo = 1 + rand_r(&seed) % numPages;
+    Page page = file->readPage(pageNo);
+    std::string record = page.getRecord(rids[pageNo]);
+    const int *fields = reinterpret_cast<const int *>(record.data());
+    if (fields[0] != (int)pageNo) errors++;
+    checksum += fields[0];
+  }
+  std::chrono::duration<double> readTime =
+      std::chrono::steady_clock::now() - start;
+
+  // Random single page writes, bumping the version.
+  start = std::chrono::steady_clock::now();
+  for (int op = 0; op < numOps; op++) {
+    PageId pageNo = 1 + rand_r(&seed) % numPages;
+    Page page = file->readPage(pageNo);
+    int fields[2];
+    std::memcpy(fields, page.getRecord(rids[pageNo]).data(), sizeof(fields));
+    fields[1]++;
+    page.updateRecord(rids[pageNo], std::string(reinterpret_cast<char *>(fields),
+                                                sizeof(fields)));
+    file->writePage(pageNo, page);
+  }
+  std::chrono::duration<double> writeTime =
+      std::chrono::steady_clock::now() - start;
+
+  // Sequential batches of consecutive pages.
+  const int batchSize = 64;
+  std::vector<Page> pages;
+  start = std::chrono::steady_clock::now();
+  for (int first = 1; first <= numPages; first += batchSize) {
+    int count = std::min(batchSize, numPages + 1 - first);
+    file->readPages(first, count, pages);
+    for (int i = 0; i < count; i++) {
+      std::string record = pages[i].getRecord(rids[first + i]);
+      const int *fields = reinterpret_cast<const int *>(record.data());
+      if (fields[0] != first + i) errors++;
+      checksum += 3 * fields[1];
+    }
+  }
+  std::chrono::duration<double> batchTime =
+      std::chrono::steady_clock::now() - start;
+
+  // Concurrent readers sharing the file.
+  const int numThreads = 4;
+  std::atomic<int> threadErrors(0);
+  std::vector<std::thread> threads;
+  start = std::chrono::steady_clock::now();
+  for (int t = 0; t < numThreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      unsigned int threadSeed = t + 1;
+      for (int op = 0; op < numOps / numThreads; op++) {
+        PageId pageNo = 1 + rand_r(&threadSeed) % numPages;
+        Page page = file->readPage(pageNo);
+        std::string record = page.getRecord(rids[pageNo]);
+        if (*reinterpret_cast<const int *>(record.data()) != (int)pageNo)
+          threadErrors++;
+      }
+    }));
+  }
+  for (std::thread &thread : threads) thread.join();
+  std::chrono::duration<double> concurrentTime =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << "backend:" << name
+            << " reads/sec:" << (long)(numOps / readTime.count())
+            << " writes/sec:" << (long)(numOps / writeTime.count())
+            << " batched pages/sec:" << (long)(numPages / batchTime.count())
+            << " concurrent reads/sec:"
+            << (long)(numOps / concurrentTime.count()) << std::endl;
+
+  delete file;
+  File::remove(relationName);
+  checkPassFail(errors + threadErrors, 0);
+  return checksum;
+}
+
+void test19_group_commit() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test19_group_commit" << std::endl;
+
+  // Creating a relation page by page must leave the same data on disk with
+  // and without batching the writes.
+  long expected = bulkCreate(PREAD_IO, false, 5000);
+  checkPassFail(bulkCreate(PREAD_IO, true, 5000), expected);
+  checkPassFail(bulkCreate(STREAM_IO, true, 5000), expected);
+
+  // Threads writing their own pages and syncing after every write share
+  // syncs.
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+  {
+    const int numThreads = 4, pagesPerThread = 50;
+    PageFile file(relationName, true);
+    file.setGroupCommit();
+    for (int i = 0; i < numThreads * pagesPerThread; i++) {
+      PageId pageNo;
+      Page page = file.allocatePage(pageNo);
+      page.insertRecord(std::string(reinterpret_cast<char *>(&i), sizeof(i)));
+      file.writePage(pageNo, page);
+    }
+    file.sync();
+    std::uint64_t syncsBefore = file.io().syncCalls();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+      threads.push_back(std::thread([&file, t, pagesPerThread]() {
+        for (int i = 0; i < pagesPerThread; i++) {
+          PageId pageNo = 1 + t * pagesPerThread + i;
+          Page page = file.readPage(pageNo);
+          page.updateRecord(page.begin().getCurrentRecord(),
+                            std::string("synced"));
+          file.writePage(pageNo, page);
+          file.sync();
+        }
+      }));
+    }
+    for (std::thread &thread : threads) thread.join();
+    std::uint64_t syncs = file.io().syncCalls() - syncsBefore;
+    std::cout << "sync requests:" << numThreads * pagesPerThread
+              << " syncs:" << syncs << std::endl;
+    checkPassFail((syncs <= (std::uint64_t)numThreads * pagesPerThread), true);
+  }
+  {
+    PageFile file(relationName, false);
+    int synced = 0;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      Page page = *iter;
+      if (page.getRecord(page.begin().getCurrentRecord()) == "synced")
+        synced++;
+    }
+    checkPassFail(synced, 4 * 50);
+  }
+  File::remove(relationName);
+}
+
+long bulkCreate(IOBackend backend, bool groupCommit, int numRecords) {
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+
+  IOBackend oldBackend = File::defaultBackend();
+  File::setDefaultBackend(backend);
+  std::uint64_t writeCalls, syncCalls;
+  auto start = std::chrono::steady_clock::now();
+  {
+    PageFile file(relationName, true);
+    if (groupCommit) file.setGroupCommit();
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    for (int i = 0; i < numRecords; i++) {
+      record1.i = i;
+      std::string data(reinterpret_cast<char *>(&record1), sizeof(record1));
+      while (true) {
+        try {
+          page.insertRecord(data);
+          break;
+        } catch (InsufficientSpaceException e) {
+          file.writePage(pageNo, page);
+          page = file.allocatePage(pageNo);
+        }
+      }
+    }
+    file.writePage(pageNo, page);
+    file.sync();
+    writeCalls = file.io().writeCalls();
+    syncCalls = file.io().syncCalls();
+  }
+  std::chrono::duration<double> createTime =
+      std::chrono::steady_clock::now() - start;
+  File::setDefaultBackend(oldBackend);
+
+  // read back through a freshly opened file
+  long checksum = 0;
+  int numFound = 0;
+  {
+    PageFile file(relationName, false);
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      Page page = *iter;
+      for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+        checksum += reinterpret_cast<const RECORD *>((*rec).data())->i;
+        numFound++;
+      }
+    }
+  }
+  File::remove(relationName);
+
+  std::cout << "backend:" << (backend == STREAM_IO ? "fstream" : "pread")
+            << " group commit:" << groupCommit << " write calls:" << writeCalls
+            << " syncs:" << syncCalls
+            << " ms:" << (long)(createTime.count() * 1000) << std::endl;
+  checkPassFail(numFound, numRecords);
+  return checksum;
+}
+
+void test20_append_pages() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test20_append_pages" << std::endl;
+
+  // Appending a page must not depend on the number of pages already in the
+  // file: loading 1M records takes a bounded number of reads per page.
+  checkPassFail(loadRecords(1000000), 1000000);
+
+  // The tail survives deleting pages and reopening the file.
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+  {
+    PageFile file(relationName, true);
+    PageId pageNo;
+    for (int i = 0; i < 10; i++) file.allocatePage(pageNo);
+    file.deletePage(10);
+    file.deletePage(9);
+  }
+  {
+    PageFile file(relationName, false);
+    PageId pageNo;
+    file.allocatePage(pageNo);  // reuses page 9 after the tail, page 8
+    file.allocatePage(pageNo);  // reuses page 10
+    file.allocatePage(pageNo);  // appends page 11
+    std::vector<PageId> pageNos;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+      pageNos.push_back((*iter).page_number());
+    checkPassFail(pageNos.size(), 11);
+    checkPassFail(pageNos.back(), 11);
+  }
+  File::remove(relationName);
+}
+
+int loadRecords(int numRecords) {
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+
+  int numPages = 0;
+  std::uint64_t reads;
+  auto start = std::chrono::steady_clock::now();
+  {
+    PageFile file(relationName, true);
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    numPages++;
+    for (int i = 0; i < numRecords; i++) {
+      record1.i = i;
+      std::string data(reinterpret_cast<char *>(&record1), sizeof(record1));
+      while (true) {
+        try {
+          page.insertRecord(data);
+          break;
+        } catch (InsufficientSpaceException e) {
+          file.writePage(pageNo, page);
+          page = file.allocatePage(pageNo);
+          numPages++;
+        }
+      }
+    }
+    file.writePage(pageNo, page);
+    reads = file.io().readCalls();
+  }
+  std::chrono::duration<double> loadTime =
+      std::chrono::steady_clock::now() - start;
+
+  int numFound = 0;
+  {
+    PageFile file(relationName, false);
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      Page page = *iter;
+      for (PageIterator rec = page.begin(); rec != page.end(); ++rec)
+        numFound++;
+    }
+  }
+  File::remove(relationName);
+
+  std::cout << "records:" << numRecords << " pages:" << numPages
+            << " reads per page:" << (double)reads / numPages
+            << " ms:" << (long)(loadTime.count() * 1000) << std::endl;
+  checkPassFail((reads <= 2 * (std::uint64_t)numPages), true);
+  return numFound;
+}
+
+void test21_free_space_map() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test21_free_space_map" << std::endl;
+
+  // Deleting a page does not walk the used list: deleting every page of a
+  // file in random order reads only the header of each page.
+  const int numPages = 20000;
+  std::uint64_t reads = deleteAllPages(numPages);
+  std::cout << "pages:" << numPages
+            << " reads per delete:" << (double)reads / numPages << std::endl;
+  checkPassFail(reads, (std::uint64_t)numPages);
+
+  // Space freed by deletes is reused by later inserts, also after reopening.
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+  const int numRecords = 20000;
+  std::vector<RecordId> rids;
+  int pagesAfterLoad;
+  {
+    HeapFile heap(relationName, bufMgr);
+    for (int i = 0; i < numRecords; i++) {
+      record1.i = i;
+      std::string data(reinterpret_cast<char *>(&record1), sizeof(record1));
+      rids.push_back(heap.insertRecord(data));
+    }
+    pagesAfterLoad = countPages(heap.getFile());
+
+    // delete every other record, then fill the holes again
+    for (int i = 0; i < numRecords; i += 2) heap.deleteRecord(rids[i]);
+    for (int i = 0; i < numRecords; i += 2) {
+      record1.i = i;
+      std::string data(reinterpret_cast<char *>(&record1), sizeof(record1));
+      rids[i] = heap.insertRecord(data);
+    }
+    checkPassFail(countPages(heap.getFile()), pagesAfterLoad);
+
+    // pages left empty are disposed of
+    for (int i = 0; i < numRecords; i++) {
+      if (rids[i].page_number % 2 == 0) {
+        heap.deleteRecord(rids[i]);
+        rids[i].page_number = Page::INVALID_NUMBER;
+      }
+    }
+    checkPassFail((countPages(heap.getFile()) < pagesAfterLoad), true);
+  }
+  {
+    HeapFile heap(relationName, bufMgr);
+    for (int i = 0; i < numRecords; i++) {
+      if (rids[i].page_number != Page::INVALID_NUMBER) continue;
+      record1.i = i;
+      std::string data(reinterpret_cast<char *>(&record1), sizeof(record1));
+      rids[i] = heap.insertRecord(data);
+    }
+    checkPassFail(countPages(heap.getFile()), pagesAfterLoad);
+
+    int numFound = 0;
+    for (int i = 0; i < numRecords; i++) {
+      std::string data = heap.getRecord(rids[i]);
+      if (reinterpret_cast<const RECORD *>(data.data())->i == i) numFound++;
+    }
+    checkPassFail(numFound, numRecords);
+
+    // deleting and inserting a record over and over moves its page between
+    // two free-space lists and back to the same page every time
+    const PageId churnPageNo = rids[1].page_number;
+    int numMoved = 0;
+    for (int cycle = 0; cycle < 100000; cycle++) {
+      heap.deleteRecord(rids[1]);
+      record1.i = 1;
+      std::string data(reinterpret_cast<char *>(&record1), sizeof(record1));
+      rids[1] = heap.insertRecord(data);
+      numMoved += rids[1].page_number != churnPageNo;
+    }
+    checkPassFail(numMoved, 0);
+    checkPassFail(countPages(heap.getFile()), pagesAfterLoad);
+  }
+  File::remove(relationName);
+  File::remove(relationName + HeapFile::FSM_SUFFIX);
+}
+
+std::uint64_t deleteAllPages(int numPages) {
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+
+  std::vector<PageId> pageNos;
+  for (PageId i = 1; i <= (PageId)numPages; i++) pageNos.push_back(i);
+  std::srand(21);
+  std::random_shuffle(pageNos.begin(), pageNos.end());
+
+  std::uint64_t reads;
+  {
+    PageFile file(relationName, true);
+    PageId pageNo;
+    for (int i = 0; i < numPages; i++) file.allocatePage(pageNo);
+
+    // free half the pages and take them back, so they are linked into the
+    // middle of the used list; each is put back with two reads at most
+    for (int i = 0; i < numPages / 2; i++) file.deletePage(pageNos[i]);
+    std::uint64_t before = file.io().readCalls();
+    for (int i = 0; i < numPages / 2; i++) file.allocatePage(pageNo);
+    checkPassFail((file.io().readCalls() - before <= (std::uint64_t)numPages),
+                  true);
+    PageId previous = Page::INVALID_NUMBER;
+    int numInOrder = 0;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      if (iter.page_number() > previous) numInOrder++;
+      previous = iter.page_number();
+    }
+    checkPassFail(numInOrder, numPages);
+  }
+  {
+    // the links are on disk, so a file just opened needs no warm-up
+    PageFile file(relationName, false);
+    std::uint64_t before = file.io().readCalls();
+    for (int i = 0; i < numPages; i++) file.deletePage(pageNos[i]);
+    reads = file.io().readCalls() - before;
+    checkPassFail((file.begin() == file.end()), true);
+  }
+  File::remove(relationName);
+  return reads;
+}
+
+int countPages(PageFile *file) {
+  int numPages = 0;
+  for (FileIterator iter = file->begin(); iter != file->end(); ++iter)
+    numPages++;
+  return numPages;
+}
+
+void test22_record_view() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test22_record_view" << std::endl;
+
+  // A view points at the record's bytes on the page instead of copying them.
+  Page page;
+  std::vector<RecordId> rids;
+  for (int i = 0; i < 50; i++) {
+    record1.i = i;
+    rids.push_back(page.insertRecord(
+        std::string(reinterpret_cast<char *>(&record1), sizeof(record1))));
+  }
+  const char *pageStart = reinterpret_cast<const char *>(&page);
+  int numInPlace = 0;
+  for (int i = 0; i < 50; i++) {
+    RecordView view = page.viewRecord(rids[i]);
+    if (view.data() >= pageStart && view.data() < pageStart + Page::SIZE &&
+        view == page.getRecord(rids[i]) &&
+        reinterpret_cast<const RECORD *>(view.data())->i == i)
+      numInPlace++;
+  }
+  checkPassFail(numInPlace, 50);
+
+  // The records of a file scan are viewed in the pinned page: consecutive
+  // records of a page are next to each other.
+  createRelationForward(relationSize);
+  int numFound = 0, numAdjacent = 0;
+  {
+    FileScan scan(relationName, bufMgr);
+    const char *previous = NULL;
+    try {
+      RecordId scanRid;
+      while (1) {
+        scan.scanNext(scanRid);
+        RecordView record = scan.getRecord();
+        if (record.size() == sizeof(RECORD) &&
+            reinterpret_cast<const RECORD *>(record.data())->i == numFound)
+          numFound++;
+        if (previous != NULL && std::abs(record.data() - previous) ==
+                                    (long)sizeof(RECORD))
+          numAdjacent++;
+        previous = record.data();
+      }
+    } catch (EndOfFileException e) {
+    }
+  }
+  deleteRelation();
+  std::cout << "records:" << numFound << " adjacent:" << numAdjacent
+            << std::endl;
+  checkPassFail(numFound, relationSize);
+  checkPassFail((numAdjacent > relationSize * 9 / 10), true);
+}
+
+void test23_read_into() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test23_read_into" << std::endl;
+
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+  {
+    PageFile file(relationName, true);
+    PageId pageNo;
+    for (int i = 0; i < 3; i++) {
+      Page page = file.allocatePage(pageNo);
+      record1.i = i;
+      page.insertRecord(
+          std::string(reinterpret_cast<char *>(&record1), sizeof(record1)));
+      file.writePage(pageNo, page);
+    }
+
+    // a page read in place matches one returned by value
+    Page page;
+    file.readPageInto(2, page);
+    Page copy = file.readPage(2);
+    checkPassFail((page.page_number() == 2 &&
+                   *page.begin() == *copy.begin()), true);
+
+    // pages are built from scratch, whatever the target held before
+    file.deletePage(2);
+    file.allocatePageInto(pageNo, page);
+    checkPassFail((pageNo == 2 && page.begin() == page.end()), true);
+    file.allocatePageInto(pageNo, page);
+    checkPassFail((pageNo == 4 && page.begin() == page.end()), true);
+
+    bool thrown = false;
+    try {
+      file.deletePage(4);
+      file.readPageInto(4, page);
+    } catch (InvalidPageException e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+  }
+  File::remove(relationName);
+
+  // Buffer misses read straight into the frame.
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+  {
+    PageFile file(relationName, true);
+    const int numPages = 2000;
+    PageId pageNo;
+    for (int i = 0; i < numPages; i++) {
+      Page page = file.allocatePage(pageNo);
+      record1.i = pageNo;
+      page.insertRecord(
+          std::string(reinterpret_cast<char *>(&record1), sizeof(record1)));
+      file.writePage(pageNo, page);
+    }
+    double latency = missLatency(&file, numPages, 5);
+    std::cout << "pages:" << numPages << " us per miss:" << latency
+              << std::endl;
+    checkPassFail((latency > 0), true);
+  }
+  File::remove(relationName);
+}
+
+double missLatency(PageFile *file, int numPages, int rounds) {
+  BufMgr mgr(10);
+  int numCorrect = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; round++) {
+    for (PageId pageNo = 1; pageNo <= (PageId)numPages; pageNo++) {
+      Page *page;
+      mgr.readPage(file, pageNo, page);
+      if (reinterpret_cast<const RECORD *>(page->begin().view().data())->i ==
+          (int)pageNo)
+        numCorrect++;
+      mgr.unPinPage(file, pageNo, false);
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  int misses = mgr.getBufStats().diskreads;
+  checkPassFail(numCorrect, numPages * rounds);
+  checkPassFail(misses, numPages * rounds);
+  return elapsed.count() * 1e6 / misses;
+}
+
+void test24_batch_scan() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test24_batch_scan" << std::endl;
+
+  createRelationForward(relationSize);
+  const long expected = (long)relationSize * (relationSize - 1) / 2;
+
+  // every record is returned once and in order, whatever the batch size
+  int numRecords, numBatches;
+  checkPassFail(batchScanSum(FileScan::DEFAULT_BATCH_SIZE, numRecords,
+                             numBatches), expected);
+  checkPassFail(numRecords, relationSize);
+  checkPassFail(batchScanSum(7, numRecords, numBatches), expected);
+  checkPassFail(numRecords, relationSize);
+  checkPassFail((numBatches >= relationSize / 7), true);
+  checkPassFail(batchScanSum(1, numRecords, numBatches), expected);
+  checkPassFail(numBatches, relationSize);
+
+  // batches and single records can be mixed, and the end of the file is
+  // reported by an empty batch, again and again
+  long sum = 0;
+  {
+    FileScan scan(relationName, bufMgr);
+    ScanRecord batch[3];
+    RecordId scanRid;
+    numRecords = 0;
+    while (true) {
+      try {
+        scan.scanNext(scanRid);
+      } catch (EndOfFileException e) {
+        break;
+      }
+      sum += reinterpret_cast<const RECORD *>(scan.getRecord().data())->i;
+      numRecords++;
+      std::size_t count = scan.scanNextBatch(batch, 3);
+      for (std::size_t i = 0; i < count; i++)
+        sum += reinterpret_cast<const RECORD *>(batch[i].record.data())->i;
+      numRecords += count;
+    }
+    checkPassFail(scan.scanNextBatch(batch, 3), 0);
+    checkPassFail(scan.scanNextBatch(batch, 3), 0);
+  }
+  checkPassFail(sum, expected);
+  checkPassFail(numRecords, relationSize);
+  deleteRelation();
+}
+
+long batchScanSum(std::size_t batchSize, int &numRecords, int &numBatches) {
+  std::vector<ScanRecord> batch(batchSize);
+  long sum = 0;
+  int numOutOfOrder = 0;
+  numRecords = numBatches = 0;
+  {
+    FileScan scan(relationName, bufMgr);
+    std::size_t count;
+    while ((count = scan.scanNextBatch(batch.data(), batchSize)) > 0) {
+      for (std::size_t i = 0; i < count; i++) {
+        int key = reinterpret_cast<const RECORD *>(batch[i].record.data())->i;
+        if (key != numRecords ||
+            batch[i].rid.page_number != batch[0].rid.page_number)
+          numOutOfOrder++;
+        sum += key;
+        numRecords++;
+      }
+      numBatches++;
+    }
+  }
+  checkPassFail(numOutOfOrder, 0);
+  return sum;
+}
+
+void test25_scan_pushdown() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test25_scan_pushdown" << std::endl;
+
+  createRelationForward(relationSize);
+  long sum;
+
+  // OR of int ranges
+  ScanPredicate ranges;
+  ranges.andInt(offsetof(RECORD, i), GTE, 100)
+      .andInt(offsetof(RECORD, i), LT, 200)
+      .orElse()
+      .andInt(offsetof(RECORD, i), GTE, relationSize - 10);
+  checkPassFail(pushdownScan(ranges, sum), 110);
+  checkPassFail(sum, 14950 + 10 * (relationSize - 10) + 45);
+
+  // double and string fields
+  ScanPredicate mixed;
+  mixed.andDouble(offsetof(RECORD, d), GT, 2500.5)
+      .andString(offsetof(RECORD, s), sizeof(record1.s), LT, "03000");
+  checkPassFail(pushdownScan(mixed, sum), 499);
+  ScanPredicate equal;
+  equal.andString(offsetof(RECORD, s), sizeof(record1.s), EQ,
+                  "00042 string record");
+  checkPassFail(pushdownScan(equal, sum), 1);
+  checkPassFail(sum, 42);
+  ScanPredicate none;
+  none.andInt(offsetof(RECORD, i), LT, 0);
+  checkPassFail(pushdownScan(none, sum), 0);
+  checkPassFail(pushdownScan(ScanPredicate(), sum), relationSize);
+
+  // a trailing orElse adds no term that matches everything
+  ScanPredicate trailing;
+  trailing.andInt(offsetof(RECORD, i), LT, 10).orElse();
+  checkPassFail(trailing.empty(), false);
+  checkPassFail(pushdownScan(trailing, sum), 10);
+  checkPassFail(sum, 45);
+  ScanPredicate trailingString;
+  trailingString
+      .andString(offsetof(RECORD, s), sizeof(record1.s), EQ,
+                 "00042 string record")
+      .orElse();
+  checkPassFail(pushdownScan(trailingString, sum), 1);
+
+  // the predicate applies to scanNext and scanNextBatch as well
+  {
+    FileScan scan(relationName, bufMgr);
+    ScanPredicate first;
+    first.andInt(offsetof(RECORD, i), LT, 10);
+    scan.setPredicate(first);
+    int numFound = 0;
+    try {
+      RecordId scanRid;
+      while (1) {
+        scan.scanNext(scanRid);
+        if (reinterpret_cast<const RECORD *>(scan.getRecord().data())->i ==
+            numFound)
+          numFound++;
+      }
+    } catch (EndOfFileException e) {
+    }
+    checkPassFail(numFound, 10);
+  }
+  {
+    FileScan scan(relationName, bufMgr);
+    ScanPredicate window;
+    window.andInt(offsetof(RECORD, i), GTE, 4000)
+        .andInt(offsetof(RECORD, i), LT, 4100);
+    scan.setPredicate(window);
+    ScanRecord batch[FileScan::DEFAULT_BATCH_SIZE];
+    std::size_t count;
+    int numFound = 0;
+    while ((count = scan.scanNextBatch(batch, FileScan::DEFAULT_BATCH_SIZE)) >
+           0) {
+      for (std::size_t i = 0; i < count; i++) {
+        int key = reinterpret_cast<const RECORD *>(batch[i].record.data())->i;
+        if (key >= 4000 && key < 4100) numFound++;
+      }
+    }
+    checkPassFail(numFound, 100);
+  }
+  deleteRelation();
+}
+
+int pushdownScan(const ScanPredicate &predicate, long &sum) {
+  struct Row {
+    int i;
+    double d;
+  };
+  const int batchSize = 64;
+  char rows[batchSize * sizeof(Row)];
+  RecordId rids[batchSize];
+  int numRows = 0, numWrong = 0;
+  sum = 0;
+  {
+    FileScan scan(relationName, bufMgr);
+    scan.setPredicate(predicate);
+    std::vector<ScanField> fields;
+    fields.push_back(ScanField{offsetof(RECORD, i), sizeof(int)});
+    fields.push_back(ScanField{offsetof(RECORD, d), sizeof(double)});
+    scan.setProjection(fields);
+    checkPassFail(scan.projectedWidth(), sizeof(int) + sizeof(double));
+
+    std::size_t count;
+    while ((count = scan.scanNextProjected(rows, rids, batchSize)) > 0) {
+      for (std::size_t r = 0; r < count; r++) {
+        int key;
+        double d;
+        std::memcpy(&key, rows + r * scan.projectedWidth(), sizeof(int));
+        std::memcpy(&d, rows + r * scan.projectedWidth() + sizeof(int),
+                    sizeof(double));
+        if (d != (double)key || rids[r].page_number == Page::INVALID_NUMBER)
+          numWrong++;
+        sum += key;
+        numRows++;
+      }
+    }
+  }
+  checkPassFail(numWrong, 0);
+  return numRows;
+}
+
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+// ######################      Error Tests      ######################## //
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+
+void test9_error_test() {
+  std::cout << "Error handling tests" << std::endl;
+  std::cout << "--------------------" << std::endl;
+  // Given error test
+
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for (int i = 0; i < 10; i++) {
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i;
+    record1.d = (double)i;
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+    while (1) {
+      try {
+        new_page.insertRecord(new_data);
+        break;
+      } catch (InsufficientSpaceException e) {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+
+  file1->writePage(new_page_number, new_page);
+
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  int int2 = 2;
+  int int5 = 5;
+
+  // Scan Tests
+  std::cout << "Call endScan before startScan" << std::endl;
+  try {
+    index.endScan();
+    std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+  } catch (ScanNotInitializedException e) {
+    std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
+  }
+
+  std::cout << "Call scanNext before startScan" << std::endl;
+  try {
+    RecordId foo;
+    index.scanNext(foo);
+    std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
+  } catch (ScanNotInitializedException e) {
+    std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+  }
+
+  std::cout << "Scan with bad lowOp" << std::endl;
+  try {
+    index.startScan(&int2, LTE, &int5, LTE);
+    std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
+  } catch (BadOpcodesException e) {
+    std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+  }
+
+  std::cout << "Scan with bad highOp" << std::endl;
+  try {
+    index.startScan(&int2, GTE, &int5, GTE);
+    std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+  } catch (BadOpcodesException e) {
+    std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
+  }
+
+  std::cout << "Scan with bad range" << std::endl;
+  try {
+    index.startScan(&int5, GTE, &int2, LTE);
+    std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
+  } catch (BadScanrangeException e) {
+    std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+  }
+
+  deleteRelation();
+}
+
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+// ######################         Helper        ######################## //
+// ##################################################################### //
+// ##################################################################### //
+// ##################################################################### //
+void indexTests() {
+  intTests();
+  deleteIndexFile();
+}
+
+void deleteRelation() {
+  if (file1) {
+    bufMgr->flushFile(file1);
+    delete file1;
+    file1 = NULL;
+  }
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+}
+
+void deleteIndexFile() {
+  try {
+    File::remove(intIndexName);
+  } catch (FileNotFoundException e) {
+  }
+
+  try {
+    File::remove(doubleIndexName);
+  } catch (FileNotFoundException e) {
+  }
+
+  try {
+    File::remove(stringIndexName);
+  } catch (FileNotFoundException e) {
+  }
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp) {
+  std::cout << "Scan for " << (lowOp == GT ? "(" : "[") << lowVal << ","
+            << highVal << (highOp == LT ? ")" : "]") << std::endl;
+  return countScan(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp) {
+  char lowValStr[100];
+  sprintf(lowValStr, "%05d string record", lowVal);
+  char highValStr[100];
+  sprintf(highValStr, "%05d string record", highVal);
+
+  std::cout << "Scan for " << (lowOp == GT ? "(" : "[") << lowValStr << ","
+            << highValStr << (highOp == LT ? ")" : "]") << std::endl;
+  return countScan(index, lowValStr, lowOp, highValStr, highOp);
+}
+
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp,
+              const void *highVal, Operator highOp) {
+  RecordId scanRid;
+  int numResults = 0;
+
+  try {
+    index->startScan(lowVal, lowOp, highVal, highOp);
+  } catch (NoSuchKeyFoundException e) {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  while (1) {
+    try {
+      index->scanNext(scanRid);
+    } catch (IndexScanCompletedException e) {
+      break;
+    }
+    numResults++;
+  }
+  index->endScan();
+  std::cout << "Number of results: " << numResults << std::endl;
+
+  return numResults;
+}
+
+int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+            Operator highOp, std::vector<int> *ret_vector) {
+  RecordId scanRid;
+  Page *curPage;
+
+  std::cout << "Scan for ";
+  if (lowOp == GT) {
+    std::cout << "(";
+  } else {
+    std::cout << "[";
+  }
+  std::cout << lowVal << "," << highVal;
+  if (highOp == LT) {
+    std::cout << ")";
+  } else {
+    std::cout << "]";
+  }
+  std::cout << std::endl;
+
+  int numResults = 0;
+
+  try {
+    index->startScan(&lowVal, lowOp, &highVal, highOp);
+  } catch (NoSuchKeyFoundException e) {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  while (1) {
+    try {
+      index->scanNext(scanRid);
+      bufMgr->readPage(file1, scanRid.page_number, curPage);
+      RECORD myRec = *(reinterpret_cast<const RECORD *>(
+          curPage->viewRecord(scanRid).data()));
+      bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+      if (ret_vector) ret_vector->push_back(myRec.i);
+
+      if (numResults < 5) {
+        std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+        std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s
+                  << ":" << std::endl;
+      } else if (numResults == 5) {
+        std::cout << "..." << std::endl;
+      }
+    } catch (IndexScanCompletedException e) {
+      break;
+    }
+
+    numResults++;
+  }
+
+  if (numResults >= 5) {
     std::cout << "Number of results: " << numResults << std::endl;
   }
-  index->endScan();
-  std::cout << std::endl;
+  index->endScan();
+  std::cout << std::endl;
+
+  return numResults;
+}
+
+void test26_simd_filter() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test26_simd_filter" << std::endl;
+
+  std::vector<Page> pages = filterPages(40);
+  const FilterKernel kernels[] = {SCALAR_FILTER, SSE42_FILTER, AVX2_FILTER};
+  const double infinity = std::numeric_limits<double>::infinity();
+
+  struct IntRange {
+    int low;
+    Operator lowOp;
+    int high;
+    Operator highOp;
+  };
+  const IntRange intRanges[] = {
+      {-100, GTE, 100, LT},       {7, GTE, 7, LTE},
+      {-1000, GT, -1000, LTE},    {INT_MIN, GTE, INT_MAX, LTE},
+      {INT_MAX, GT, INT_MAX, LTE}, {INT_MIN, GT, INT_MIN + 1, LT},
+      {500, GT, INT_MAX, LTE}};
+  struct DoubleRange {
+    double low;
+    Operator lowOp;
+    double high;
+    Operator highOp;
+  };
+  const DoubleRange doubleRanges[] = {
+      {-0.5, GTE, 0.5, LTE},          {-infinity, GTE, 10.25, LT},
+      {-infinity, GT, infinity, LT},  {-infinity, GTE, infinity, LTE},
+      {100.25, GT, 100.25, LTE},      {1e300, GT, infinity, LTE}};
+
+  // every kernel selects exactly the records the predicate matches, skipping
+  // deleted slots, records too short for the field and NaN
+  int numMismatches = 0;
+  std::size_t numSelected = 0;
+  std::vector<std::uint64_t> selection;
+  for (const Page &page : pages) {
+    selection.resize(PageFilter::selectionWords(page));
+    for (FilterKernel kernel : kernels) {
+      for (const IntRange &range : intRanges) {
+        ScanPredicate reference;
+        reference.andInt(offsetof(RECORD, i), range.lowOp, range.low)
+            .andInt(offsetof(RECORD, i), range.highOp, range.high);
+        std::size_t count = PageFilter::selectInt(
+            page, offsetof(RECORD, i), range.low, range.lowOp, range.high,
+            range.highOp, selection.data(), kernel);
+        numMismatches += selectionMismatches(page, reference, selection, count);
+        numSelected += count;
+      }
+      for (const DoubleRange &range : doubleRanges) {
+        ScanPredicate reference;
+        reference.andDouble(offsetof(RECORD, d), range.lowOp, range.low)
+            .andDouble(offsetof(RECORD, d), range.highOp, range.high);
+        std::size_t count = PageFilter::selectDouble(
+            page, offsetof(RECORD, d), range.low, range.lowOp, range.high,
+            range.highOp, selection.data(), kernel);
+        numMismatches += selectionMismatches(page, reference, selection, count);
+        numSelected += count;
+      }
+    }
+  }
+  checkPassFail(numMismatches, 0);
+  checkPassFail((numSelected > 0), true);
+
+  // whole predicates, as FileScan evaluates them
+  int numPredicateMismatches = 0;
+  ScanPredicate predicate;
+  predicate.andInt(offsetof(RECORD, i), GTE, -50)
+      .andDouble(offsetof(RECORD, d), LT, 0)
+      .orElse()
+      .andInt(offsetof(RECORD, i), EQ, 999)
+      .orElse()
+      .andDouble(offsetof(RECORD, d), GT, 900.75);
+  ScanPredicate unsupported;
+  unsupported.andInt(offsetof(RECORD, i), NE, 0);
+  for (const Page &page : pages) {
+    checkPassFail(predicate.selectSlots(page, selection), true);
+    std::size_t count = 0;
+    for (std::uint64_t word : selection)
+      count += __builtin_popcountll(word);
+    numPredicateMismatches +=
+        selectionMismatches(page, predicate, selection, count);
+  }
+  checkPassFail(numPredicateMismatches, 0);
+  checkPassFail(unsupported.selectSlots(pages[0], selection), false);
+
+  // a file scan gets the same records through the kernels
+  createRelationForward(relationSize);
+  long sum;
+  ScanPredicate window;
+  window.andDouble(offsetof(RECORD, d), GTE, 1000.5)
+      .andInt(offsetof(RECORD, i), LTE, 1100);
+  checkPassFail(pushdownScan(window, sum), 100);
+  checkPassFail(sum, 105050);
+  deleteRelation();
+
+  // microbenchmark of a double range against the record at a time loop
+  const int rounds = 200;
+  const char *kernelNames[] = {"scalar", "sse4.2", "avx2"};
+  std::size_t numRecords = 0;
+  for (Page &page : pages)
+    for (PageIterator iter = page.begin(); iter != page.end(); iter++)
+      numRecords++;
+  std::size_t loopSelected, kernelSelected;
+  ScanPredicate range;
+  range.andDouble(offsetof(RECORD, d), GTE, -250.5)
+      .andDouble(offsetof(RECORD, d), LT, 250.5);
+  const double loopNanos =
+      matchLoopNanos(pages, range, rounds, loopSelected) / numRecords;
+  std::cout << "record loop ns per record:" << loopNanos << std::endl;
+  for (FilterKernel kernel : kernels) {
+    const double nanos =
+        filterNanos(pages, kernel, rounds, kernelSelected) / numRecords;
+    std::cout << kernelNames[kernel] << " kernel ns per record:" << nanos
+              << " speedup:" << loopNanos / nanos << std::endl;
+    checkPassFail(kernelSelected, loopSelected);
+  }
+  std::cout << "best kernel:" << kernelNames[PageFilter::bestKernel()]
+            << std::endl;
+}
+
+std::vector<Page> filterPages(int numPages) {
+  std::vector<Page> pages(numPages);
+  std::srand(26);
+  for (Page &page : pages) {
+    std::vector<RecordId> rids;
+    for (int n = 0;; n++) {
+      RECORD rec;
+      std::memset(&rec, 0, sizeof(rec));
+      rec.i = std::rand() % 2001 - 1000;
+      rec.d = rec.i + 0.25;
+      if (n % 31 == 0) rec.i = n % 2 ? INT_MAX : INT_MIN;
+      if (n % 13 == 0) rec.d = std::nan("");
+      if (n % 29 == 0) rec.d = n % 2 ? std::numeric_limits<double>::infinity()
+                                     : -std::numeric_limits<double>::infinity();
+      // some records hold the int but not the double
+      std::size_t length = n % 17 == 0 ? offsetof(RECORD, d) : sizeof(rec);
+      std::string data(reinterpret_cast<const char *>(&rec), length);
+      if (!page.hasSpaceForRecord(data)) break;
+      rids.push_back(page.insertRecord(data));
+    }
+    for (std::size_t r = 0; r < rids.size(); r += 5)
+      page.deleteRecord(rids[r]);
+  }
+  return pages;
+}
+
+int selectionMismatches(const Page &page, const ScanPredicate &reference,
+                        const std::vector<std::uint64_t> &selection,
+                        std::size_t count) {
+  std::vector<std::uint64_t> expected(selection.size(), 0);
+  std::size_t numExpected = 0;
+  Page &records = const_cast<Page &>(page);
+  for (PageIterator iter = records.begin(); iter != records.end(); iter++) {
+    RecordView record = iter.view();
+    if (reference.matches(record.data(), record.size())) {
+      SlotId bit = iter.getCurrentRecord().slot_number - 1;
+      expected[bit / 64] |= 1ULL << (bit % 64);
+      numExpected++;
+    }
+  }
+  int numMismatches = count == numExpected ? 0 : 1;
+  for (std::size_t w = 0; w < selection.size(); w++)
+    numMismatches += __builtin_popcountll(selection[w] ^ expected[w]);
+  return numMismatches;
+}
+
+double filterNanos(const std::vector<Page> &pages, FilterKernel kernel,
+                   int rounds, std::size_t &numSelected) {
+  std::vector<std::uint64_t> selection;
+  numSelected = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; round++) {
+    for (const Page &page : pages) {
+      selection.resize(PageFilter::selectionWords(page));
+      std::size_t count = PageFilter::selectDouble(
+          page, offsetof(RECORD, d), -250.5, GTE, 250.5, LT, selection.data(),
+          kernel);
+      if (round == 0) numSelected += count;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() * 1e9 / rounds;
+}
+
+double matchLoopNanos(const std::vector<Page> &pages,
+                      const ScanPredicate &predicate, int rounds,
+                      std::size_t &numSelected) {
+  numSelected = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; round++) {
+    for (const Page &page : pages) {
+      Page &records = const_cast<Page &>(page);
+      std::size_t count = 0;
+      for (PageIterator iter = records.begin(); iter != records.end(); iter++) {
+        RecordView record = iter.view();
+        if (predicate.matches(record.data(), record.size())) count++;
+      }
+      if (round == 0) numSelected += count;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() * 1e9 / rounds;
+}
+
+void test27_parallel_scan() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test27_parallel_scan" << std::endl;
+
+  // the workers visit exactly the used pages, also after pages in the
+  // middle are deleted and reused
+  try {
+    File::remove(relationName);
+  } catch (FileNotFoundException e) {
+  }
+  const std::string record(16, 'r');
+  std::vector<PageId> usedPageNos;
+  {
+    PageFile file(relationName, true);
+    for (int i = 0; i < 20; i++) {
+      PageId pageNo;
+      Page page = file.allocatePage(pageNo);
+      page.insertRecord(record);
+      file.writePage(pageNo, page);
+    }
+    file.deletePage(1);
+    file.deletePage(7);
+    file.deletePage(8);
+    file.deletePage(20);
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+      usedPageNos.push_back((*iter).page_number());
+  }
+  checkPassFail(usedPageNos.size(), 16);
+  checkPassFail((scannedPages(1) == usedPageNos), true);
+  checkPassFail((scannedPages(4) == usedPageNos), true);
+  {
+    PageFile file(relationName, false);
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    page.insertRecord(record);
+    file.writePage(pageNo, page);
+    usedPageNos.push_back(pageNo);
+    std::sort(usedPageNos.begin(), usedPageNos.end());
+  }
+  checkPassFail((scannedPages(4) == usedPageNos), true);
+  File::remove(relationName);
+
+  createRelationForward(relationSize);
+  const long expected = (long)relationSize * (relationSize - 1) / 2;
+
+  // every record is passed on once, whatever the number of workers and the
+  // size of the morsels
+  int numRecords;
+  const int workerCounts[] = {1, 2, 4, 8};
+  for (int numWorkers : workerCounts) {
+    checkPassFail(parallelScanSum(numWorkers, ParallelScan::DEFAULT_MORSEL_PAGES,
+                                  ScanPredicate(), numRecords),
+                  expected);
+    checkPassFail(numRecords, relationSize);
+    checkPassFail(parallelScanSum(numWorkers, 1, ScanPredicate(), numRecords),
+                  expected);
+    checkPassFail(numRecords, relationSize);
+  }
 
-  return numResults;
-}
\ No newline at end of file
+  ScanPredicate window;
+  window.andInt(offsetof(RECORD, i), GTE, 4000)
+      .andInt(offsetof(RECORD, i), LT, 4100);
+  checkPassFail(parallelScanSum(4, 2, window, numRecords),
+                100 * 4000 + 99 * 100 / 2);
+  checkPassFail(numRecords, 100);
+
+  // a slow worker has its morsels stolen by the others
+  {
+    ParallelScan scan(relationName, bufMgr, 4);
+    scan.setMorselPages(2);
+    std::vector<int> perWorker(scan.numWorkers(), 0);
+    std::size_t total = scan.run(
+        [&perWorker](int worker, const ScanRecord *, std::size_t count) {
+          if (worker == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+          perWorker[worker] += count;
+        });
+    checkPassFail(total, (std::size_t)relationSize);
+    checkPassFail((perWorker[0] < relationSize / 4), true);
+  }
+
+  // an exception thrown by the consumer stops the scan, leaving no page
+  // pinned, and is rethrown by run
+  {
+    ParallelScan scan(relationName, bufMgr, 4);
+    std::atomic<int> numBatches(0);
+    bool thrown = false;
+    try {
+      scan.run([&numBatches](int, const ScanRecord *, std::size_t) {
+        if (++numBatches == 2) throw std::runtime_error("consumer failed");
+      });
+    } catch (const std::runtime_error &e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+  }
+  checkPassFail(parallelScanSum(2, 4, ScanPredicate(), numRecords), expected);
+
+  // the bulk build reads the relation with a parallel scan
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(RECORD, i),
+                     INTEGER, BULK_BUILD);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14);
+    checkPassFail(intScan(&index, -3, GT, relationSize + 3, LT), relationSize);
+  }
+  deleteIndexFile();
+
+  const int numWorkers = ParallelScan::defaultWorkers();
+  auto start = std::chrono::steady_clock::now();
+  parallelScanSum(1, ParallelScan::DEFAULT_MORSEL_PAGES, ScanPredicate(),
+                  numRecords);
+  std::chrono::duration<double> serial = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  parallelScanSum(numWorkers, ParallelScan::DEFAULT_MORSEL_PAGES,
+                  ScanPredicate(), numRecords);
+  std::chrono::duration<double> parallel =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "workers:1 ms:" << serial.count() * 1000 << std::endl;
+  std::cout << "workers:" << numWorkers << " ms:" << parallel.count() * 1000
+            << std::endl;
+
+  // the workers skip free pages in the middle of the relation
+  {
+    int numDeleted = 0;
+    {
+      PageFile file(relationName, false);
+      for (PageId pageNo = 2; pageNo < 6; pageNo++) {
+        Page page = file.readPage(pageNo);
+        for (PageIterator iter = page.begin(); iter != page.end(); iter++)
+          numDeleted++;
+        file.deletePage(pageNo);
+      }
+    }
+    ParallelScan scan(relationName, bufMgr, 4);
+    scan.setMorselPages(2);
+    std::size_t total =
+        scan.run([](int, const ScanRecord *, std::size_t) {});
+    checkPassFail(total, (std::size_t)(relationSize - numDeleted));
+  }
+  deleteRelation();
+}
+
+long parallelScanSum(int numWorkers, std::size_t morselPages,
+                     const ScanPredicate &predicate, int &numRecords) {
+  // each key is seen by one worker only, so the flags need no latch
+  std::vector<char> seen(relationSize, 0);
+  std::vector<long> sums(numWorkers, 0);
+  int numDuplicates = 0;
+  std::atomic<int> numBad(0);
+  std::size_t total;
+  {
+    ParallelScan scan(relationName, bufMgr, numWorkers);
+    scan.setMorselPages(morselPages);
+    scan.setPredicate(predicate);
+    checkPassFail(scan.numWorkers(), numWorkers);
+    total = scan.run([&](int worker, const ScanRecord *batch, std::size_t count) {
+      for (std::size_t i = 0; i < count; i++) {
+        const RECORD *rec =
+            reinterpret_cast<const RECORD *>(batch[i].record.data());
+        if (rec->i < 0 || rec->i >= relationSize ||
+            batch[i].rid.page_number != batch[0].rid.page_number) {
+          numBad++;
+          continue;
+        }
+        seen[rec->i]++;
+        sums[worker] += rec->i;
+      }
+    });
+  }
+  numRecords = 0;
+  for (char times : seen) {
+    if (times > 1) numDuplicates++;
+    numRecords += times;
+  }
+  checkPassFail(numBad.load(), 0);
+  checkPassFail(numDuplicates, 0);
+  checkPassFail(total, (std::size_t)numRecords);
+  long sum = 0;
+  for (long part : sums) sum += part;
+  return sum;
+}
+
+std::vector<PageId> scannedPages(int numWorkers) {
+  std::vector<std::vector<PageId> > perWorker(numWorkers);
+  {
+    ParallelScan scan(relationName, bufMgr, numWorkers);
+    scan.setMorselPages(2);
+    scan.run([&perWorker](int worker, const ScanRecord *batch,
+                          std::size_t count) {
+      for (std::size_t i = 0; i < count; i++)
+        perWorker[worker].push_back(batch[i].rid.page_number);
+    });
+  }
+  std::vector<PageId> pageNos;
+  for (const std::vector<PageId> &pages : perWorker)
+    pageNos.insert(pageNos.end(), pages.begin(), pages.end());
+  std::sort(pageNos.begin(), pageNos.end());
+  return pageNos;
+}
+
+void test28_external_sort() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test28_external_sort" << std::endl;
+
+  // nothing added, nothing returned
+  int numOutOfOrder;
+  checkPassFail(externalSortCheck(2, 0, 100, 4, numOutOfOrder), 0);
+  checkPassFail(numOutOfOrder, 0);
+
+  // runs kept in memory only
+  checkPassFail(externalSortCheck(4, 5000, 10000, 4, numOutOfOrder), 0);
+  checkPassFail(numOutOfOrder, 0);
+
+  // 40 runs spilled by four writers, merged three at a time: more than one
+  // merge pass writes runs of its own
+  checkPassFail((externalSortCheck(4, 40000, 1000, 3, numOutOfOrder) > 40),
+                true);
+  checkPassFail(numOutOfOrder, 0);
+
+  // a run longer than a page, merged sixteen at a time
+  checkPassFail((externalSortCheck(1, 30000, 2000, 16, numOutOfOrder) >= 15),
+                true);
+  checkPassFail(numOutOfOrder, 0);
+
+  // the bulk build sorts the pairs with an external sort
+  createRelationRandom(relationSize);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(RECORD, i),
+                     INTEGER, BULK_BUILD);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14);
+    checkPassFail(intScan(&index, 996, GTE, 1000, LTE), 5);
+    checkPassFail(intScan(&index, -3, GT, relationSize + 3, LT), relationSize);
+  }
+  checkPassFail(File::exists(intIndexName + ".sort"), false);
+  deleteIndexFile();
+  deleteRelation();
+}
+
+/**
+ * Sorts numEntries random pairs, added from numWriters threads at once, and
+ * checks every pair comes back once and in order. Returns the number of runs
+ * spilled.
+ */
+std::size_t externalSortCheck(int numWriters, int numEntries,
+                              std::size_t runEntries, std::size_t fanIn,
+                              int &numOutOfOrder) {
+  const std::string tempName = "relA.sort";
+  std::vector<long> sums(numWriters, 0);
+  std::size_t numSpilled;
+  numOutOfOrder = 0;
+  {
+    ExternalSort<int> sorter(bufMgr, tempName, numWriters, runEntries, fanIn);
+    std::vector<std::thread> threads;
+    for (int w = 0; w < numWriters; w++)
+      threads.push_back(std::thread([&, w]() {
+        // few distinct keys, so the record ids break many ties
+        for (int i = w; i < numEntries; i += numWriters) {
+          RIDKeyPair<int> entry;
+          RecordId rid;
+          rid.page_number = i / 100 + 1;
+          rid.slot_number = i % 100 + 1;
+          entry.set(rid, (int)((i * 2654435761u) % 997) - 500);
+          sorter.add(w, entry);
+          sums[w] += entry.key;
+        }
+      }));
+    for (std::thread &thread : threads) thread.join();
+    sorter.finish();
+    checkPassFail(sorter.size(), (std::size_t)numEntries);
+
+    long sum = 0;
+    for (long part : sums) sum += part;
+    std::vector<char> seen(numEntries, 0);
+    int numReturned = 0;
+    int numDuplicates = 0;
+    RIDKeyPair<int> prev;
+    RIDKeyPair<int> entry;
+    while (sorter.next(entry)) {
+      if (numReturned > 0 && entry < prev) numOutOfOrder++;
+      const int i = (entry.rid.page_number - 1) * 100 + entry.rid.slot_number - 1;
+      if (seen[i]++) numDuplicates++;
+      sum -= entry.key;
+      prev = entry;
+      numReturned++;
+    }
+    checkPassFail(numReturned, numEntries);
+    checkPassFail(numDuplicates, 0);
+    checkPassFail(sum, 0);
+    checkPassFail(sorter.next(entry), false);
+    numSpilled = sorter.numSpilledRuns();
+  }
+  checkPassFail(File::exists(tempName), false);
+  return numSpilled;
+}
+
+void test29_typed_keys() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test29_typed_keys" << std::endl;
+
+  // string keys order bytewise, like memcmp, cut off at STRINGSIZE bytes and
+  // padded with zero bytes
+  const char *strings[] = {"",          "a",          "ab",
+                           "abc",       "b",          "\xff",
+                           "a\xff",     "abcdefghij", "abcdefghik",
+                           "abcdefghijk", "abcdefghi",  "00042 string"};
+  const int numStrings = sizeof(strings) / sizeof(strings[0]);
+  int numWrong = 0;
+  for (int i = 0; i < numStrings; i++) {
+    for (int j = 0; j < numStrings; j++) {
+      char a[STRINGSIZE] = {};
+      char b[STRINGSIZE] = {};
+      strncpy(a, strings[i], STRINGSIZE);
+      strncpy(b, strings[j], STRINGSIZE);
+      const int cmp = memcmp(a, b, STRINGSIZE);
+      const StringKey x = StringKey::fromString(strings[i]);
+      const StringKey y = StringKey::fromString(strings[j]);
+      if ((x < y) != (cmp < 0) || (x == y) != (cmp == 0)) numWrong++;
+    }
+  }
+  checkPassFail(numWrong, 0);
+  const std::string longString(STRINGSIZE, 'x');
+  checkPassFail((StringKey::fromString(longString.c_str()) ==
+                 StringKey::fromString((longString + "y").c_str())),
+                true);
+  checkPassFail((StringKey::fromString(longString.substr(1).c_str()) <
+                 StringKey::fromString(longString.c_str())),
+                true);
+
+  // double and string indexes, built by inserting and by bulk loading
+  const BuildMode buildModes[] = {INSERT_BUILD, BULK_BUILD};
+  for (BuildMode buildMode : buildModes) {
+    createRelationRandom();
+    doubleTests(buildMode);
+    stringTests(buildMode);
+
+    // reopened from the meta page
+    doubleTests(buildMode);
+    stringTests(buildMode);
+    deleteIndexFile();
+    deleteRelation();
+  }
+
+  // enough keys for the inserts to split the leaves many times
+  createRelationRandom(50000);
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
+    checkPassFail(doubleScan(&index, 12345, GTE, 23456, LTE), 11112);
+    checkPassFail(doubleScan(&index, -1, GT, 50000, LT), 50000);
+  }
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+    checkPassFail(stringScan(&index, 12345, GTE, 23456, LTE), 11112);
+    checkPassFail(stringScan(&index, -1, GT, 50000, LT), 50000);
+
+    // pairs bulk loaded into an index must have its type of key
+    std::vector<RIDKeyPair<int> > entries(1);
+    bool thrown = false;
+    try {
+      index.bulkLoad(entries);
+    } catch (BadIndexInfoException e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+  }
+  deleteIndexFile();
+  deleteRelation();
+
+  // keys sharing a long prefix are told apart by the bytes after it
+  createRelationForward();
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+    char key[64] = {};
+    for (int i = 0; i < 1000; i++) {
+      sprintf(key, "shared prefix of many keys %05d", i);
+      RecordId keyRid;
+      keyRid.page_number = 1;
+      keyRid.slot_number = i;
+      index.insertEntry(key, keyRid);
+    }
+    char low[64] = {};
+    char high[64] = {};
+    sprintf(low, "shared prefix of many keys %05d", 100);
+    sprintf(high, "shared prefix of many keys %05d", 199);
+    checkPassFail(countScan(&index, low, GTE, high, LTE), 100);
+    checkPassFail(countScan(&index, low, GT, high, LT), 98);
+    checkPassFail(countScan(&index, low, GTE, low, LTE), 1);
+    sprintf(low, "shared prefix of many keys");
+    sprintf(high, "shared prefix of many keys 99999");
+    checkPassFail(countScan(&index, low, GT, high, LT), 1000);
+  }
+  deleteIndexFile();
+  deleteRelation();
+}
+
+void test30_node_counts() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test30_node_counts" << std::endl;
+
+  // the entry counts of the leaves add up to the number of records, and no
+  // leaf holds more than fits
+  int numBadLeaves;
+  const BuildMode buildModes[] = {INSERT_BUILD, BULK_BUILD};
+  for (BuildMode buildMode : buildModes) {
+    createRelationRandom();
+    {
+      BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                       INTEGER, buildMode);
+    }
+    checkPassFail(countLeafEntries(intIndexName, numBadLeaves), relationSize);
+    checkPassFail(numBadLeaves, 0);
+    deleteIndexFile();
+    deleteRelation();
+  }
+
+  // a RecordId of {0, 0} is an entry like any other
+  createRelationForward();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    RecordId zeroRid;
+    zeroRid.page_number = 0;
+    zeroRid.slot_number = 0;
+    for (int key = -10; key < 0; key++) index.insertEntry(&key, zeroRid);
+    int low = -20;
+    int high = -5;
+    checkPassFail(countScan(&index, &low, GT, &high, LT), 5);
+    high = 3;
+    checkPassFail(countScan(&index, &low, GT, &high, LTE), 14);
+  }
+  checkPassFail(countLeafEntries(intIndexName, numBadLeaves),
+                relationSize + 10);
+  checkPassFail(numBadLeaves, 0);
+
+  // enough ascending inserts to split non-leaf nodes, each key still found
+  deleteIndexFile();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int numKeys = 400000;
+    for (int key = relationSize; key < numKeys; key++) {
+      RecordId rid;
+      rid.page_number = key / 100 + 1;
+      rid.slot_number = key % 100 + 1;
+      index.insertEntry(&key, rid);
+    }
+    int numMissing = 0;
+    for (int key = 0; key < numKeys; key += 997)
+      numMissing += countScan(&index, &key, GTE, &key, LTE) != 1;
+    checkPassFail(numMissing, 0);
+  }
+  checkPassFail(countLeafEntries(intIndexName, numBadLeaves), 400000);
+  checkPassFail(numBadLeaves, 0);
+
+  // an index written in another format version is not opened
+  {
+    BlobFile indexFile(intIndexName, false);
+    const PageId metaPageNo = indexFile.getFirstPageNo();
+    Page metaPage = indexFile.readPage(metaPageNo);
+    IndexMetaInfo *meta = reinterpret_cast<IndexMetaInfo *>(&metaPage);
+    checkPassFail(meta->formatVersion, INDEX_FORMAT_VERSION);
+    meta->formatVersion = INDEX_FORMAT_VERSION - 1;
+    indexFile.writePage(metaPageNo, metaPage);
+  }
+  bool thrown = false;
+  try {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  } catch (BadIndexInfoException e) {
+    thrown = true;
+  }
+  checkPassFail(thrown, true);
+  deleteIndexFile();
+  deleteRelation();
+}
+
+/**
+ * Walks the leaves of a closed INTEGER index, reading its file directly, and
+ * returns the sum of their entry counts. Counts the leaves whose count is out
+ * of range or whose keys are out of order.
+ */
+int countLeafEntries(const std::string &indexName, int &numBadLeaves) {
+  BlobFile indexFile(indexName, false);
+  Page page = indexFile.readPage(indexFile.getFirstPageNo());
+  PageId pageNo = reinterpret_cast<IndexMetaInfo *>(&page)->rootPageNo;
+  page = indexFile.readPage(pageNo);
+  while (reinterpret_cast<LeafNodeInt *>(&page)->level != -1) {
+    pageNo = reinterpret_cast<NonLeafNodeInt *>(&page)->pageNoArray[0];
+    page = indexFile.readPage(pageNo);
+  }
+
+  int numEntries = 0;
+  numBadLeaves = 0;
+  while (true) {
+    const LeafNodeInt *leaf = reinterpret_cast<LeafNodeInt *>(&page);
+    if (leaf->count > INTARRAYLEAFSIZE ||
+        !std::is_sorted(leaf->keyArray, leaf->keyArray + leaf->count))
+      numBadLeaves++;
+    numEntries += leaf->count;
+    if (leaf->rightSibPageNo == 0) break;
+    page = indexFile.readPage(leaf->rightSibPageNo);
+  }
+  return numEntries;
+}
+
+void test31_key_search() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test31_key_search" << std::endl;
+
+  // every kernel finds what std::lower_bound and std::upper_bound do, for
+  // short arrays, arrays the size of the nodes and keys out of range
+  const SearchKernel kernels[] = {SCALAR_SEARCH, BRANCHLESS_SEARCH, AVX2_SEARCH,
+                                  AVX512_SEARCH};
+  const int nodeSizes[] = {INTARRAYLEAFSIZE, INTARRAYNONLEAFSIZE,
+                           DOUBLEARRAYLEAFSIZE, DOUBLEARRAYNONLEAFSIZE};
+  int numMismatches = 0;
+  int numSearches = 0;
+  for (SearchKernel kernel : kernels) {
+    for (int len = 0; len <= 130; len++)
+      numMismatches += searchMismatches(kernel, len, numSearches);
+    for (int len : nodeSizes)
+      numMismatches += searchMismatches(kernel, len, numSearches);
+  }
+  checkPassFail(numMismatches, 0);
+  checkPassFail((numSearches > 0), true);
+
+  // other key types take the branchless kernel
+  std::vector<StringKey> strings;
+  char buffer[16];
+  for (int i = 0; i < 300; i += 3) {
+    sprintf(buffer, "%05d", i);
+    strings.push_back(StringKey::fromString(buffer));
+  }
+  int numStringMismatches = 0;
+  for (int i = -1; i <= 300; i++) {
+    sprintf(buffer, "%05d", i);
+    const StringKey key = StringKey::fromString(buffer);
+    numStringMismatches +=
+        KeySearch::search(strings.data(), (int)strings.size(), key, true) !=
+        std::lower_bound(strings.begin(), strings.end(), key) - strings.begin();
+    numStringMismatches +=
+        KeySearch::search(strings.data(), (int)strings.size(), key, false) !=
+        std::upper_bound(strings.begin(), strings.end(), key) - strings.begin();
+  }
+  checkPassFail(numStringMismatches, 0);
+
+  // microbenchmark of lookups in a full non-leaf node
+  std::vector<int> keys(INTARRAYNONLEAFSIZE);
+  for (int i = 0; i < INTARRAYNONLEAFSIZE; i++) keys[i] = 3 * i;
+  std::vector<int> probes(1 << 16);
+  std::srand(31);
+  for (int &probe : probes) probe = std::rand() % (3 * INTARRAYNONLEAFSIZE);
+  const char *kernelNames[] = {"scalar", "branchless", "avx2", "avx512"};
+  long scalarSum;
+  const double scalarNanos =
+      searchNanos(SCALAR_SEARCH, keys, probes, scalarSum);
+  for (SearchKernel kernel : kernels) {
+    long sum;
+    const double nanos = searchNanos(kernel, keys, probes, sum);
+    std::cout << kernelNames[kernel] << " search ns:" << nanos
+              << " speedup:" << scalarNanos / nanos << std::endl;
+    checkPassFail(sum, scalarSum);
+  }
+  std::cout << "best kernel:" << kernelNames[KeySearch::bestKernel()]
+            << std::endl;
+}
+
+/**
+ * Searches sorted arrays of len ints and of len doubles, with repeated keys,
+ * for every key in them, the keys between them and keys beyond both ends,
+ * and counts the results differing from std::lower_bound and
+ * std::upper_bound.
+ */
+int searchMismatches(SearchKernel kernel, int len, int &numSearches) {
+  std::vector<int> ints(len);
+  std::vector<double> doubles(len);
+  std::srand(len);
+  for (int i = 0; i < len; i++) ints[i] = std::rand() % (len + 1) - len / 2;
+  std::sort(ints.begin(), ints.end());
+  for (int i = 0; i < len; i++) doubles[i] = ints[i] / 2.0;
+
+  std::vector<int> intProbes = {INT_MIN, INT_MAX, -len, len};
+  for (int key : ints) {
+    intProbes.push_back(key);
+    intProbes.push_back(key + 1);
+  }
+  std::vector<double> doubleProbes = {-std::numeric_limits<double>::infinity(),
+                                      std::numeric_limits<double>::infinity()};
+  for (double key : doubles) {
+    doubleProbes.push_back(key);
+    doubleProbes.push_back(key + 0.25);
+  }
+
+  int numMismatches = 0;
+  for (int key : intProbes) {
+    numMismatches +=
+        KeySearch::search(ints.data(), len, key, true, kernel) !=
+        std::lower_bound(ints.begin(), ints.end(), key) - ints.begin();
+    numMismatches +=
+        KeySearch::search(ints.data(), len, key, false, kernel) !=
+        std::upper_bound(ints.begin(), ints.end(), key) - ints.begin();
+    numSearches += 2;
+  }
+  for (double key : doubleProbes) {
+    numMismatches +=
+        KeySearch::search(doubles.data(), len, key, true, kernel) !=
+        std::lower_bound(doubles.begin(), doubles.end(), key) - doubles.begin();
+    numMismatches +=
+        KeySearch::search(doubles.data(), len, key, false, kernel) !=
+        std::upper_bound(doubles.begin(), doubles.end(), key) - doubles.begin();
+    numSearches += 2;
+  }
+  return numMismatches;
+}
+
+/**
+ * Searches the keys for each probe, 50 times over, and returns the average
+ * time of a search in nanoseconds. Sums the positions found.
+ */
+double searchNanos(SearchKernel kernel, const std::vector<int> &keys,
+                   const std::vector<int> &probes, long &sum) {
+  const int rounds = 50;
+  sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; round++)
+    for (int probe : probes)
+      sum += KeySearch::search(keys.data(), (int)keys.size(), probe,
+                               round % 2 == 0, kernel);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         (rounds * probes.size());
+}
+
+void test32_scan_cursors() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test32_scan_cursors" << std::endl;
+
+  createRelationRandom();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // cursors stepped in turn each see their own range, alongside the scan
+    // of startScan
+    int low[] = {-1, 1000, 2500};
+    int high[] = {1500, 1200, 5000};
+    std::vector<BTreeScanCursor> cursors;
+    for (int c = 0; c < 3; c++)
+      cursors.push_back(index.openScan(&low[c], GT, &high[c], LTE));
+    int startLow = 4000;
+    int startHigh = 4100;
+    index.startScan(&startLow, GTE, &startHigh, LT);
+    int counts[] = {0, 0, 0};
+    int startCount = 0;
+    bool done[] = {false, false, false, false};
+    RecordId rid;
+    while (!(done[0] && done[1] && done[2] && done[3])) {
+      for (int c = 0; c < 3; c++) {
+        if (done[c]) continue;
+        try {
+          cursors[c].scanNext(rid);
+          counts[c]++;
+        } catch (IndexScanCompletedException e) {
+          done[c] = true;
+        }
+      }
+      if (done[3]) continue;
+      try {
+        index.scanNext(rid);
+        startCount++;
+      } catch (IndexScanCompletedException e) {
+        done[3] = true;
+      }
+    }
+    checkPassFail(counts[0], 1501);
+    checkPassFail(counts[1], 200);
+    checkPassFail(counts[2], 2499);
+    checkPassFail(startCount, 100);
+    index.endScan();
+
+    // an ended or moved from cursor is not scanning
+    cursors[0].endScan();
+    bool thrown = false;
+    try {
+      cursors[0].scanNext(rid);
+    } catch (ScanNotInitializedException e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+    int moveLow = 10;
+    int moveHigh = 20;
+    BTreeScanCursor moved = index.openScan(&moveLow, GTE, &moveHigh, LTE);
+    moved.scanNext(rid);
+    BTreeScanCursor taken(std::move(moved));
+    checkPassFail(moved.isExecuting(), false);
+    checkPassFail(drainCursor(taken), 10);
+    cursors.clear();
+
+    // a scan that finds nothing leaves no cursor open
+    int emptyLow = 6000;
+    int emptyHigh = 7000;
+    thrown = false;
+    try {
+      BTreeScanCursor empty = index.openScan(&emptyLow, GT, &emptyHigh, LT);
+    } catch (NoSuchKeyFoundException e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+
+    // threads running many range scans of the one index at once
+    const int numThreads = 8;
+    std::atomic<int> numWrong(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+      threads.push_back(std::thread([&index, &numWrong, t]() {
+        for (int q = 0; q < 40; q++) {
+          int qLow = (t * 613 + q * 97) % (relationSize - 100);
+          int qHigh = qLow + 99;
+          BTreeScanCursor cursor = index.openScan(&qLow, GTE, &qHigh, LTE);
+          if (drainCursor(cursor) != 100) numWrong++;
+        }
+      }));
+    }
+    for (std::thread &thread : threads) thread.join();
+    checkPassFail(numWrong, 0);
+  }
+  // the index was flushed on close, which no pinned leaf prevented
+  int numBadLeaves;
+  checkPassFail(countLeafEntries(intIndexName, numBadLeaves), relationSize);
+  checkPassFail(numBadLeaves, 0);
+  deleteIndexFile();
+  deleteRelation();
+}
+
+/**
+ * Returns the number of entries left in a cursor's scan.
+ */
+int drainCursor(BTreeScanCursor &cursor) {
+  RecordId rid;
+  int count = 0;
+  try {
+    while (true) {
+      cursor.scanNext(rid);
+      count++;
+    }
+  } catch (IndexScanCompletedException e) {
+  }
+  return count;
+}
+
+void test33_batch_index_scan() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test33_batch_index_scan" << std::endl;
+
+  createRelationRandom();
+  const std::size_t batchSizes[] = {1, 7, 256, 1000};
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // batches return the entries scanNext does, in the same order, for
+    // ranges ending inside a leaf, at its end and past the last leaf
+    const int lows[] = {25, -100, 0, 1000, 4990, 5000, 300};
+    const Operator lowOps[] = {GT, GT, GTE, GTE, GT, GTE, GT};
+    const int highs[] = {40, 10000, 4999, 2000, 4999, 6000, 300};
+    const Operator highOps[] = {LT, LT, LTE, LT, LTE, LT, LTE};
+    int numMismatches = 0;
+    int numEntries = 0;
+    for (std::size_t batchSize : batchSizes) {
+      for (int r = 0; r < 7; r++) {
+        int found;
+        numMismatches += batchMismatches(&index, &lows[r], lowOps[r],
+                                         &highs[r], highOps[r], batchSize,
+                                         found);
+        numEntries += found;
+      }
+    }
+    checkPassFail(numMismatches, 0);
+    checkPassFail(numEntries, 4 * (14 + 5000 + 5000 + 1000 + 9 + 0 + 0));
+
+    // the keys come back with the record ids
+    int low = 100;
+    int high = 2100;
+    RecordId rids[300];
+    int keys[300];
+    int expectedKey = low;
+    int numBadKeys = 0;
+    index.startScan(&low, GTE, &high, LT);
+    std::size_t count;
+    while ((count = index.scanNextBatch(rids, 300, keys)) > 0)
+      for (std::size_t e = 0; e < count; e++)
+        numBadKeys += keys[e] != expectedKey++;
+    checkPassFail(expectedKey, high);
+    checkPassFail(numBadKeys, 0);
+    checkPassFail(index.scanNextBatch(rids, 300, keys), (std::size_t)0);
+    index.endScan();
+
+    // a batch of no entries cannot be asked for
+    index.startScan(&low, GTE, &high, LT);
+    bool thrown = false;
+    try {
+      index.scanNextBatch(rids, 0, keys);
+    } catch (BadScanParamException e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true);
+    checkPassFail(index.scanNextBatch(rids, 1, keys), (std::size_t)1);
+    checkPassFail(keys[0], low);
+    index.endScan();
+
+    // an empty range is reported without an exception
+    BTreeScanCursor cursor;
+    low = 6000;
+    high = 7000;
+    checkPassFail(index.openScan(&low, GT, &high, LT, cursor), false);
+    checkPassFail(cursor.isExecuting(), false);
+
+    // short range scans, one entry at a time against in batches
+    long oneAtATime, batched;
+    const double scanNanos = shortScansNanos(&index, false, 20000, oneAtATime);
+    const double batchNanos = shortScansNanos(&index, true, 20000, batched);
+    std::cout << "short scan ns scanNext:" << scanNanos
+              << " scanNextBatch:" << batchNanos
+              << " speedup:" << scanNanos / batchNanos << std::endl;
+    checkPassFail(batched, oneAtATime);
+  }
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
+    double low = 24.5;
+    double high = 1040.5;
+    double keys[64];
+    RecordId rids[64];
+    int numMismatches = 0;
+    int numEntries = 0;
+    for (std::size_t batchSize : batchSizes) {
+      int found;
+      numMismatches += batchMismatches(&index, &low, GT, &high, LTE, batchSize,
+                                       found);
+      numEntries += found;
+    }
+    checkPassFail(numMismatches, 0);
+    checkPassFail(numEntries, 4 * 1016);
+    index.startScan(&low, GT, &high, LTE);
+    checkPassFail(index.scanNextBatch(rids, 64, keys), (std::size_t)64);
+    checkPassFail(keys[0], 25.0);
+    checkPassFail(keys[63], 88.0);
+    index.endScan();
+  }
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+    char low[64];
+    char high[64];
+    sprintf(low, "%05d string record", 20);
+    sprintf(high, "%05d string record", 3500);
+    int numMismatches = 0;
+    int numEntries = 0;
+    for (std::size_t batchSize : batchSizes) {
+      int found;
+      numMismatches += batchMismatches(&index, low, GTE, high, LT, batchSize,
+                                       found);
+      numEntries += found;
+    }
+    checkPassFail(numMismatches, 0);
+    checkPassFail(numEntries, 4 * 3480);
+  }
+  deleteIndexFile();
+  deleteRelation();
+}
+
+/**
+ * Scans a range once with scanNext and once with scanNextBatch, in batches
+ * of batchSize, and returns the number of differences between the record
+ * ids found. Sets numEntries to the number found in batches.
+ */
+int batchMismatches(BTreeIndex *index, const void *lowVal, Operator lowOp,
+                    const void *highVal, Operator highOp,
+                    std::size_t batchSize, int &numEntries) {
+  std::vector<RecordId> expected;
+  BTreeScanCursor cursor;
+  if (index->openScan(lowVal, lowOp, highVal, highOp, cursor)) {
+    RecordId rid;
+    try {
+      while (true) {
+        cursor.scanNext(rid);
+        expected.push_back(rid);
+      }
+    } catch (IndexScanCompletedException e) {
+    }
+  }
+
+  std::vector<RecordId> found;
+  std::vector<RecordId> batch(batchSize);
+  int numMismatches = 0;
+  if (index->openScan(lowVal, lowOp, highVal, highOp, cursor)) {
+    std::size_t count;
+    while ((count = cursor.scanNextBatch(batch.data(), batchSize)) > 0)
+      found.insert(found.end(), batch.begin(), batch.begin() + count);
+    // the end of the range is not passed by asking again
+    numMismatches += cursor.scanNextBatch(batch.data(), batchSize) != 0;
+    cursor.endScan();
+  }
+
+  numEntries = (int)found.size();
+  numMismatches += std::abs((int)found.size() - (int)expected.size());
+  for (std::size_t e = 0; e < std::min(found.size(), expected.size()); e++)
+    numMismatches += !(found[e] == expected[e]);
+  return numMismatches;
+}
+
+/**
+ * Runs numScans scans of ranges of ten keys, a tenth of them empty, either
+ * with startScan and scanNext until the scan throws, or without exceptions
+ * with openScan and scanNextBatch. Returns the average time of a scan in
+ * nanoseconds and sets numEntries to the entries found.
+ */
+double shortScansNanos(BTreeIndex *index, bool batched, int numScans,
+                       long &numEntries) {
+  std::srand(33);
+  numEntries = 0;
+  RecordId rids[16];
+  BTreeScanCursor cursor;
+  auto start = std::chrono::steady_clock::now();
+  for (int s = 0; s < numScans; s++) {
+    int low = std::rand() % (relationSize * 11 / 10);
+    int high = low + 9;
+    if (batched) {
+      if (!index->openScan(&low, GTE, &high, LTE, cursor)) continue;
+      std::size_t count;
+      while ((count = cursor.scanNextBatch(rids, 16)) > 0) numEntries += count;
+      cursor.endScan();
+    } else {
+      try {
+        index->startScan(&low, GTE, &high, LTE);
+      } catch (NoSuchKeyFoundException e) {
+        continue;
+      }
+      try {
+        while (true) {
+          index->scanNext(rids[0]);
+          numEntries++;
+        }
+      } catch (IndexScanCompletedException e) {
+      }
+      index->endScan();
+    }
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / numScans;
+}
+
+void test34_delete_entries() {
+  std::cout << "---------------------" << std::endl;
+  std::cout << "test34_delete_entries" << std::endl;
+
+  createRelationRandom();
+  std::vector<RIDKeyPair<int> > entries = relationEntries();
+  int numEntries, height;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // deleted entries are gone, the others still found
+    int numDeleted = 0;
+    for (const RIDKeyPair<int> &entry : entries)
+      if (entry.key % 2 == 0)
+        numDeleted += index.deleteEntry(&entry.key, entry.rid);
+    checkPassFail(numDeleted, relationSize / 2);
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize / 2);
+    checkPassFail(intScan(&index, 100, GTE, 200, LTE), 50);
+    checkPassFail(intScan(&index, 2000, GTE, 2000, LTE), 0);
+    checkPassFail(intScan(&index, 2001, GTE, 2001, LTE), 1);
+
+    // a pair is only deleted once, and only with its own record id
+    checkPassFail((index.deleteEntry(&entries[0].key, entries[0].rid) ==
+                   (entries[0].key % 2 != 0)),
+                  true);
+    int key = 3;
+    RecordId wrongRid;
+    wrongRid.page_number = 9999;
+    wrongRid.slot_number = 1;
+    checkPassFail(index.deleteEntry(&key, wrongRid), false);
+  }
+  checkPassFail(treeViolations(intIndexName, true, numEntries, height), 0);
+  checkPassFail((numEntries == relationSize / 2 ||
+                 numEntries == relationSize / 2 - 1),
+                true);
+
+  // deleting everything leaves an empty leaf as the root, and inserting it
+  // all again reuses the freed pages
+  const long pagesBefore = indexFilePages(intIndexName);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    for (const RIDKeyPair<int> &entry : entries)
+      index.deleteEntry(&entry.key, entry.rid);
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), 0);
+  }
+  checkPassFail(treeViolations(intIndexName, true, numEntries, height), 0);
+  checkPassFail(numEntries, 0);
+  checkPassFail(height, 1);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    for (const RIDKeyPair<int> &entry : entries)
+      index.insertEntry(&entry.key, entry.rid);
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize);
+  }
+  checkPassFail(treeViolations(intIndexName, true, numEntries, height), 0);
+  checkPassFail(numEntries, relationSize);
+  checkPassFail(indexFilePages(intIndexName), pagesBefore);
+
+  // enough entries for three levels, mostly deleted in random order: internal
+  // nodes borrow and merge too and the root collapses
+  const int numKeys = 400000;
+  std::vector<int> deleted;
+  for (int key = relationSize; key < numKeys; key++)
+    if (key % 1000 != 0) deleted.push_back(key);
+  std::srand(34);
+  std::random_shuffle(deleted.begin(), deleted.end());
+  long fullPages;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    for (int key = relationSize; key < numKeys; key++) {
+      RecordId rid;
+      rid.page_number = key / 100 + 1;
+      rid.slot_number = key % 100 + 1;
+      index.insertEntry(&key, rid);
+    }
+  }
+  checkPassFail(treeViolations(intIndexName, true, numEntries, height), 0);
+  checkPassFail(numEntries, numKeys);
+  checkPassFail(height, 3);
+  fullPages = indexFilePages(intIndexName);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int numDeleted = 0;
+    for (int key : deleted) {
+      RecordId rid;
+      rid.page_number = key / 100 + 1;
+      rid.slot_number = key % 100 + 1;
+      numDeleted += index.deleteEntry(&key, rid);
+    }
+    checkPassFail(numDeleted, (int)deleted.size());
+    int low = relationSize;
+    int high = numKeys;
+    checkPassFail(countScan(&index, &low, GTE, &high, LT),
+                  numKeys / 1000 - relationSize / 1000);
+  }
+  checkPassFail(treeViolations(intIndexName, true, numEntries, height), 0);
+  checkPassFail(numEntries, numKeys - (int)deleted.size());
+  checkPassFail(height, 2);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    for (int key : deleted) {
+      RecordId rid;
+      rid.page_number = key / 100 + 1;
+      rid.slot_number = key % 100 + 1;
+      index.insertEntry(&key, rid);
+    }
+  }
+  checkPassFail(treeViolations(intIndexName, true, numEntries, height), 0);
+  checkPassFail(numEntries, numKeys);
+  checkPassFail((indexFilePages(intIndexName) <= fullPages), true);
+  deleteIndexFile();
+
+  // entries of one key spread over several leaves
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int key = 7;
+    std::vector<RecordId> rids;
+    for (int d = 0; d < 2000; d++) {
+      RecordId rid;
+      rid.page_number = 10000 + d;
+      rid.slot_number = 1;
+      rids.push_back(rid);
+      index.insertEntry(&key, rid);
+    }
+    std::random_shuffle(rids.begin(), rids.end());
+    int numDeleted = 0;
+    for (const RecordId &rid : rids) numDeleted += index.deleteEntry(&key, rid);
+    checkPassFail(numDeleted, 2000);
+    checkPassFail(intScan(&index, 7, GTE, 7, LTE), 1);
+  }
+  checkPassFail(treeViolations(intIndexName, true, numEntries, height), 0);
+  checkPassFail(numEntries, relationSize);
+
+  // a bulk load puts the pages of the old tree on the free list
+  const long insertedPages = indexFilePages(intIndexName);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    for (int load = 0; load < 2; load++) {
+      std::vector<RIDKeyPair<int> > none;
+      index.bulkLoad(none);
+    }
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize);
+  }
+  checkPassFail(treeViolations(intIndexName, false, numEntries, height), 0);
+  checkPassFail(numEntries, relationSize);
+  checkPassFail(indexFilePages(intIndexName), insertedPages);
+
+  // the other types of key
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
+    for (const RIDKeyPair<int> &entry : entries) {
+      const double key = entry.key;
+      if (entry.key < 1000) index.deleteEntry(&key, entry.rid);
+    }
+    checkPassFail(doubleScan(&index, -1, GT, relationSize, LT),
+                  relationSize - 1000);
+  }
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+    char key[64];
+    for (const RIDKeyPair<int> &entry : entries) {
+      sprintf(key, "%05d string record", entry.key);
+      if (entry.key >= 3000) index.deleteEntry(key, entry.rid);
+    }
+    checkPassFail(stringScan(&index, -1, GT, relationSize, LT), 3000);
+  }
+  deleteIndexFile();
+  deleteRelation();
+}
+
+/**
+ * Returns the key of attribute i and the record id of every record of the
+ * relation.
+ */
+std::vector<RIDKeyPair<int> > relationEntries() {
+  std::vector<RIDKeyPair<int> > entries;
+  FileScan scan(relationName, bufMgr);
+  try {
+    RecordId rid;
+    while (true) {
+      scan.scanNext(rid);
+      RIDKeyPair<int> entry;
+      entry.set(rid, reinterpret_cast<const RECORD *>(
+                         scan.getRecord().data())->i);
+      entries.push_back(entry);
+    }
+  } catch (EndOfFileException e) {
+  }
+  return entries;
+}
+
+/**
+ * State of a walk over the nodes of a closed INTEGER index by treeViolations.
+ */
+struct TreeWalk {
+  BlobFile *file;
+  bool checkFill;
+  int leafDepth;
+  int numEntries;
+  int numViolations;
+  std::vector<PageId> leaves;
+};
+
+/**
+ * Checks the subtree with the given root, whose keys must lie in
+ * [low, high]: that keys are in order and between those of the parent, that
+ * nodes other than the root are at least half full, and that every leaf is at
+ * the same depth. Appends the leaves to walk.leaves from left to right.
+ */
+void walkSubtree(TreeWalk &walk, PageId pageNo, int depth, long low,
+                 long high) {
+  Page page = walk.file->readPage(pageNo);
+  if (reinterpret_cast<LeafNodeInt *>(&page)->level == -1) {
+    const LeafNodeInt *leaf = reinterpret_cast<LeafNodeInt *>(&page);
+    const bool underfull = walk.checkFill && depth > 0 &&
+                           leaf->count < INTARRAYLEAFSIZE / 2;
+    walk.numViolations +=
+        underfull || leaf->count > INTARRAYLEAFSIZE ||
+        !std::is_sorted(leaf->keyArray, leaf->keyArray + leaf->count) ||
+        (leaf->count > 0 && (leaf->keyArray[0] < low ||
+                             leaf->keyArray[leaf->count - 1] > high));
+    if (walk.leafDepth == -1) walk.leafDepth = depth;
+    walk.numViolations += depth != walk.leafDepth;
+    walk.numEntries += leaf->count;
+    walk.leaves.push_back(pageNo);
+    return;
+  }
+
+  const NonLeafNodeInt *node = reinterpret_cast<NonLeafNodeInt *>(&page);
+  const bool underfull = walk.checkFill && depth > 0 &&
+                         node->count < (INTARRAYNONLEAFSIZE - 1) / 2;
+  walk.numViolations +=
+      underfull || node->count > INTARRAYNONLEAFSIZE ||
+      (depth == 0 && node->count == 0) ||
+      !std::is_sorted(node->keyArray, node->keyArray + node->count);
+  const std::vector<int> keys(node->keyArray, node->keyArray + node->count);
+  const std::vector<PageId> children(node->pageNoArray,
+                                     node->pageNoArray + node->count + 1);
+  for (std::size_t c = 0; c < children.size(); c++)
+    walkSubtree(walk, children[c], depth + 1, c == 0 ? low : keys[c - 1],
+                c == keys.size() ? high : keys[c]);
+}
+
+/**
+ * Walks every node of a closed INTEGER index, reading its file directly, and
+ * returns the number of nodes breaking the rules of the tree. The leaf chain
+ * counts as one more violation if it does not link the leaves in order. Sets
+ * the number of entries and the number of levels.
+ */
+int treeViolations(const std::string &indexName, bool checkFill,
+                   int &numEntries, int &height) {
+  BlobFile indexFile(indexName, false);
+  Page metaPage = indexFile.readPage(indexFile.getFirstPageNo());
+  TreeWalk walk;
+  walk.file = &indexFile;
+  walk.checkFill = checkFill;
+  walk.leafDepth = -1;
+  walk.numEntries = 0;
+  walk.numViolations = 0;
+  walkSubtree(walk, reinterpret_cast<IndexMetaInfo *>(&metaPage)->rootPageNo,
+              0, INT_MIN, INT_MAX);
+
+  for (std::size_t l = 0; l < walk.leaves.size(); l++) {
+    Page page = indexFile.readPage(walk.leaves[l]);
+    const PageId next = reinterpret_cast<LeafNodeInt *>(&page)->rightSibPageNo;
+    if (next != (l + 1 < walk.leaves.size() ? walk.leaves[l + 1] : 0)) {
+      walk.numViolations++;
+      break;
+    }
+  }
+  numEntries = walk.numEntries;
+  height = walk.leafDepth + 1;
+  return walk.numViolations;
+}
+
+/**
+ * Returns the size of an index file in pages.
+ */
+long indexFilePages(const std::string &indexName) {
+  std::ifstream in(indexName, std::ios::binary | std::ios::ate);
+  return static_cast<long>(in.tellg()) / Page::SIZE;
+}
@@ -19,6 +19,8 @@
 
 namespace badgerdb {
 
+const PageId Page::INVALID_NUMBER;
+
 Page::Page() { initialize(); }
 
 void Page::initialize() {
@@ -28,6 +30,7 @@ void Page::initialize() {
   header_.num_free_slots = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.prev_page_number = INVALID_NUMBER;
   // data_.assign(DATA_SIZE, char());
   memset(data_, '\0', DATA_SIZE);
 }
@@ -45,10 +48,13 @@ RecordId Page::insertRecord(const std::string &record_data) {
 std::string Page::getRecord(const RecordId &record_id) const {
   validateRecordId(record_id);
   const PageSlot &slot = getSlot(record_id.slot_number);
-  std::string retStr =
-      std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
+  return std::string(&data_[slot.item_offset], slot.item_length);
+}
 
-  return retStr;
+RecordView Page::viewRecord(const RecordId &record_id) const {
+  validateRecordId(record_id);
+  const PageSlot &slot = getSlot(record_id.slot_number);
+  return RecordView(&data_[slot.item_offset], slot.item_length);
 }
 
 void Page::updateRecord(const RecordId &record_id,
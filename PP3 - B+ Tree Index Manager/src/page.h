@@ -59,6 +59,12 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of the previous used page in the file.  For a free page, the used
+   * page it followed when it was deleted.
+   */
+  PageId prev_page_number;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -68,7 +74,8 @@ struct PageHeader {
   bool operator==(const PageHeader &rhs) const {
     return num_slots == rhs.num_slots && num_free_slots == rhs.num_free_slots &&
            current_page_number == rhs.current_page_number &&
-           next_page_number == rhs.next_page_number;
+           next_page_number == rhs.next_page_number &&
+           prev_page_number == rhs.prev_page_number;
   }
 };
 
@@ -93,6 +100,82 @@ struct PageSlot {
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Read-only view of the bytes of a record stored on a page.
+ *
+ * A view points into the page it was taken from and does not own or copy the
+ * bytes.  It stays valid until the page is modified or, for a page in the
+ * buffer pool, unpinned.
+ */
+class RecordView {
+ public:
+  /**
+   * Constructs an empty view.
+   */
+  RecordView() : data_(NULL), size_(0) {}
+
+  /**
+   * Constructs a view of size bytes starting at data.
+   */
+  RecordView(const char *data, const std::size_t size)
+      : data_(data), size_(size) {}
+
+  /**
+   * Returns a pointer to the first byte of the record.
+   */
+  const char *data() const { return data_; }
+
+  /**
+   * Returns the length of the record in bytes.
+   */
+  std::size_t size() const { return size_; }
+
+  /**
+   * Returns the length of the record in bytes.
+   */
+  std::size_t length() const { return size_; }
+
+  /**
+   * Returns true if the record has no bytes.
+   */
+  bool empty() const { return size_ == 0; }
+
+  /**
+   * Returns the byte at the given offset in the record.
+   */
+  char operator[](const std::size_t offset) const { return data_[offset]; }
+
+  /**
+   * Returns a copy of the record, which stays valid after the page changes.
+   */
+  std::string str() const { return std::string(data_, size_); }
+
+  /**
+   * Copies the record, for callers that need a std::string.
+   */
+  operator std::string() const { return str(); }
+
+  /**
+   * Returns true if the record holds the same bytes as the given string.
+   */
+  bool operator==(const std::string &rhs) const {
+    return size_ == rhs.size() && rhs.compare(0, size_, data_, size_) == 0;
+  }
+
+  bool operator!=(const std::string &rhs) const { return !(*this == rhs); }
+
+ private:
+  /**
+   * First byte of the record on its page.
+   */
+  const char *data_;
+
+  /**
+   * Length of the record in bytes.
+   */
+  std::size_t size_;
+};
+
 class PageIterator;
 
 /**
@@ -151,6 +234,15 @@ class Page {
    */
   std::string getRecord(const RecordId &record_id) const;
 
+  /**
+   * Returns a view of the record with the given ID, without copying it.  The
+   * view points into this page; see RecordView for how long it stays valid.
+   *
+   * @param record_id  ID of the record to view.
+   * @return  View of the record.
+   */
+  RecordView viewRecord(const RecordId &record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -201,6 +293,13 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the number of the previous used page to this page in its file.
+   *
+   * @return  Page number of previous used page in file.
+   */
+  PageId prev_page_number() const { return header_.prev_page_number; }
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -242,6 +341,15 @@ class Page {
     header_.next_page_number = new_next_page_number;
   }
 
+  /**
+   * Sets the number of the previous used page before this page in its file.
+   *
+   * @param prev_page_number  Page number of previous used page in file.
+   */
+  void set_prev_page_number(const PageId new_prev_page_number) {
+    header_.prev_page_number = new_prev_page_number;
+  }
+
   /**
    * Deletes the record with the given ID.  Page is compacted upon delete to
    * ensure that data of all records is contiguous.  Slot array is compacted if
@@ -341,6 +449,8 @@ class Page {
   friend class BlobFile;
 
   friend class PageIterator;
+
+  friend class PageFilter;
 };
 
 
@@ -0,0 +1,482 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_filter.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PAGE_FILTER_X86
+#endif
+
+namespace badgerdb {
+
+// the vector kernels read slot fields at these byte offsets
+static_assert(sizeof(PageSlot) == 6 && offsetof(PageSlot, item_offset) == 2 &&
+                  offsetof(PageSlot, item_length) == 4,
+              "PageFilter expects a six byte PageSlot.");
+
+/**
+ * Int range with both bounds inclusive.
+ */
+struct IntRange {
+  int low;
+  int high;
+  bool empty;
+};
+
+/**
+ * Double range, each bound inclusive or not.
+ */
+struct DoubleRange {
+  double low;
+  bool lowInclusive;
+  double high;
+  bool highInclusive;
+};
+
+static IntRange intRange(int low, Operator lowOp, int high, Operator highOp) {
+  IntRange range = {low, high, false};
+  if (lowOp == GT) {
+    if (low == INT_MAX)
+      range.empty = true;
+    else
+      range.low = low + 1;
+  }
+  if (highOp == LT) {
+    if (high == INT_MIN)
+      range.empty = true;
+    else
+      range.high = high - 1;
+  }
+  if (range.low > range.high)
+    range.empty = true;
+  return range;
+}
+
+static bool inRange(double value, const DoubleRange &range) {
+  return (range.lowInclusive ? value >= range.low : value > range.low) &&
+         (range.highInclusive ? value <= range.high : value < range.high);
+}
+
+/**
+ * Reads the attribute of the record in a slot. Returns false if the slot is
+ * not used or its record is too short to hold the attribute.
+ */
+template <typename T>
+static bool attribute(const char *data, std::size_t slot, std::size_t attrOffset,
+                      T &value) {
+  PageSlot meta;
+  std::memcpy(&meta, data + (slot - 1) * sizeof(PageSlot), sizeof(meta));
+  if (!meta.used || meta.item_length < attrOffset + sizeof(T) ||
+      meta.item_offset + attrOffset + sizeof(T) > Page::DATA_SIZE)
+    return false;
+  std::memcpy(&value, data + meta.item_offset + attrOffset, sizeof(T));
+  return true;
+}
+
+/**
+ * Reads an unaligned value at base + offset.
+ */
+template <typename T>
+static inline T readValue(const char *base, int offset) {
+  T value;
+  std::memcpy(&value, base + offset, sizeof(T));
+  return value;
+}
+
+/**
+ * Sets the bits of a group of slots starting at slot index first, which is a
+ * multiple of the group size, and returns how many were set.
+ */
+static std::size_t setBits(std::uint64_t *selection, std::size_t first,
+                           unsigned bits) {
+  selection[first / 64] |= static_cast<std::uint64_t>(bits) << (first % 64);
+  return __builtin_popcount(bits);
+}
+
+static std::size_t selectIntScalar(const char *data, std::size_t numSlots,
+                                   std::size_t attrOffset, const IntRange &range,
+                                   std::uint64_t *selection) {
+  std::size_t count = 0;
+  for (std::size_t slot = 1; slot <= numSlots; slot++) {
+    int value;
+    if (attribute(data, slot, attrOffset, value) && value >= range.low &&
+        value <= range.high) {
+      selection[(slot - 1) / 64] |= 1ULL << ((slot - 1) % 64);
+      count++;
+    }
+  }
+  return count;
+}
+
+static std::size_t selectDoubleScalar(const char *data, std::size_t numSlots,
+                                      std::size_t attrOffset,
+                                      const DoubleRange &range,
+                                      std::uint64_t *selection) {
+  std::size_t count = 0;
+  for (std::size_t slot = 1; slot <= numSlots; slot++) {
+    double value;
+    if (attribute(data, slot, attrOffset, value) && inRange(value, range)) {
+      selection[(slot - 1) / 64] |= 1ULL << ((slot - 1) % 64);
+      count++;
+    }
+  }
+  return count;
+}
+
+#ifdef PAGE_FILTER_X86
+
+/**
+ * Reads the slots of four slot indexes starting at first. Sets offset to the
+ * offsets of their records, zero for lanes not selected, and returns a mask of
+ * the lanes whose slot is used and whose record holds width bytes at
+ * attrOffset.
+ */
+__attribute__((target("sse4.2")))
+static inline __m128i readSlots(const char *data, std::size_t numSlots,
+                                std::size_t first, std::size_t attrOffset,
+                                std::size_t width, __m128i &offset) {
+  // the two loads read 28 bytes; near the end of the page the slots are
+  // copied out first so the loads stay inside it
+  const std::size_t start = first * sizeof(PageSlot);
+  const char *slots = data + start;
+  alignas(16) char copy[32] = {0};
+  if (start + 28 > Page::DATA_SIZE) {
+    std::memcpy(copy, slots, Page::DATA_SIZE - start);
+    slots = copy;
+  }
+  const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(slots));
+  const __m128i high = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(slots + 2 * sizeof(PageSlot)));
+
+  // slots 0 and 1 from low, 2 and 3 from high, one 32-bit lane each
+  const __m128i usedLow = _mm_setr_epi8(0, -1, -1, -1, 6, -1, -1, -1,
+                                        -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i usedHigh = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                         0, -1, -1, -1, 6, -1, -1, -1);
+  const __m128i offsetLow = _mm_setr_epi8(2, 3, -1, -1, 8, 9, -1, -1,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i offsetHigh = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                          2, 3, -1, -1, 8, 9, -1, -1);
+  const __m128i lengthLow = _mm_setr_epi8(4, 5, -1, -1, 10, 11, -1, -1,
+                                          -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i lengthHigh = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                           4, 5, -1, -1, 10, 11, -1, -1);
+  const __m128i used = _mm_or_si128(_mm_shuffle_epi8(low, usedLow),
+                                    _mm_shuffle_epi8(high, usedHigh));
+  const __m128i itemOffset = _mm_or_si128(_mm_shuffle_epi8(low, offsetLow),
+                                          _mm_shuffle_epi8(high, offsetHigh));
+  const __m128i length = _mm_or_si128(_mm_shuffle_epi8(low, lengthLow),
+                                      _mm_shuffle_epi8(high, lengthHigh));
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i inPage = _mm_cmpgt_epi32(_mm_set1_epi32(numSlots - first),
+                                         _mm_setr_epi32(0, 1, 2, 3));
+  const __m128i longEnough =
+      _mm_cmpgt_epi32(length, _mm_set1_epi32(attrOffset + width - 1));
+  const __m128i inData = _mm_cmpgt_epi32(
+      _mm_set1_epi32(Page::DATA_SIZE - attrOffset - width + 1), itemOffset);
+  const __m128i valid = _mm_andnot_si128(
+      _mm_cmpeq_epi32(used, zero),
+      _mm_and_si128(inPage, _mm_and_si128(longEnough, inData)));
+  // offset 0 is in the page for every attrOffset the kernels are run with
+  offset = _mm_and_si128(itemOffset, valid);
+  return valid;
+}
+
+__attribute__((target("sse4.2")))
+static std::size_t selectIntSse42(const char *data, std::size_t numSlots,
+                                  std::size_t attrOffset, const IntRange &range,
+                                  std::uint64_t *selection) {
+  const __m128i low = _mm_set1_epi32(range.low);
+  const __m128i high = _mm_set1_epi32(range.high);
+  const char *base = data + attrOffset;
+  std::size_t count = 0;
+  for (std::size_t first = 0; first < numSlots; first += 4) {
+    __m128i offset;
+    const __m128i valid =
+        readSlots(data, numSlots, first, attrOffset, sizeof(int), offset);
+    const __m128i value = _mm_setr_epi32(
+        readValue<int>(base, _mm_extract_epi32(offset, 0)),
+        readValue<int>(base, _mm_extract_epi32(offset, 1)),
+        readValue<int>(base, _mm_extract_epi32(offset, 2)),
+        readValue<int>(base, _mm_extract_epi32(offset, 3)));
+    const __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(low, value),
+                                         _mm_cmpgt_epi32(value, high));
+    const __m128i selected = _mm_andnot_si128(outside, valid);
+    count += setBits(selection, first, _mm_movemask_ps(_mm_castsi128_ps(selected)));
+  }
+  return count;
+}
+
+__attribute__((target("sse4.2")))
+static std::size_t selectDoubleSse42(const char *data, std::size_t numSlots,
+                                     std::size_t attrOffset,
+                                     const DoubleRange &range,
+                                     std::uint64_t *selection) {
+  const __m128d low = _mm_set1_pd(range.low);
+  const __m128d high = _mm_set1_pd(range.high);
+  const char *base = data + attrOffset;
+  std::size_t count = 0;
+  for (std::size_t first = 0; first < numSlots; first += 4) {
+    __m128i offset;
+    const __m128i valid =
+        readSlots(data, numSlots, first, attrOffset, sizeof(double), offset);
+    const __m128d values[2] = {
+        _mm_setr_pd(readValue<double>(base, _mm_extract_epi32(offset, 0)),
+                    readValue<double>(base, _mm_extract_epi32(offset, 1))),
+        _mm_setr_pd(readValue<double>(base, _mm_extract_epi32(offset, 2)),
+                    readValue<double>(base, _mm_extract_epi32(offset, 3)))};
+
+    // ordered compares, so NaN is never in range
+    unsigned bits = 0;
+    for (int half = 0; half < 2; half++) {
+      const __m128d value = values[half];
+      const __m128d aboveLow = range.lowInclusive ? _mm_cmpge_pd(value, low)
+                                                  : _mm_cmpgt_pd(value, low);
+      const __m128d belowHigh = range.highInclusive ? _mm_cmple_pd(value, high)
+                                                    : _mm_cmplt_pd(value, high);
+      bits |= _mm_movemask_pd(_mm_and_pd(aboveLow, belowHigh)) << (2 * half);
+    }
+    count += setBits(selection, first,
+                     bits & _mm_movemask_ps(_mm_castsi128_ps(valid)));
+  }
+  return count;
+}
+
+/**
+ * Loads 16 bytes at low and 16 at high into the two halves of a register.
+ */
+__attribute__((target("avx2")))
+static inline __m256i loadHalves(const char *low, const char *high) {
+  return _mm256_inserti128_si256(
+      _mm256_castsi128_si256(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(low))),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(high)), 1);
+}
+
+/**
+ * Reads the slots of eight slot indexes starting at first, like readSlots.
+ * The lanes hold the slots in the order 0 1 4 5 2 3 6 7, which
+ * selectedSlots undoes.
+ */
+__attribute__((target("avx2")))
+static inline __m256i readSlotsAvx2(const char *data, std::size_t numSlots,
+                                    std::size_t first, std::size_t attrOffset,
+                                    std::size_t width, __m256i &offset) {
+  // the loads read 52 bytes; near the end of the page the slots are copied
+  // out first so the loads stay inside it
+  const std::size_t start = first * sizeof(PageSlot);
+  const char *slots = data + start;
+  alignas(32) char copy[64] = {0};
+  if (start + 52 > Page::DATA_SIZE) {
+    std::memcpy(copy, slots, Page::DATA_SIZE - start);
+    slots = copy;
+  }
+  // each 128-bit half holds two slots; slots 0 to 3 in the first register,
+  // 4 to 7 in the second
+  const __m256i front = loadHalves(slots, slots + 2 * sizeof(PageSlot));
+  const __m256i back = loadHalves(slots + 4 * sizeof(PageSlot),
+                                  slots + 6 * sizeof(PageSlot));
+
+  // the two slots of a half go to its first two lanes from front and its
+  // last two from back
+  const __m256i usedFront = _mm256_setr_epi8(
+      0, -1, -1, -1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      0, -1, -1, -1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i usedBack = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1, 6, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1, 6, -1, -1, -1);
+  const __m256i offsetFront = _mm256_setr_epi8(
+      2, 3, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      2, 3, -1, -1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i offsetBack = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1, 8, 9, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1, 8, 9, -1, -1);
+  const __m256i lengthFront = _mm256_setr_epi8(
+      4, 5, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      4, 5, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i lengthBack = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, 10, 11, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, 10, 11, -1, -1);
+  const __m256i used = _mm256_or_si256(_mm256_shuffle_epi8(front, usedFront),
+                                       _mm256_shuffle_epi8(back, usedBack));
+  const __m256i itemOffset =
+      _mm256_or_si256(_mm256_shuffle_epi8(front, offsetFront),
+                      _mm256_shuffle_epi8(back, offsetBack));
+  const __m256i length =
+      _mm256_or_si256(_mm256_shuffle_epi8(front, lengthFront),
+                      _mm256_shuffle_epi8(back, lengthBack));
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i inPage =
+      _mm256_cmpgt_epi32(_mm256_set1_epi32(numSlots - first),
+                         _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+  const __m256i longEnough = _mm256_cmpgt_epi32(
+      length, _mm256_set1_epi32(attrOffset + width - 1));
+  const __m256i inData = _mm256_cmpgt_epi32(
+      _mm256_set1_epi32(Page::DATA_SIZE - attrOffset - width + 1), itemOffset);
+  const __m256i valid = _mm256_andnot_si256(
+      _mm256_cmpeq_epi32(used, zero),
+      _mm256_and_si256(inPage, _mm256_and_si256(longEnough, inData)));
+  offset = _mm256_and_si256(itemOffset, valid);
+  return valid;
+}
+
+/**
+ * Puts the bits of eight lanes in the order 0 1 4 5 2 3 6 7 back in slot
+ * order.
+ */
+static inline unsigned selectedSlots(unsigned bits) {
+  return (bits & 0xc3) | ((bits & 0x0c) << 2) | ((bits & 0x30) >> 2);
+}
+
+__attribute__((target("avx2")))
+static std::size_t selectIntAvx2(const char *data, std::size_t numSlots,
+                                 std::size_t attrOffset, const IntRange &range,
+                                 std::uint64_t *selection) {
+  const __m256i low = _mm256_set1_epi32(range.low);
+  const __m256i high = _mm256_set1_epi32(range.high);
+  const char *base = data + attrOffset;
+  std::size_t count = 0;
+  for (std::size_t first = 0; first < numSlots; first += 8) {
+    __m256i offset;
+    const __m256i valid =
+        readSlotsAvx2(data, numSlots, first, attrOffset, sizeof(int), offset);
+    // scalar loads beat a gather, which is microcoded on some machines
+    alignas(32) int offsets[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(offsets), offset);
+    const __m256i value = _mm256_setr_epi32(
+        readValue<int>(base, offsets[0]), readValue<int>(base, offsets[1]),
+        readValue<int>(base, offsets[2]), readValue<int>(base, offsets[3]),
+        readValue<int>(base, offsets[4]), readValue<int>(base, offsets[5]),
+        readValue<int>(base, offsets[6]), readValue<int>(base, offsets[7]));
+    const __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(low, value),
+                                            _mm256_cmpgt_epi32(value, high));
+    const __m256i selected = _mm256_andnot_si256(outside, valid);
+    count += setBits(selection, first, selectedSlots(_mm256_movemask_ps(
+                                           _mm256_castsi256_ps(selected))));
+  }
+  return count;
+}
+
+template <int LowPredicate, int HighPredicate>
+__attribute__((target("avx2")))
+static std::size_t selectDoubleAvx2(const char *data, std::size_t numSlots,
+                                    std::size_t attrOffset,
+                                    const DoubleRange &range,
+                                    std::uint64_t *selection) {
+  const __m256d low = _mm256_set1_pd(range.low);
+  const __m256d high = _mm256_set1_pd(range.high);
+  const char *base = data + attrOffset;
+  std::size_t count = 0;
+  for (std::size_t first = 0; first < numSlots; first += 8) {
+    __m256i offset;
+    const __m256i valid =
+        readSlotsAvx2(data, numSlots, first, attrOffset, sizeof(double), offset);
+    alignas(32) int offsets[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(offsets), offset);
+    unsigned bits = 0;
+    for (int half = 0; half < 2; half++) {
+      const int *lane = offsets + 4 * half;
+      const __m256d value = _mm256_setr_pd(
+          readValue<double>(base, lane[0]), readValue<double>(base, lane[1]),
+          readValue<double>(base, lane[2]), readValue<double>(base, lane[3]));
+      // ordered compares, so NaN is never in range
+      const __m256d selected =
+          _mm256_and_pd(_mm256_cmp_pd(value, low, LowPredicate),
+                        _mm256_cmp_pd(value, high, HighPredicate));
+      bits |= _mm256_movemask_pd(selected) << (4 * half);
+    }
+    bits &= _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+    count += setBits(selection, first, selectedSlots(bits));
+  }
+  return count;
+}
+
+#endif
+
+/**
+ * Asks CPUID for the fastest kernel the machine supports.
+ */
+static FilterKernel detectKernel() {
+#ifdef PAGE_FILTER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return AVX2_FILTER;
+  if (__builtin_cpu_supports("sse4.2"))
+    return SSE42_FILTER;
+#endif
+  return SCALAR_FILTER;
+}
+
+FilterKernel PageFilter::bestKernel() {
+  static const FilterKernel best = detectKernel();
+  return best;
+}
+
+std::size_t PageFilter::selectInt(const Page &page, std::size_t attrOffset,
+                                  int low, Operator lowOp, int high,
+                                  Operator highOp, std::uint64_t *selection,
+                                  FilterKernel kernel) {
+  std::memset(selection, 0, selectionWords(page) * sizeof(std::uint64_t));
+  const IntRange range = intRange(low, lowOp, high, highOp);
+  if (range.empty || attrOffset + sizeof(int) > Page::DATA_SIZE)
+    return 0;
+
+  const char *data = page.data_;
+  const std::size_t numSlots = page.header_.num_slots;
+  switch (std::min(kernel, bestKernel())) {
+#ifdef PAGE_FILTER_X86
+    case AVX2_FILTER:
+      return selectIntAvx2(data, numSlots, attrOffset, range, selection);
+    case SSE42_FILTER:
+      return selectIntSse42(data, numSlots, attrOffset, range, selection);
+#endif
+    default:
+      return selectIntScalar(data, numSlots, attrOffset, range, selection);
+  }
+}
+
+std::size_t PageFilter::selectDouble(const Page &page, std::size_t attrOffset,
+                                     double low, Operator lowOp, double high,
+                                     Operator highOp, std::uint64_t *selection,
+                                     FilterKernel kernel) {
+  std::memset(selection, 0, selectionWords(page) * sizeof(std::uint64_t));
+  if (attrOffset + sizeof(double) > Page::DATA_SIZE)
+    return 0;
+  const DoubleRange range = {low, lowOp != GT, high, highOp != LT};
+
+  const char *data = page.data_;
+  const std::size_t numSlots = page.header_.num_slots;
+  switch (std::min(kernel, bestKernel())) {
+#ifdef PAGE_FILTER_X86
+    case AVX2_FILTER:
+      if (range.lowInclusive)
+        return range.highInclusive
+                   ? selectDoubleAvx2<_CMP_GE_OQ, _CMP_LE_OQ>(
+                         data, numSlots, attrOffset, range, selection)
+                   : selectDoubleAvx2<_CMP_GE_OQ, _CMP_LT_OQ>(
+                         data, numSlots, attrOffset, range, selection);
+      return range.highInclusive
+                 ? selectDoubleAvx2<_CMP_GT_OQ, _CMP_LE_OQ>(
+                       data, numSlots, attrOffset, range, selection)
+                 : selectDoubleAvx2<_CMP_GT_OQ, _CMP_LT_OQ>(
+                       data, numSlots, attrOffset, range, selection);
+    case SSE42_FILTER:
+      return selectDoubleSse42(data, numSlots, attrOffset, range, selection);
+#endif
+    default:
+      return selectDoubleScalar(data, numSlots, attrOffset, range, selection);
+  }
+}
+
+}
@@ -0,0 +1,103 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "types.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Implementations of the PageFilter kernels, from slowest to fastest.
+ */
+enum FilterKernel {
+  /**
+   * One record at a time.
+   */
+  SCALAR_FILTER,
+
+  /**
+   * Slots read and attributes compared four at a time with SSE4.2.
+   */
+  SSE42_FILTER,
+
+  /**
+   * Slots read and attributes compared eight at a time with AVX2.
+   */
+  AVX2_FILTER
+};
+
+/**
+ * @brief Range filters over an attribute at a fixed byte offset of every
+ * record of a page.
+ *
+ * A filter reads the slot array of the page, takes the attribute from every
+ * used slot whose record is long enough to hold it, compares it against a
+ * low and a high bound and sets bit (slot number - 1) of a selection bitmap
+ * for each record in range. The bitmap has selectionWords(page) words, all
+ * of which are written.
+ *
+ * The kernel is picked at runtime with CPUID; on other than x86 machines
+ * only SCALAR_FILTER is available. Asking for a kernel the machine does not
+ * support runs the best one it does.
+ */
+class PageFilter {
+ public:
+  /**
+   * Returns the fastest kernel the machine supports.
+   */
+  static FilterKernel bestKernel();
+
+  /**
+   * Returns the number of 64-bit words of a selection bitmap for the page.
+   */
+  static std::size_t selectionWords(const Page &page) {
+    return (page.header_.num_slots + 63) / 64;
+  }
+
+  /**
+   * Returns true if the bit of a slot is set in a selection bitmap.
+   */
+  static bool isSelected(const std::uint64_t *selection, SlotId slot) {
+    const std::size_t bit = slot - 1;
+    return (selection[bit / 64] >> (bit % 64)) & 1;
+  }
+
+  /**
+   * Selects the records whose int attribute at attrOffset is in range.
+   *
+   * @param page        Page to filter.
+   * @param attrOffset  Byte offset of the attribute in each record.
+   * @param low         Low bound.
+   * @param lowOp       GT or GTE.
+   * @param high        High bound.
+   * @param highOp      LT or LTE.
+   * @param selection   Bitmap of selectionWords(page) words to fill.
+   * @param kernel      Implementation to use.
+   * @return  Number of records selected.
+   */
+  static std::size_t selectInt(const Page &page, std::size_t attrOffset,
+                               int low, Operator lowOp, int high,
+                               Operator highOp, std::uint64_t *selection,
+                               FilterKernel kernel = bestKernel());
+
+  /**
+   * Selects the records whose double attribute at attrOffset is in range.
+   * NaN is never in range.
+   *
+   * @see selectInt
+   */
+  static std::size_t selectDouble(const Page &page, std::size_t attrOffset,
+                                  double low, Operator lowOp, double high,
+                                  Operator highOp, std::uint64_t *selection,
+                                  FilterKernel kernel = bestKernel());
+};
+
+}
@@ -102,6 +102,15 @@ class PageIterator {
     return page_->getRecord(current_record_);
   }
 
+  /**
+   * Returns a view of the current record in the page, without copying it.
+   *
+   * @return  View of record in page.
+   */
+  inline RecordView view() const {
+    return page_->viewRecord(current_record_);
+  }
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
@@ -121,7 +130,7 @@ class PageIterator {
     return slot_number;
   }
 
-  RecordId getCurrentRecord() {
+  RecordId getCurrentRecord() const {
     return current_record_;
   }
 
@@ -0,0 +1,177 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "parallel_scan.h"
+
+#include <algorithm>
+#include <thread>
+#include "page_filter.h"
+#include "page_iterator.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+const std::size_t ParallelScan::DEFAULT_MORSEL_PAGES;
+
+int ParallelScan::defaultWorkers() {
+  const unsigned threads = std::thread::hardware_concurrency();
+  return threads > 0 ? static_cast<int>(threads) : 1;
+}
+
+ParallelScan::ParallelScan(const std::string &name, BufMgr *bufMgrIn,
+                           int numWorkers)
+    : bufMgr(bufMgrIn), morselPages(DEFAULT_MORSEL_PAGES) {
+  file = new PageFile(name, false);    //dont create new file
+  for (int i = 0; i < (numWorkers > 0 ? numWorkers : 1); i++) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    workers.back()->batch.resize(FileScan::DEFAULT_BATCH_SIZE);
+  }
+  endPage = file->endPageNo();
+}
+
+ParallelScan::~ParallelScan() {
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelScan::setRingSize(std::uint32_t ringSize) {
+  for (std::unique_ptr<Worker> &worker : workers)
+    worker->ring.reset(ringSize > 0 ? new BufAccessStrategy(ringSize) : NULL);
+}
+
+std::size_t ParallelScan::run(const BatchConsumer &consume) {
+  // deal the morsels out in one contiguous run per worker, so each worker
+  // mostly reads consecutive pages
+  const std::size_t numPages = endPage - 1;
+  const std::size_t numMorsels = (numPages + morselPages - 1) / morselPages;
+  const std::size_t numWorkers = workers.size();
+  for (std::size_t w = 0; w < numWorkers; w++) {
+    Worker &worker = *workers[w];
+    worker.morsels.clear();
+    for (std::size_t m = w * numMorsels / numWorkers;
+         m < (w + 1) * numMorsels / numWorkers; m++) {
+      Morsel morsel = {static_cast<PageId>(1 + m * morselPages),
+                       static_cast<PageId>(
+                           1 + std::min((m + 1) * morselPages, numPages))};
+      worker.morsels.push_back(morsel);
+    }
+  }
+
+  RunState state;
+  state.consume = &consume;
+  state.numRecords = 0;
+  state.failed = false;
+
+  std::vector<std::thread> threads;
+  for (std::size_t w = 1; w < numWorkers; w++)
+    threads.push_back(std::thread(&ParallelScan::work, this, w, std::ref(state)));
+  work(0, state);
+  for (std::thread &thread : threads)
+    thread.join();
+
+  if (state.error)
+    std::rethrow_exception(state.error);
+  return state.numRecords;
+}
+
+void ParallelScan::work(int workerNo, RunState &state) {
+  Worker &worker = *workers[workerNo];
+  Morsel morsel;
+  try {
+    while (!state.failed && nextMorsel(workerNo, morsel)) {
+      // read the rest of the morsel while the first page is scanned
+      if (morsel.last - morsel.first > 1) {
+        std::vector<PageId> ahead;
+        for (PageId pageNo = morsel.first + 1; pageNo < morsel.last; pageNo++)
+          ahead.push_back(pageNo);
+        bufMgr->prefetchPages(file, ahead, worker.ring.get());
+      }
+      for (PageId pageNo = morsel.first; pageNo < morsel.last && !state.failed;
+           pageNo++)
+        state.numRecords += scanPage(workerNo, pageNo, state);
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> guard(state.errorLatch);
+    if (!state.error)
+      state.error = std::current_exception();
+    state.failed = true;
+  }
+}
+
+bool ParallelScan::nextMorsel(int workerNo, Morsel &morsel) {
+  {
+    Worker &own = *workers[workerNo];
+    std::lock_guard<std::mutex> guard(own.latch);
+    if (!own.morsels.empty()) {
+      morsel = own.morsels.front();
+      own.morsels.pop_front();
+      return true;
+    }
+  }
+
+  // steal the last morsel of the next worker that has any, which is the one
+  // that worker would get to last
+  const std::size_t numWorkers = workers.size();
+  for (std::size_t i = 1; i < numWorkers; i++) {
+    Worker &victim = *workers[(workerNo + i) % numWorkers];
+    std::lock_guard<std::mutex> guard(victim.latch);
+    if (!victim.morsels.empty()) {
+      morsel = victim.morsels.back();
+      victim.morsels.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+std::size_t ParallelScan::scanPage(int workerNo, PageId pageNo,
+                                   RunState &state) {
+  Worker &worker = *workers[workerNo];
+  Page *page;
+  try {
+    bufMgr->readPage(file, pageNo, page, worker.ring.get());
+  } catch (InvalidPageException &e) {
+    // a free page
+    return 0;
+  }
+
+  std::size_t numRecords = 0;
+  try {
+    const bool filtered = !predicate.empty();
+    const bool selected =
+        filtered && predicate.selectSlots(*page, worker.selection);
+    std::size_t count = 0;
+    for (PageIterator iter = page->begin(); iter != page->end(); iter++) {
+      const RecordId rid = iter.getCurrentRecord();
+      const RecordView record = iter.view();
+      if (filtered &&
+          !(selected ? PageFilter::isSelected(worker.selection.data(),
+                                              rid.slot_number)
+                     : predicate.matches(record.data(), record.size())))
+        continue;
+
+      worker.batch[count].rid = rid;
+      worker.batch[count].record = record;
+      if (++count == worker.batch.size()) {
+        (*state.consume)(workerNo, worker.batch.data(), count);
+        numRecords += count;
+        count = 0;
+      }
+    }
+    if (count > 0) {
+      (*state.consume)(workerNo, worker.batch.data(), count);
+      numRecords += count;
+    }
+  } catch (...) {
+    bufMgr->unPinPage(file, pageNo, false);
+    throw;
+  }
+  bufMgr->unPinPage(file, pageNo, false);
+  return numRecords;
+}
+
+}
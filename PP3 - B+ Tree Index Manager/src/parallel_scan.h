@@ -0,0 +1,224 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "filescan.h"
+#include "scan_predicate.h"
+
+namespace badgerdb {
+
+/**
+ * @brief A scan of a relation split across worker threads.
+ *
+ * The pages of the relation are numbered 1 up to File::endPageNo, so the
+ * workers do not follow the page links one page at a time: the page numbers
+ * are cut into morsels of consecutive pages which are dealt out to the
+ * workers in contiguous runs, and a worker skips the free pages it meets. A worker takes morsels from
+ * the front of its own run and, once that is empty, steals from the back of
+ * the other workers' runs, so a slow worker does not hold up the scan.
+ *
+ * The calling thread is one of the workers. Each worker passes the records
+ * of one page at a time, in batches of up to FileScan::DEFAULT_BATCH_SIZE,
+ * to the consumer given to run. The consumer is called from all workers at
+ * once and is told which worker is calling, so it can keep per-worker state
+ * without locking. The views in a batch are valid until the consumer returns.
+ *
+ * The scan is read only: pages are unpinned clean.
+ */
+class ParallelScan {
+ public:
+  /**
+   * Pages per morsel.
+   */
+  static const std::size_t DEFAULT_MORSEL_PAGES = 16;
+
+  /**
+   * Called with the worker number, from 0 to numWorkers() - 1, and a batch of
+   * records.
+   */
+  typedef std::function<void(int worker, const ScanRecord *batch,
+                             std::size_t count)> BatchConsumer;
+
+  /**
+   * Returns the number of workers used when none is given: the number of
+   * hardware threads.
+   */
+  static int defaultWorkers();
+
+  /**
+   * Open a scan of the relation.
+   *
+   * @param name        Name of the relation file.
+   * @param bufMgr      Buffer manager pages are read through.
+   * @param numWorkers  Number of threads scanning, at least 1.
+   */
+  ParallelScan(const std::string &name, BufMgr *bufMgr,
+               int numWorkers = defaultWorkers());
+
+  /**
+   * Flushes the pages of the relation and closes it.
+   */
+  ~ParallelScan();
+
+  /**
+   * Restrict the scan to records satisfying the predicate.
+   */
+  void setPredicate(const ScanPredicate &scanPredicate) {
+    predicate = scanPredicate;
+  }
+
+  /**
+   * Set the number of pages per morsel.
+   */
+  void setMorselPages(std::size_t pages) {
+    morselPages = pages > 0 ? pages : 1;
+  }
+
+  /**
+   * Have each worker read pages through a BufAccessStrategy ring of the given
+   * size, so the scan does not fill the buffer pool; 0 turns the rings off,
+   * which is the default.
+   */
+  void setRingSize(std::uint32_t ringSize);
+
+  /**
+   * Returns the number of workers.
+   */
+  int numWorkers() const { return static_cast<int>(workers.size()); }
+
+  /**
+   * Returns the number of pages of the relation, used or free, when the scan
+   * was opened.
+   */
+  std::size_t numPages() const { return endPage - 1; }
+
+  /**
+   * Scans the whole relation once, passing every record satisfying the
+   * predicate to consume exactly once. If consume throws, the workers stop
+   * after the pages they are on and the first exception is rethrown once all
+   * have stopped.
+   *
+   * @param consume  Receives the records, from all workers at once.
+   * @return  Number of records passed to consume.
+   */
+  std::size_t run(const BatchConsumer &consume);
+
+ private:
+  /**
+   * Consecutive pages of the scan, from first up to last.
+   */
+  struct Morsel {
+    PageId first;
+    PageId last;
+  };
+
+  /**
+   * Morsels left to a worker, and what it scans pages with.
+   */
+  struct Worker {
+    /**
+     * Latch guarding morsels against thieves.
+     */
+    std::mutex latch;
+
+    /**
+     * Morsels the worker has not started, in page order.
+     */
+    std::deque<Morsel> morsels;
+
+    /**
+     * Ring the worker reads pages through, or NULL.
+     */
+    std::unique_ptr<BufAccessStrategy> ring;
+
+    /**
+     * Records of the current page passed on to the consumer.
+     */
+    std::vector<ScanRecord> batch;
+
+    /**
+     * Records of the current page satisfying the predicate, one bit per slot.
+     */
+    std::vector<std::uint64_t> selection;
+  };
+
+  /**
+   * State shared by the workers during run.
+   */
+  struct RunState {
+    const BatchConsumer *consume;
+    std::atomic<std::size_t> numRecords;
+    std::atomic<bool> failed;
+    std::mutex errorLatch;
+    std::exception_ptr error;
+  };
+
+  /**
+   * Body of a worker: scans morsels until there are none left or another
+   * worker failed.
+   */
+  void work(int workerNo, RunState &state);
+
+  /**
+   * Takes the next morsel of a worker, stealing one if it has none left.
+   * Returns false once every worker's morsels are taken.
+   */
+  bool nextMorsel(int workerNo, Morsel &morsel);
+
+  /**
+   * Passes the records of one page satisfying the predicate to the consumer.
+   * Returns the number of records passed, 0 if the page is free.
+   */
+  std::size_t scanPage(int workerNo, PageId pageNo, RunState &state);
+
+  /**
+   * File which is being scanned.
+   */
+  PageFile *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * One past the highest page number of the relation.
+   */
+  PageId endPage;
+
+  /**
+   * Pages per morsel.
+   */
+  std::size_t morselPages;
+
+  /**
+   * Condition records must satisfy to be returned.
+   */
+  ScanPredicate predicate;
+
+  /**
+   * One per worker thread.
+   */
+  std::vector<std::unique_ptr<Worker> > workers;
+};
+
+}
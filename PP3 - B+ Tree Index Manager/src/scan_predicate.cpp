@@ -0,0 +1,180 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "scan_predicate.h"
+
+#include <cstring>
+#include <limits>
+#include "page_filter.h"
+
+namespace badgerdb {
+
+ScanPredicate::ScanPredicate() : terms(1) {
+}
+
+ScanPredicate &ScanPredicate::andInt(std::size_t offset, Operator op, int value) {
+  Condition condition;
+  condition.field = ScanField{offset, sizeof(int)};
+  condition.type = INTEGER;
+  condition.op = op;
+  condition.intValue = value;
+  condition.doubleValue = 0;
+  terms.back().push_back(condition);
+  return *this;
+}
+
+ScanPredicate &ScanPredicate::andDouble(std::size_t offset, Operator op, double value) {
+  Condition condition;
+  condition.field = ScanField{offset, sizeof(double)};
+  condition.type = DOUBLE;
+  condition.op = op;
+  condition.intValue = 0;
+  condition.doubleValue = value;
+  terms.back().push_back(condition);
+  return *this;
+}
+
+ScanPredicate &ScanPredicate::andString(std::size_t offset, std::size_t width,
+                                        Operator op, const std::string &value) {
+  Condition condition;
+  condition.field = ScanField{offset, width};
+  condition.type = STRING;
+  condition.op = op;
+  condition.intValue = 0;
+  condition.doubleValue = 0;
+  condition.stringValue = value.substr(0, width);
+  condition.stringValue.resize(width, '\0');
+  terms.back().push_back(condition);
+  return *this;
+}
+
+ScanPredicate &ScanPredicate::orElse() {
+  if (!terms.back().empty())
+    terms.push_back(std::vector<Condition>());
+  return *this;
+}
+
+bool ScanPredicate::satisfies(int cmp, Operator op) {
+  switch (op) {
+    case LT:
+      return cmp < 0;
+    case LTE:
+      return cmp <= 0;
+    case GTE:
+      return cmp >= 0;
+    case GT:
+      return cmp > 0;
+    case EQ:
+      return cmp == 0;
+    case NE:
+    default:
+      return cmp != 0;
+  }
+}
+
+bool ScanPredicate::matches(const Condition &condition, const char *record,
+                            std::size_t length) {
+  const ScanField &field = condition.field;
+  if (field.offset + field.width > length)
+    return false;
+  const char *bytes = record + field.offset;
+
+  int cmp;
+  switch (condition.type) {
+    case INTEGER: {
+      int value;
+      std::memcpy(&value, bytes, sizeof(value));
+      cmp = value < condition.intValue ? -1 : value > condition.intValue ? 1 : 0;
+      break;
+    }
+    case DOUBLE: {
+      double value;
+      std::memcpy(&value, bytes, sizeof(value));
+      // NaN compares unequal to everything
+      if (value != value || condition.doubleValue != condition.doubleValue)
+        return condition.op == NE;
+      cmp = value < condition.doubleValue ? -1 : value > condition.doubleValue ? 1 : 0;
+      break;
+    }
+    case STRING:
+    default:
+      cmp = std::strncmp(bytes, condition.stringValue.data(), field.width);
+      break;
+  }
+  return satisfies(cmp, condition.op);
+}
+
+bool ScanPredicate::matches(const char *record, std::size_t length) const {
+  if (empty())
+    return true;
+  for (const std::vector<Condition> &term : terms) {
+    // an empty term, left by a trailing orElse, adds nothing
+    if (term.empty())
+      continue;
+    bool all = true;
+    for (const Condition &condition : term) {
+      if (!matches(condition, record, length)) {
+        all = false;
+        break;
+      }
+    }
+    if (all)
+      return true;
+  }
+  return false;
+}
+
+bool ScanPredicate::selectSlots(const Page &page,
+                                std::vector<std::uint64_t> &selection) const {
+  for (const std::vector<Condition> &term : terms)
+    for (const Condition &condition : term)
+      if (condition.type == STRING || condition.op == NE)
+        return false;
+
+  const std::size_t words = PageFilter::selectionWords(page);
+  selection.assign(words, 0);
+  std::vector<std::uint64_t> termSelection(words);
+  std::vector<std::uint64_t> conditionSelection(words);
+  for (const std::vector<Condition> &term : terms) {
+    if (term.empty() && !empty())
+      continue;
+    termSelection.assign(words, ~0ULL);
+    for (const Condition &condition : term) {
+      selectCondition(page, condition, conditionSelection.data());
+      for (std::size_t i = 0; i < words; i++)
+        termSelection[i] &= conditionSelection[i];
+    }
+    for (std::size_t i = 0; i < words; i++)
+      selection[i] |= termSelection[i];
+  }
+  return true;
+}
+
+void ScanPredicate::selectCondition(const Page &page, const Condition &condition,
+                                    std::uint64_t *selection) {
+  // each condition is a range with an open or closed bound on each side
+  const std::size_t offset = condition.field.offset;
+  const Operator lowOp = condition.op == GT ? GT : GTE;
+  const Operator highOp = condition.op == LT ? LT : LTE;
+  const bool hasLow = condition.op == GT || condition.op == GTE || condition.op == EQ;
+  const bool hasHigh = condition.op == LT || condition.op == LTE || condition.op == EQ;
+
+  if (condition.type == INTEGER) {
+    const int value = condition.intValue;
+    PageFilter::selectInt(page, offset,
+                          hasLow ? value : std::numeric_limits<int>::min(), lowOp,
+                          hasHigh ? value : std::numeric_limits<int>::max(), highOp,
+                          selection);
+  } else {
+    const double value = condition.doubleValue;
+    const double infinity = std::numeric_limits<double>::infinity();
+    PageFilter::selectDouble(page, offset, hasLow ? value : -infinity, lowOp,
+                             hasHigh ? value : infinity, highOp, selection);
+  }
+}
+
+}
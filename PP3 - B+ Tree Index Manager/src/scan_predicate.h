@@ -0,0 +1,138 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "types.h"
+
+namespace badgerdb {
+
+class Page;
+
+/**
+ * @brief A fixed-width field of a record, given by its byte offset.
+ */
+struct ScanField {
+  /**
+   * Offset of the field from the start of the record.
+   */
+  std::size_t offset;
+
+  /**
+   * Width of the field in bytes.
+   */
+  std::size_t width;
+};
+
+/**
+ * @brief A condition on the fields of a record, evaluated on the record's
+ * bytes in place.
+ *
+ * A predicate is an OR of terms, each an AND of comparisons of a field at a
+ * fixed offset with a constant. Conditions are added to the current term;
+ * orElse() starts a new one. A range is two conditions on the same field.
+ * INTEGER and DOUBLE fields need not be aligned. STRING fields are
+ * char arrays of a given width compared like strncmp, so they may be
+ * NUL-terminated early. A record too short to hold a field fails any
+ * condition on it. A predicate without conditions matches every record.
+ */
+class ScanPredicate {
+ public:
+  ScanPredicate();
+
+  /**
+   * Adds the condition (int field at offset) op value to the current term.
+   */
+  ScanPredicate &andInt(std::size_t offset, Operator op, int value);
+
+  /**
+   * Adds the condition (double field at offset) op value to the current term.
+   */
+  ScanPredicate &andDouble(std::size_t offset, Operator op, double value);
+
+  /**
+   * Adds the condition (char[width] field at offset) op value to the current
+   * term. value is cut or NUL-padded to width bytes.
+   */
+  ScanPredicate &andString(std::size_t offset, std::size_t width, Operator op,
+                           const std::string &value);
+
+  /**
+   * Starts a new term, ORed with the ones before it. A term left without
+   * conditions adds nothing; only a predicate with no conditions at all
+   * matches every record.
+   */
+  ScanPredicate &orElse();
+
+  /**
+   * Returns true if the predicate has no conditions.
+   */
+  bool empty() const { return terms.size() == 1 && terms[0].empty(); }
+
+  /**
+   * Returns true if the record satisfies the predicate.
+   *
+   * @param record  First byte of the record.
+   * @param length  Length of the record in bytes.
+   */
+  bool matches(const char *record, std::size_t length) const;
+
+  /**
+   * Evaluates the predicate on every record of a page at once with the
+   * PageFilter kernels, setting bit (slot number - 1) of selection for each
+   * record satisfying it. Only INTEGER and DOUBLE conditions other than NE
+   * can be evaluated this way.
+   *
+   * @param page       Page to evaluate the predicate on.
+   * @param selection  Resized to PageFilter::selectionWords(page) and filled.
+   * @return  False, leaving selection alone, if the predicate has conditions
+   *          the kernels cannot evaluate.
+   */
+  bool selectSlots(const Page &page, std::vector<std::uint64_t> &selection) const;
+
+ private:
+  /**
+   * Comparison of one field with a constant.
+   */
+  struct Condition {
+    ScanField field;
+    Datatype type;
+    Operator op;
+    int intValue;
+    double doubleValue;
+    std::string stringValue;
+  };
+
+  /**
+   * Returns true if the result of a three-way comparison satisfies op.
+   */
+  static bool satisfies(int cmp, Operator op);
+
+  /**
+   * Returns true if the record satisfies one condition.
+   */
+  static bool matches(const Condition &condition, const char *record,
+                      std::size_t length);
+
+  /**
+   * Sets the bits of selection for the records of a page satisfying one
+   * INTEGER or DOUBLE condition other than NE.
+   */
+  static void selectCondition(const Page &page, const Condition &condition,
+                              std::uint64_t *selection);
+
+  /**
+   * Terms of the predicate, each a list of conditions that must all hold.
+   */
+  std::vector<std::vector<Condition> > terms;
+};
+
+}